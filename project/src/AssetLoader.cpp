@@ -0,0 +1,166 @@
+//
+//  Parallel asset loading
+//  images are decoded on the global thread pool (or read back from the
+//  texture cache) and handed to the upload thread as finished mip chains
+//
+#include <QThreadPool>
+#include <QRunnable>
+#include <QFile>
+#include <memory>
+#include <stdio.h>
+#include "AssetLoader.h"
+
+//
+//  Adapts a function to QThreadPool
+//
+class PoolJob : public QRunnable
+{
+public:
+   PoolJob(std::function<void()> f) : work(f) {}
+   void run() { work(); }
+private:
+   std::function<void()> work;
+};
+
+//
+//  Create a texture from a prebuilt mip chain, upload thread only
+//
+static QOpenGLTexture *createTexture(const MipImage &img)
+{
+   QOpenGLTexture *tex = new QOpenGLTexture(QOpenGLTexture::Target2D);
+   bool bc1 = (img.format == TEX_BC1);
+   tex->setSize(img.width, img.height);
+   tex->setMipLevels(img.levels.size());
+   tex->setFormat(bc1 ? QOpenGLTexture::RGB_DXT1 : QOpenGLTexture::RGBA8_UNorm);
+   tex->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+   for (unsigned int i = 0; i < img.levels.size(); i++)
+   {
+      if (bc1)
+         tex->setCompressedData(i, img.levels[i].size(), img.levels[i].constData());
+      else
+         tex->setData(i, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, img.levels[i].constData());
+   }
+   tex->setMinMagFilters(QOpenGLTexture::LinearMipMapLinear, QOpenGLTexture::Linear);
+   return tex;
+}
+
+AssetLoader::AssetLoader(GLUploader *uploader, bool compress)
+{
+   gl = uploader;
+   this->compress = compress;
+   outstanding = 0;
+   clock.start();
+}
+
+//
+//  Load a texture through the cache, *dest stays NULL until it is ready
+//
+void AssetLoader::loadTexture(const QString &file, QOpenGLTexture **dest)
+{
+   lock.lock();
+   outstanding++;
+   lock.unlock();
+   bool bc1 = compress;
+   QThreadPool::globalInstance()->start(new PoolJob([this,file,dest,bc1]()
+   {
+      QElapsedTimer t;
+      t.start();
+      std::shared_ptr<AssetTiming> timing(new AssetTiming);
+      std::shared_ptr<MipImage> img(new MipImage);
+      std::shared_ptr<QOpenGLTexture*> tex(new QOpenGLTexture*(NULL));
+      timing->name = file;
+
+      QFile src(file);
+      QByteArray bytes;
+      bool found = src.open(QIODevice::ReadOnly);
+      if (found)
+         bytes = src.readAll();
+      QString path = cachePath(hashBytes(bytes), bc1);
+      timing->cached = found && readCache(path, *img);
+      if (!timing->cached)
+      {
+         QImage image;
+         bool decoded = image.loadFromData(bytes);
+         if (!decoded)
+         {
+            // a missing or broken asset shows as magenta and is never cached
+            fprintf(stderr, "cannot load texture %s\n", file.toLocal8Bit().constData());
+            image = QImage(1, 1, QImage::Format_RGBA8888);
+            image.fill(Qt::magenta);
+         }
+         buildMips(image, bc1, *img);
+         if (decoded) writeCache(path, *img);
+      }
+      timing->load_ms = t.nsecsElapsed()/1e6;
+
+      gl->upload([img,tex,timing](QOpenGLExtraFunctions*)
+                 {
+                    QElapsedTimer u;
+                    u.start();
+                    *tex = createTexture(*img);
+                    timing->upload_ms = u.nsecsElapsed()/1e6;
+                 },
+                 [this,dest,tex,timing]()
+                 {
+                    *dest = *tex;
+                    finished(*timing);
+                 });
+   }));
+}
+
+//
+//  Run any other startup work on the pool and time it
+//
+void AssetLoader::run(const QString &name, std::function<void()> work)
+{
+   lock.lock();
+   outstanding++;
+   lock.unlock();
+   QThreadPool::globalInstance()->start(new PoolJob([this,name,work]()
+   {
+      QElapsedTimer t;
+      AssetTiming timing;
+      t.start();
+      work();
+      timing.name = name;
+      timing.load_ms = t.nsecsElapsed()/1e6;
+      timing.upload_ms = 0;
+      timing.cached = false;
+      finished(timing);
+   }));
+}
+
+bool AssetLoader::busy()
+{
+   QMutexLocker locker(&lock);
+   return outstanding > 0;
+}
+
+void AssetLoader::finished(const AssetTiming &timing)
+{
+   QMutexLocker locker(&lock);
+   timings.push_back(timing);
+   if (--outstanding == 0)
+      report();
+}
+
+//
+//  Print the startup timing report once everything has landed
+//
+void AssetLoader::report()
+{
+   double load = 0, upload = 0;
+   fprintf(stderr, "startup assets (%d pool threads):\n",
+           QThreadPool::globalInstance()->maxThreadCount());
+   for (unsigned int i = 0; i < timings.size(); i++)
+   {
+      fprintf(stderr, "  %-20s load %8.2f ms  upload %7.2f ms  %s\n",
+              timings[i].name.toLocal8Bit().constData(),
+              timings[i].load_ms, timings[i].upload_ms,
+              timings[i].cached ? "(cached)" : "");
+      load += timings[i].load_ms;
+      upload += timings[i].upload_ms;
+   }
+   fprintf(stderr, "  total load %.2f ms, upload %.2f ms, ready after %.2f ms\n",
+           load, upload, clock.nsecsElapsed()/1e6);
+}
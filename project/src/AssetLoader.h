@@ -0,0 +1,45 @@
+//
+// decodes startup assets in parallel and reports where the time went
+//
+
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <QString>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QOpenGLTexture>
+#include <functional>
+#include <vector>
+#include "GLUploader.h"
+#include "TexCache.h"
+
+typedef struct AssetTiming
+{
+	QString name;
+	double load_ms;   // read/decode/mipmap on a pool thread
+	double upload_ms; // GL upload on the upload thread
+	bool cached;
+} AssetTiming;
+
+class AssetLoader
+{
+public:
+	AssetLoader(GLUploader *uploader, bool compress);
+	void loadTexture(const QString &file, QOpenGLTexture **dest);
+	void run(const QString &name, std::function<void()> work);
+	bool busy(); // jobs still decoding or waiting to be published
+	GLUploader *gl;
+
+private:
+	bool compress;
+	int outstanding;
+	QMutex lock;
+	QElapsedTimer clock;
+	std::vector<AssetTiming> timings;
+
+	void finished(const AssetTiming &timing);
+	void report();
+};
+
+#endif
@@ -0,0 +1,65 @@
+//
+//  Camera path
+//  one keyframe per line: <time ms> <th> <ph> <dim> [<cx> <cy> <cz>],
+//  values are interpolated linearly and held past either end, so
+//  write angles unwrapped (350 then 370, not 350 then 10)
+//
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <algorithm>
+#include "CameraPath.h"
+
+bool CameraPath::load(const QString &path)
+{
+   QFile in(path);
+   if (!in.open(QIODevice::ReadOnly | QIODevice::Text))
+      return false;
+   QTextStream stream(&in);
+   keys.clear();
+   while (!stream.atEnd())
+   {
+      QStringList tokens = stream.readLine().split(' ', QString::SkipEmptyParts);
+      if (tokens.size() < 4 || tokens[0].startsWith('#')) continue;
+      CamKey key;
+      key.time = tokens[0].toDouble();
+      key.th = tokens[1].toDouble();
+      key.ph = tokens[2].toDouble();
+      key.dim = tokens[3].toDouble();
+      key.has_center = tokens.size() >= 7;
+      if (key.has_center)
+         key.center = glm::vec3(tokens[4].toFloat(), tokens[5].toFloat(), tokens[6].toFloat());
+      keys.push_back(key);
+   }
+   std::stable_sort(keys.begin(), keys.end(),
+                    [](const CamKey &a, const CamKey &b) {return a.time < b.time;});
+   return true;
+}
+
+bool CameraPath::sample(double time, CamKey *key) const
+{
+   if (keys.empty()) return false;
+   if (time <= keys.front().time)
+   {
+      *key = keys.front();
+      return true;
+   }
+   if (time >= keys.back().time)
+   {
+      *key = keys.back();
+      return true;
+   }
+   unsigned int i = 1;
+   while (keys[i].time < time)
+      i++;
+   const CamKey &a = keys[i-1], &b = keys[i];
+   double s = (time - a.time)/(b.time - a.time);
+   key->time = time;
+   key->th = a.th + s*(b.th - a.th);
+   key->ph = a.ph + s*(b.ph - a.ph);
+   key->dim = a.dim + s*(b.dim - a.dim);
+   key->has_center = a.has_center && b.has_center;
+   if (key->has_center)
+      key->center = a.center + (float)s*(b.center - a.center);
+   return true;
+}
@@ -0,0 +1,32 @@
+//
+// keyframed camera path for scripted runs
+//
+
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <QString>
+#include <glm/glm.hpp>
+#include <vector>
+
+typedef struct CamKey
+{
+	double time;       // replay time in ms
+	double th, ph;     // azimuth and elevation in degrees
+	double dim;
+	bool has_center;   // otherwise the view center is left alone
+	glm::vec3 center;
+} CamKey;
+
+class CameraPath
+{
+public:
+	bool load(const QString &path);
+	bool sample(double time, CamKey *key) const; // false if the path is empty
+	bool empty() const {return keys.empty();}
+
+private:
+	std::vector<CamKey> keys; // sorted by time
+};
+
+#endif
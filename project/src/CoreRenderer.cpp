@@ -0,0 +1,390 @@
+//
+//  Core profile renderer
+//  meshes live in vertex array objects, and a draw list of mesh,
+//  material and model matrix is drawn with one program that does the
+//  lighting and the shadow map lookup itself; the GL state cache sees
+//  the program, texture and array buffer changes, element buffers are
+//  only ever bound inside a mesh's vertex array object
+//
+#include "CoreRenderer.h"
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+enum {U_MODEL, U_VIEWPROJ, U_INSTANCED, U_SHADOWMAT, U_COLOR, U_TEXTURED, U_LIT, U_SPECULAR,
+      U_SHININESS, U_SHADOWED, U_TEX, U_DEPTH, U_LIGHTPOS, U_EYE, U_AMBIENT, U_DIFFUSE};
+
+static const char *uniform_names[CORE_UNIFORMS] =
+   {"Model", "ViewProj", "Instanced", "ShadowMat", "Color", "Textured", "Lit", "Specular",
+    "Shininess", "Shadowed", "Tex", "Depth", "LightPos", "Eye", "Ambient", "Diffuse"};
+
+static bool sameMaterial(const Material &a, const Material &b)
+{
+   return a.color == b.color && a.texture == b.texture && a.textured == b.textured &&
+          a.lit == b.lit && a.specular == b.specular && a.shininess == b.shininess &&
+          a.offset == b.offset;
+}
+
+void RenderList::add(const RenderMesh *mesh, const Material &material, const glm::mat4 &model, GLsizei count)
+{
+   RenderCmd cmd;
+   cmd.mesh = mesh;
+   cmd.material = material;
+   cmd.model = model;
+   cmd.count = count;
+   cmd.instances = 0;
+   cmd.instance_count = 0;
+   cmds.push_back(cmd);
+}
+
+void RenderList::addInstanced(const RenderMesh *mesh, const Material &material, const glm::mat4 &model,
+                              GLuint buffer, int count)
+{
+   add(mesh, material, model);
+   cmds.back().instances = buffer;
+   cmds.back().instance_count = count;
+}
+
+//
+//  Decals go last so they land on what they are offset from
+//
+void RenderList::sort()
+{
+   std::stable_sort(cmds.begin(), cmds.end(), [](const RenderCmd &a, const RenderCmd &b)
+   {
+      if (a.material.offset != b.material.offset) return b.material.offset;
+      return a.material.texture < b.material.texture;
+   });
+}
+
+MeshBuilder::MeshBuilder()
+{
+   material.color = glm::vec4(1);
+   material.texture = 0;
+   material.textured = false;
+   material.lit = true;
+   material.specular = 0;
+   material.shininess = 1;
+   material.offset = false;
+   mode = GL_TRIANGLES;
+   cur_normal = glm::vec3(0,0,1);
+   cur_tex = glm::vec2(0);
+}
+
+void MeshBuilder::begin(GLenum mode)
+{
+   this->mode = mode;
+   prim.clear();
+}
+
+void MeshBuilder::vertex(float x, float y, float z)
+{
+   const glm::mat4 &m = matrices.top();
+   glm::vec3 p = glm::vec3(m*glm::vec4(x,y,z,1));
+   glm::vec3 n = glm::mat3(m)*cur_normal;
+   float v[MESH_STRIDE] = {p.x, p.y, p.z, cur_tex.s, cur_tex.t, n.x, n.y, n.z};
+   prim.insert(prim.end(), v, v+MESH_STRIDE);
+}
+
+MeshBuilder::Batch &MeshBuilder::batch()
+{
+   for (unsigned int i = 0; i < batches.size(); i++)
+      if (sameMaterial(batches[i].material, material))
+         return batches[i];
+   batches.push_back(Batch());
+   batches.back().material = material;
+   return batches.back();
+}
+
+//
+//  Split the primitive into triangles with the winding GL gives them
+//
+void MeshBuilder::end()
+{
+   int n = prim.size()/MESH_STRIDE;
+   if (n < 3) return;
+   Batch &b = batch();
+   unsigned int base = b.verts.size()/MESH_STRIDE;
+   b.verts.insert(b.verts.end(), prim.begin(), prim.end());
+   std::vector<unsigned int> &idx = b.indices;
+   switch (mode)
+   {
+   case GL_TRIANGLES:
+      for (int i = 0; i+2 < n; i += 3)
+         idx.insert(idx.end(), {base+i, base+i+1, base+i+2});
+      break;
+   case GL_QUADS:
+      for (int i = 0; i+3 < n; i += 4)
+         idx.insert(idx.end(), {base+i, base+i+1, base+i+2, base+i, base+i+2, base+i+3});
+      break;
+   case GL_QUAD_STRIP:
+      for (int i = 0; i+3 < n; i += 2)
+         idx.insert(idx.end(), {base+i, base+i+1, base+i+3, base+i, base+i+3, base+i+2});
+      break;
+   case GL_TRIANGLE_STRIP:
+      for (int i = 0; i+2 < n; i++)
+         if (i%2)
+            idx.insert(idx.end(), {base+i+1, base+i, base+i+2});
+         else
+            idx.insert(idx.end(), {base+i, base+i+1, base+i+2});
+      break;
+   default: // GL_POLYGON and GL_TRIANGLE_FAN
+      for (int i = 1; i+1 < n; i++)
+         idx.insert(idx.end(), {base, base+i, base+i+1});
+      break;
+   }
+   prim.clear();
+}
+
+void MeshBuilder::build(CoreRenderer *renderer, RenderList &parts)
+{
+   for (unsigned int i = 0; i < batches.size(); i++)
+   {
+      Batch &b = batches[i];
+      parts.add(renderer->createMesh(b.verts, b.indices, GL_TRIANGLES), b.material, glm::mat4(1));
+   }
+   batches.clear();
+}
+
+CoreRenderer::CoreRenderer()
+{
+   gl = NULL;
+   state = NULL;
+   shader = depth_shader = NULL;
+   mesh_bytes = 0;
+   memset(loc, -1, sizeof(loc));
+}
+
+CoreRenderer::~CoreRenderer()
+{
+   delete shader;
+   delete depth_shader;
+   for (unsigned int i = 0; i < meshes.size(); i++)
+   {
+      RenderMesh *mesh = meshes[i];
+      if (gl)
+      {
+         gl->glDeleteVertexArrays(1, &mesh->vao);
+         if (mesh->owned)
+         {
+            gl->glDeleteBuffers(1, &mesh->vbo);
+            if (mesh->ibo) gl->glDeleteBuffers(1, &mesh->ibo);
+         }
+      }
+      delete mesh;
+   }
+}
+
+static QOpenGLShaderProgram *compile(const char *vert, const char *frag)
+{
+   QOpenGLShaderProgram *program = new QOpenGLShaderProgram();
+   if (!program->addShaderFromSourceFile(QOpenGLShader::Vertex, vert) ||
+       !program->addShaderFromSourceFile(QOpenGLShader::Fragment, frag) ||
+       !program->link())
+   {
+      std::cerr << "Core renderer disabled: " << program->log().toStdString() << std::endl;
+      delete program;
+      return NULL;
+   }
+   return program;
+}
+
+//
+//  False if the shaders don't build, the caller keeps the
+//  fixed-function path then
+//
+bool CoreRenderer::initGL(QOpenGLFunctions_3_3_Compatibility *gl, GLState *state)
+{
+   this->gl = gl;
+   this->state = state;
+   if (!gl) return false;
+   shader = compile("core.vert", "core.frag");
+   depth_shader = compile("core_depth.vert", "core_depth.frag");
+   if (!shader || !depth_shader) return false;
+   // names a program doesn't use stay at -1 and are skipped by GL
+   for (int i = 0; i < CORE_UNIFORMS; i++)
+   {
+      loc[0][i] = shader->uniformLocation(uniform_names[i]);
+      loc[1][i] = depth_shader->uniformLocation(uniform_names[i]);
+   }
+   return true;
+}
+
+RenderMesh *CoreRenderer::createMesh(const std::vector<float> &verts, const std::vector<unsigned int> &indices,
+                                     GLenum mode)
+{
+   RenderMesh *mesh = new RenderMesh;
+   mesh->owned = true;
+   mesh->mode = mode;
+   mesh->stride = MESH_STRIDE;
+   mesh->ibo = 0;
+   mesh->count = indices.empty() ? verts.size()/MESH_STRIDE : indices.size();
+   gl->glGenBuffers(1, &mesh->vbo);
+   state->bindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+   gl->glBufferData(GL_ARRAY_BUFFER, verts.size()*sizeof(float), verts.data(), GL_STATIC_DRAW);
+   state->bindBuffer(GL_ARRAY_BUFFER, 0);
+   if (!indices.empty()) gl->glGenBuffers(1, &mesh->ibo);
+   setupMesh(mesh);
+   if (mesh->ibo)
+   {
+      // the element binding belongs to the vertex array
+      gl->glBindVertexArray(mesh->vao);
+      gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+      gl->glBindVertexArray(0);
+   }
+   mesh_bytes += verts.size()*sizeof(float) + indices.size()*sizeof(unsigned int);
+   meshes.push_back(mesh);
+   return mesh;
+}
+
+RenderMesh *CoreRenderer::wrapMesh(GLuint vbo, GLuint ibo, GLsizei count, GLenum mode, int stride)
+{
+   RenderMesh *mesh = new RenderMesh;
+   mesh->owned = false;
+   mesh->vbo = vbo;
+   mesh->ibo = ibo;
+   mesh->count = count;
+   mesh->mode = mode;
+   mesh->stride = stride;
+   setupMesh(mesh);
+   meshes.push_back(mesh);
+   return mesh;
+}
+
+void CoreRenderer::setupMesh(RenderMesh *mesh)
+{
+   GLsizei stride = mesh->stride*sizeof(float);
+   gl->glGenVertexArrays(1, &mesh->vao);
+   gl->glBindVertexArray(mesh->vao);
+   state->bindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+   gl->glEnableVertexAttribArray(CORE_POSITION);
+   gl->glVertexAttribPointer(CORE_POSITION, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+   if (mesh->stride == MESH_STRIDE)
+   {
+      gl->glEnableVertexAttribArray(CORE_TEXCOORD);
+      gl->glVertexAttribPointer(CORE_TEXCOORD, 2, GL_FLOAT, GL_FALSE, stride, (void*)(3*sizeof(float)));
+      gl->glEnableVertexAttribArray(CORE_NORMAL);
+      gl->glVertexAttribPointer(CORE_NORMAL, 3, GL_FLOAT, GL_FALSE, stride, (void*)(5*sizeof(float)));
+   }
+   if (mesh->ibo) gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo);
+   gl->glBindVertexArray(0);
+   state->bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CoreRenderer::setMaterial(const Material &m)
+{
+   state->setUniform(loc[0][U_COLOR], m.color);
+   state->setUniform(loc[0][U_TEXTURED], m.texture != 0);
+   state->setUniform(loc[0][U_LIT], m.lit);
+   state->setUniform(loc[0][U_SPECULAR], m.specular);
+   state->setUniform(loc[0][U_SHININESS], m.shininess);
+   if (m.texture) state->bindTexture(GL_TEXTURE_2D, m.texture);
+   state->set(GL_POLYGON_OFFSET_FILL, m.offset);
+}
+
+void CoreRenderer::issue(const GLint *loc, const RenderCmd &cmd)
+{
+   const RenderMesh *mesh = cmd.mesh;
+   GLsizei count = cmd.count ? cmd.count : mesh->count;
+   if (!count || (cmd.instances && !cmd.instance_count)) return;
+   state->setUniform(loc[U_MODEL], cmd.model);
+   state->setUniform(loc[U_INSTANCED], cmd.instances != 0);
+   gl->glBindVertexArray(mesh->vao);
+   if (cmd.instances)
+   {
+      state->bindBuffer(GL_ARRAY_BUFFER, cmd.instances);
+      for (int i = 0; i < 4; i++)
+      {
+         gl->glEnableVertexAttribArray(CORE_INSTANCE+i);
+         gl->glVertexAttribPointer(CORE_INSTANCE+i, 4, GL_FLOAT, GL_FALSE,
+                                   16*sizeof(float), (void*)(4*i*sizeof(float)));
+         gl->glVertexAttribDivisor(CORE_INSTANCE+i, 1);
+      }
+      if (mesh->ibo)
+         gl->glDrawElementsInstanced(mesh->mode, count, GL_UNSIGNED_INT, (void*)0, cmd.instance_count);
+      else
+         gl->glDrawArraysInstanced(mesh->mode, 0, count, cmd.instance_count);
+      // the vertex array may be drawn uninstanced next
+      for (int i = 0; i < 4; i++)
+         gl->glDisableVertexAttribArray(CORE_INSTANCE+i);
+   }
+   else if (mesh->ibo)
+   {
+      gl->glDrawElements(mesh->mode, count, GL_UNSIGNED_INT, (void*)0);
+   }
+   else
+   {
+      gl->glDrawArrays(mesh->mode, 0, count);
+   }
+}
+
+//
+//  Colour pass, the shadow map is sampled with hardware depth
+//  comparison only while the program reads it
+//
+void CoreRenderer::draw(const RenderList &list, const glm::mat4 &proj, const glm::mat4 &view,
+                        const RenderLight &light)
+{
+   if (!shader || list.cmds.empty()) return;
+   state->useProgram(shader);
+   glm::mat4 vp = proj*view;
+   state->setUniform(loc[0][U_VIEWPROJ], vp);
+   state->setUniform(loc[0][U_SHADOWMAT], light.shadow_mat);
+   state->setUniform(loc[0][U_LIGHTPOS], light.position);
+   state->setUniform(loc[0][U_EYE], light.eye);
+   state->setUniform(loc[0][U_AMBIENT], light.ambient);
+   state->setUniform(loc[0][U_DIFFUSE], light.diffuse);
+   state->setUniform(loc[0][U_SHADOWED], light.shadow != 0);
+   state->setUniform(loc[0][U_TEX], 0);
+   state->setUniform(loc[0][U_DEPTH], 1);
+   if (light.shadow)
+   {
+      state->activeTexture(GL_TEXTURE1);
+      state->bindTexture(GL_TEXTURE_2D, light.shadow);
+      gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+      gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+      state->activeTexture(GL_TEXTURE0);
+   }
+   // decals are pulled forward, the shadow passes' offset is put back after
+   gl->glPolygonOffset(-1, -1);
+
+   const Material *cur = NULL;
+   for (unsigned int i = 0; i < list.cmds.size(); i++)
+   {
+      const RenderCmd &cmd = list.cmds[i];
+      if (!cur || !sameMaterial(*cur, cmd.material))
+      {
+         cur = &cmd.material;
+         setMaterial(*cur);
+      }
+      issue(loc[0], cmd);
+   }
+   gl->glBindVertexArray(0);
+   state->disable(GL_POLYGON_OFFSET_FILL);
+   gl->glPolygonOffset(4, 0);
+
+   if (light.shadow)
+   {
+      state->activeTexture(GL_TEXTURE1);
+      gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+      state->activeTexture(GL_TEXTURE0);
+   }
+   state->bindBuffer(GL_ARRAY_BUFFER, 0);
+   state->useProgram(NULL);
+}
+
+//
+//  Depth only, materials are ignored
+//
+void CoreRenderer::drawDepth(const RenderList &list, const glm::mat4 &proj, const glm::mat4 &view)
+{
+   if (!depth_shader || list.cmds.empty()) return;
+   state->useProgram(depth_shader);
+   glm::mat4 vp = proj*view;
+   state->setUniform(loc[1][U_VIEWPROJ], vp);
+   for (unsigned int i = 0; i < list.cmds.size(); i++)
+      issue(loc[1], list.cmds[i]);
+   gl->glBindVertexArray(0);
+   state->bindBuffer(GL_ARRAY_BUFFER, 0);
+   state->useProgram(NULL);
+}
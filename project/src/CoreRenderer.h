@@ -0,0 +1,153 @@
+//
+// OpenGL 3.3 core scene backend: meshes, materials and a draw list,
+// drawn with shader lighting and shadows and no fixed-function state
+//
+
+#ifndef CORERENDERER_H
+#define CORERENDERER_H
+
+#include <QOpenGLFunctions_3_3_Compatibility>
+#include <QOpenGLShaderProgram>
+#include <glm/glm.hpp>
+#include <vector>
+#include "GLState.h"
+#include "ObjMesh.h"
+
+// vertex attribute locations, the instance matrix matches Star's
+#define CORE_POSITION 0
+#define CORE_TEXCOORD 1
+#define CORE_NORMAL   2
+#define CORE_INSTANCE 4 // first of four mat4 columns
+
+#define CORE_UNIFORMS 16 // looked up once per program
+
+// replaces the fixed-function matrix stack for code that builds meshes
+class MatrixStack
+{
+public:
+	MatrixStack() {stack.push_back(glm::mat4(1));}
+	void push() {stack.push_back(stack.back());}
+	void pop() {stack.pop_back();}
+	void load(const glm::mat4 &m) {stack.back() = m;}
+	void mult(const glm::mat4 &m) {stack.back() = stack.back()*m;}
+	const glm::mat4 &top() const {return stack.back();}
+
+private:
+	std::vector<glm::mat4> stack;
+};
+
+typedef struct Material
+{
+	glm::vec4 color;
+	GLuint texture;   // 0 draws untextured
+	bool textured;    // wants a texture, the caller fills it in once loaded
+	bool lit;
+	float specular;
+	float shininess;
+	bool offset;      // pulled toward the viewer, for decals
+} Material;
+
+typedef struct RenderMesh
+{
+	GLuint vao;
+	GLuint vbo, ibo;  // ibo 0 draws arrays
+	GLsizei count;
+	GLenum mode;
+	int stride;       // MESH_STRIDE, or 3 for positions only
+	bool owned;       // buffers go with the mesh
+} RenderMesh;
+
+typedef struct RenderCmd
+{
+	const RenderMesh *mesh;
+	Material material;
+	glm::mat4 model;
+	GLsizei count;    // vertices or indices, 0 for the whole mesh
+	GLuint instances; // buffer of per-instance model matrices, or 0
+	int instance_count;
+} RenderCmd;
+
+class RenderList
+{
+public:
+	void clear() {cmds.clear();}
+	void add(const RenderMesh *mesh, const Material &material, const glm::mat4 &model, GLsizei count=0);
+	void addInstanced(const RenderMesh *mesh, const Material &material, const glm::mat4 &model,
+					  GLuint buffer, int count);
+	void sort(); // by material, so texture and uniform changes are shared
+	std::vector<RenderCmd> cmds;
+};
+
+typedef struct RenderLight
+{
+	glm::vec3 position;    // world space point light
+	glm::vec3 eye;
+	float ambient, diffuse;
+	GLuint shadow;         // depth texture on unit 1, 0 for no shadows
+	glm::mat4 shadow_mat;  // world to shadow map texture coordinates
+} RenderLight;
+
+class CoreRenderer;
+
+// turns immediate-mode style calls into indexed triangles, one mesh
+// per material, transformed by its own matrix stack
+class MeshBuilder
+{
+public:
+	MeshBuilder();
+	MatrixStack matrices;
+	Material material;
+	void begin(GLenum mode);
+	void end();
+	void normal(float x, float y, float z) {cur_normal = glm::vec3(x,y,z);}
+	void texCoord(float s, float t) {cur_tex = glm::vec2(s,t);}
+	void vertex(float x, float y, float z);
+	void build(CoreRenderer *renderer, RenderList &parts);
+
+private:
+	typedef struct Batch
+	{
+		Material material;
+		std::vector<float> verts;
+		std::vector<unsigned int> indices;
+	} Batch;
+
+	std::vector<Batch> batches;
+	std::vector<float> prim;  // vertices of the primitive being recorded
+	GLenum mode;
+	glm::vec3 cur_normal;
+	glm::vec2 cur_tex;
+
+	Batch &batch();
+};
+
+class CoreRenderer
+{
+public:
+	CoreRenderer();
+	~CoreRenderer(); // call with the GL context current
+	bool initGL(QOpenGLFunctions_3_3_Compatibility *gl, GLState *state);
+	RenderMesh *createMesh(const std::vector<float> &verts, const std::vector<unsigned int> &indices,
+						   GLenum mode);
+	// a mesh over buffers someone else owns, stride 3 for positions only
+	RenderMesh *wrapMesh(GLuint vbo, GLuint ibo, GLsizei count, GLenum mode, int stride);
+	void draw(const RenderList &list, const glm::mat4 &proj, const glm::mat4 &view,
+			  const RenderLight &light);
+	void drawDepth(const RenderList &list, const glm::mat4 &proj, const glm::mat4 &view);
+	size_t bytes() const {return mesh_bytes;}
+
+private:
+	QOpenGLFunctions_3_3_Compatibility *gl;
+	GLState *state;
+	QOpenGLShaderProgram *shader;
+	QOpenGLShaderProgram *depth_shader;
+	GLint loc[2][CORE_UNIFORMS];  // colour and depth program
+	std::vector<RenderMesh*> meshes;
+	size_t mesh_bytes;
+
+	void setupMesh(RenderMesh *mesh);
+	void setMaterial(const Material &m);
+	void issue(const GLint *loc, const RenderCmd &cmd);
+};
+
+#endif
@@ -0,0 +1,232 @@
+//
+//  Frame exporter
+//  each frame is drawn into an offscreen FBO and read into the next PBO
+//  of a ring, the copy is only mapped once its fence has signaled, so the
+//  render thread waits on the GPU only if EXPORT_PBOS frames are pending
+//
+#include <QImage>
+#include <string.h>
+#include "FrameExporter.h"
+
+//
+//  Constructor
+//  a path ending in .y4m writes a single video stream,
+//  anything else is a directory for frame_NNNNNN.png
+//
+FrameEncoder::FrameEncoder(const QString &path, int width, int height)
+{
+   w = width;
+   h = height;
+   count = 0;
+   quit = false;
+   y4m = path.endsWith(".y4m");
+   if (y4m)
+   {
+      file.setFileName(path);
+      good = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+      // 62.5 fps, one frame per replay tick
+      if (good)
+         file.write(QString("YUV4MPEG2 W%1 H%2 F125:2 Ip A1:1 C420jpeg\n")
+                    .arg(w).arg(h).toLatin1());
+   }
+   else
+   {
+      dir.setPath(path);
+      good = dir.mkpath(".");
+   }
+   start();
+}
+
+FrameEncoder::~FrameEncoder()
+{
+   lock.lock();
+   quit = true;
+   wake.wakeAll();
+   lock.unlock();
+   wait();
+   if (y4m) file.close();
+}
+
+void FrameEncoder::push(const QByteArray &rgba)
+{
+   QMutexLocker locker(&lock);
+   while (queue.size() >= EXPORT_QUEUE)
+      space.wait(&lock);
+   queue.push_back(rgba);
+   wake.wakeOne();
+}
+
+void FrameEncoder::run()
+{
+   for (;;)
+   {
+      QByteArray frame;
+      {
+         QMutexLocker locker(&lock);
+         while (queue.empty() && !quit)
+            wake.wait(&lock);
+         if (queue.empty()) return;
+         frame = queue.front();
+         queue.pop_front();
+         space.wakeOne();
+      }
+      if (!good) continue;
+      if (y4m)
+         writeY4M(frame);
+      else
+         writePNG(frame);
+      count++;
+   }
+}
+
+void FrameEncoder::writePNG(const QByteArray &rgba)
+{
+   QImage img((const uchar*)rgba.constData(), w, h, QImage::Format_RGBA8888);
+   QString name = QString("frame_%1.png").arg(count, 6, 10, QChar('0'));
+   good = img.convertToFormat(QImage::Format_RGB888).mirrored().save(dir.filePath(name));
+}
+
+//
+//  Full range BT.601, chroma averaged over each 2x2 block
+//
+void FrameEncoder::writeY4M(const QByteArray &rgba)
+{
+   const unsigned char *src = (const unsigned char*)rgba.constData();
+   int cw = w/2, ch = h/2;
+   QByteArray out(6 + w*h + 2*cw*ch, 0);
+   memcpy(out.data(), "FRAME\n", 6);
+   unsigned char *Y = (unsigned char*)out.data() + 6;
+   unsigned char *U = Y + w*h;
+   unsigned char *V = U + cw*ch;
+   for (int y = 0; y < h; y++)
+   {
+      const unsigned char *row = src + 4*w*(h-1-y);
+      for (int x = 0; x < w; x++)
+      {
+         const unsigned char *p = row + 4*x;
+         Y[y*w+x] = (unsigned char)(0.299*p[0] + 0.587*p[1] + 0.114*p[2] + 0.5);
+      }
+   }
+   for (int y = 0; y < ch; y++)
+   {
+      const unsigned char *r0 = src + 4*w*(h-1-2*y);
+      const unsigned char *r1 = src + 4*w*(h-2-2*y);
+      for (int x = 0; x < cw; x++)
+      {
+         double rgb[3];
+         for (int c = 0; c < 3; c++)
+            rgb[c] = 0.25*(r0[8*x+c] + r0[8*x+4+c] + r1[8*x+c] + r1[8*x+4+c]);
+         U[y*cw+x] = (unsigned char)(128 - 0.168736*rgb[0] - 0.331264*rgb[1] + 0.5*rgb[2] + 0.5);
+         V[y*cw+x] = (unsigned char)(128 + 0.5*rgb[0] - 0.418688*rgb[1] - 0.081312*rgb[2] + 0.5);
+      }
+   }
+   good = file.write(out) == out.size();
+}
+
+//
+//  Constructor, Y4M needs even dimensions for 4:2:0
+//
+FrameExporter::FrameExporter(const QString &path, int width, int height)
+{
+   w = (width + 1) & ~1;
+   h = (height + 1) & ~1;
+   gl = NULL;
+   fbo = NULL;
+   oldest = in_flight = 0;
+   captured = 0;
+   for (int i = 0; i < EXPORT_PBOS; i++)
+   {
+      pbo[i] = 0;
+      fence[i] = 0;
+   }
+   encoder = new FrameEncoder(path, w, h);
+}
+
+FrameExporter::~FrameExporter()
+{
+   if (gl)
+   {
+      finish();
+      gl->glDeleteBuffers(EXPORT_PBOS, pbo);
+   }
+   delete fbo;
+   delete encoder;
+}
+
+void FrameExporter::initGL(QOpenGLExtraFunctions *gl)
+{
+   this->gl = gl;
+   QOpenGLFramebufferObjectFormat format;
+   format.setAttachment(QOpenGLFramebufferObject::Depth);
+   format.setInternalTextureFormat(GL_RGBA8);
+   fbo = new QOpenGLFramebufferObject(w, h, format);
+   if (!fbo->isValid())
+   {
+      delete fbo;
+      fbo = NULL;
+   }
+   gl->glGenBuffers(EXPORT_PBOS, pbo);
+   for (int i = 0; i < EXPORT_PBOS; i++)
+   {
+      gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+      gl->glBufferData(GL_PIXEL_PACK_BUFFER, 4*w*h, NULL, GL_STREAM_READ);
+   }
+   gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameExporter::bind()
+{
+   if (fbo) fbo->bind();
+}
+
+void FrameExporter::capture()
+{
+   if (!fbo) return;
+   // the ring is full, the oldest copy has to be done before reuse
+   if (in_flight == EXPORT_PBOS)
+      collect(true);
+   int slot = (oldest + in_flight) % EXPORT_PBOS;
+   gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo->handle());
+   gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+   gl->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+   gl->glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+   gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+   fence[slot] = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   in_flight++;
+   captured++;
+   // hand over any older frames that have already landed
+   while (in_flight > 0)
+   {
+      GLenum status = gl->glClientWaitSync(fence[oldest], 0, 0);
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+      collect(false);
+   }
+}
+
+void FrameExporter::finish()
+{
+   while (in_flight > 0)
+      collect(true);
+}
+
+//
+//  Map the oldest PBO and queue its pixels for encoding
+//
+void FrameExporter::collect(bool wait)
+{
+   int slot = oldest;
+   if (wait)
+      gl->glClientWaitSync(fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+   gl->glDeleteSync(fence[slot]);
+   fence[slot] = 0;
+   gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+   void *data = gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4*w*h, GL_MAP_READ_BIT);
+   if (data)
+   {
+      encoder->push(QByteArray((const char*)data, 4*w*h));
+      gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+   }
+   gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+   oldest = (oldest + 1) % EXPORT_PBOS;
+   in_flight--;
+}
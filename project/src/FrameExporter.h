@@ -0,0 +1,81 @@
+//
+// offscreen frame capture through a PBO ring with a background encoder
+//
+
+#ifndef FRAMEEXPORTER_H
+#define FRAMEEXPORTER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <QSize>
+#include <QFile>
+#include <QDir>
+#include <QByteArray>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <deque>
+
+#define EXPORT_PBOS 3   // frames read back asynchronously before one must finish
+#define EXPORT_QUEUE 8  // encoded frames buffered before capture blocks
+
+//
+// writes RGBA frames as a PNG sequence or a Y4M (4:2:0) stream
+//
+class FrameEncoder : public QThread
+{
+public:
+	FrameEncoder(const QString &path, int width, int height);
+	~FrameEncoder(); // encodes every queued frame before returning
+	void push(const QByteArray &rgba); // bottom-up rows, as read by glReadPixels
+	bool ok() const {return good;}
+
+protected:
+	void run();
+
+private:
+	int w, h;
+	bool y4m;
+	bool good;
+	bool quit;
+	long count;
+	QFile file;
+	QDir dir;
+	QMutex lock;
+	QWaitCondition wake, space;
+	std::deque<QByteArray> queue;
+
+	void writePNG(const QByteArray &rgba);
+	void writeY4M(const QByteArray &rgba);
+};
+
+class FrameExporter
+{
+public:
+	FrameExporter(const QString &path, int width, int height);
+	~FrameExporter(); // call with the GL context current
+	void initGL(QOpenGLExtraFunctions *gl);
+	void bind();      // redirect drawing into the export framebuffer
+	void capture();   // start reading back the frame just drawn
+	void finish();    // wait for every frame in flight
+	QSize size() const {return QSize(w, h);}
+	GLuint handle() const {return fbo ? fbo->handle() : 0;}
+	size_t bytes() const {return (size_t)w*h*(4*EXPORT_PBOS + (fbo ? 8 : 0));} // PBOs, colour and depth
+	long frames() const {return captured;}
+	bool ok() const {return fbo && encoder->ok();}
+
+private:
+	int w, h;
+	QOpenGLExtraFunctions *gl;
+	QOpenGLFramebufferObject *fbo;
+	FrameEncoder *encoder;
+	GLuint pbo[EXPORT_PBOS];
+	GLsync fence[EXPORT_PBOS];
+	int oldest, in_flight;
+	long captured;
+
+	void collect(bool wait);
+};
+
+#endif
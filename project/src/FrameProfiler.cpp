@@ -0,0 +1,218 @@
+//
+//  Frame profiler
+//  GPU scopes bracket their work with timestamp queries so scopes can
+//  nest; results are read PROFILER_SLOTS frames later and only once
+//  available, so reading them never stalls the pipeline
+//
+#include <QFile>
+#include <QTextStream>
+#include <string.h>
+#include <algorithm>
+#include "FrameProfiler.h"
+
+FrameProfiler::FrameProfiler()
+{
+   gl = NULL;
+   frame = 0;
+   cur = 0;
+   pool_used = 0;
+   trace_frames = 0;
+   clock.start();
+}
+
+FrameProfiler::~FrameProfiler()
+{
+   writeTrace();
+}
+
+void FrameProfiler::initGL(QOpenGLFunctions_3_3_Compatibility *gl)
+{
+   this->gl = gl;
+}
+
+//
+//  Keep the last frames in memory and dump them to path,
+//  a .json path writes JSON, anything else CSV
+//
+void FrameProfiler::setTrace(const QString &path, int frames)
+{
+   trace_path = path;
+   trace_frames = frames;
+}
+
+int FrameProfiler::passIndex(const char *name)
+{
+   for (unsigned int i = 0; i < stats.size(); i++)
+      if (strcmp(stats[i].name, name) == 0)
+         return i;
+   PassStats s;
+   s.name = name;
+   s.cpu_ms = s.gpu_ms = 0;
+   s.calls = 0;
+   stats.push_back(s);
+   return stats.size()-1;
+}
+
+GLuint FrameProfiler::query()
+{
+   if (pool_used == pool[cur].size())
+   {
+      GLuint q;
+      gl->glGenQueries(1, &q);
+      pool[cur].push_back(q);
+   }
+   return pool[cur][pool_used++];
+}
+
+//
+//  Start a frame, collecting the slot written PROFILER_SLOTS frames ago
+//
+void FrameProfiler::beginFrame()
+{
+   frame++;
+   cur = frame % PROFILER_SLOTS;
+   resolve(cur, frame - PROFILER_SLOTS);
+   slots[cur].clear();
+   pool_used = 0;
+   if (trace_frames > 0 && frame % 120 == 0)
+      writeTrace();
+}
+
+int FrameProfiler::begin(const char *name, bool gpu)
+{
+   Sample s;
+   s.pass = passIndex(name);
+   s.gpu = gpu && gl;
+   if (s.gpu)
+   {
+      s.query[0] = query();
+      s.query[1] = query();
+      gl->glQueryCounter(s.query[0], GL_TIMESTAMP);
+   }
+   s.cpu_ns = 0;
+   s.start_ns = clock.nsecsElapsed();
+   slots[cur].push_back(s);
+   return slots[cur].size()-1;
+}
+
+void FrameProfiler::end(int scope)
+{
+   Sample &s = slots[cur][scope];
+   s.cpu_ns = clock.nsecsElapsed() - s.start_ns;
+   if (s.gpu)
+      gl->glQueryCounter(s.query[1], GL_TIMESTAMP);
+}
+
+//
+//  Fold a finished slot into the smoothed stats and the trace
+//
+void FrameProfiler::resolve(int slot, long frame)
+{
+   std::vector<PassTime> times(stats.size());
+   std::vector<Sample> &samples = slots[slot];
+   if (samples.empty()) return;
+   for (unsigned int i = 0; i < times.size(); i++)
+   {
+      times[i].pass = i;
+      times[i].cpu_ms = 0;
+      times[i].gpu_ms = -1;
+      stats[i].calls = 0;
+   }
+   for (unsigned int i = 0; i < samples.size(); i++)
+   {
+      PassTime &t = times[samples[i].pass];
+      stats[samples[i].pass].calls++;
+      t.cpu_ms += samples[i].cpu_ns/1e6;
+      if (samples[i].gpu)
+      {
+         GLint ready = 0;
+         gl->glGetQueryObjectiv(samples[i].query[1], GL_QUERY_RESULT_AVAILABLE, &ready);
+         if (ready)
+         {
+            GLuint64 t0, t1;
+            gl->glGetQueryObjectui64v(samples[i].query[0], GL_QUERY_RESULT, &t0);
+            gl->glGetQueryObjectui64v(samples[i].query[1], GL_QUERY_RESULT, &t1);
+            t.gpu_ms = std::max(t.gpu_ms, 0.0) + (t1-t0)/1e6;
+         }
+      }
+   }
+
+   FrameRecord rec;
+   rec.frame = frame;
+   for (unsigned int i = 0; i < times.size(); i++)
+   {
+      if (stats[i].calls == 0) continue;
+      stats[i].cpu_ms += 0.1*(times[i].cpu_ms - stats[i].cpu_ms);
+      if (times[i].gpu_ms >= 0)
+         stats[i].gpu_ms += 0.1*(times[i].gpu_ms - stats[i].gpu_ms);
+      rec.passes.push_back(times[i]);
+   }
+   if (trace_frames > 0)
+   {
+      trace.push_back(rec);
+      while ((int)trace.size() > trace_frames)
+         trace.pop_front();
+   }
+}
+
+double FrameProfiler::ms(const char *name) const
+{
+   for (unsigned int i = 0; i < stats.size(); i++)
+      if (strcmp(stats[i].name, name) == 0)
+         return std::max(stats[i].cpu_ms, stats[i].gpu_ms);
+   return 0;
+}
+
+//
+//  Overlay text, one line per pass
+//
+QStringList FrameProfiler::hud()
+{
+   QStringList lines;
+   lines << QString("%1 %2 %3").arg("pass",-14).arg("cpu ms",8).arg(gl ? "gpu ms" : "", 8);
+   for (unsigned int i = 0; i < stats.size(); i++)
+   {
+      QString line = QString("%1 %2").arg(stats[i].name,-14).arg(stats[i].cpu_ms,8,'f',3);
+      if (gl) line += QString(" %1").arg(stats[i].gpu_ms,8,'f',3);
+      if (stats[i].calls > 1) line += QString("  x%1").arg(stats[i].calls);
+      lines << line;
+   }
+   return lines;
+}
+
+void FrameProfiler::writeTrace()
+{
+   if (trace_path.isEmpty() || trace.empty()) return;
+   QFile file(trace_path);
+   if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) return;
+   QTextStream out(&file);
+   bool json = trace_path.endsWith(".json");
+   if (json)
+      out << "[\n";
+   else
+      out << "frame,pass,cpu_ms,gpu_ms\n";
+   for (unsigned int f = 0; f < trace.size(); f++)
+   {
+      const FrameRecord &rec = trace[f];
+      if (json)
+         out << "{\"frame\":" << rec.frame << ",\"passes\":{";
+      for (unsigned int p = 0; p < rec.passes.size(); p++)
+      {
+         const PassTime &t = rec.passes[p];
+         if (json)
+         {
+            out << (p ? "," : "") << "\"" << stats[t.pass].name << "\":{\"cpu_ms\":"
+                << t.cpu_ms << ",\"gpu_ms\":" << t.gpu_ms << "}";
+         }
+         else
+         {
+            out << rec.frame << "," << stats[t.pass].name << ","
+                << t.cpu_ms << "," << t.gpu_ms << "\n";
+         }
+      }
+      if (json)
+         out << "}}" << (f+1 < trace.size() ? ",\n" : "\n");
+   }
+   if (json)
+      out << "]\n";
+}
@@ -0,0 +1,90 @@
+//
+// scoped CPU and GPU pass timers with a rolling trace file
+//
+
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <QString>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QOpenGLFunctions_3_3_Compatibility>
+#include <vector>
+#include <deque>
+
+#define PROFILER_SLOTS 3 // frames in flight before GPU results are read
+
+typedef struct PassStats
+{
+	const char *name;
+	double cpu_ms, gpu_ms; // smoothed
+	int calls;             // scopes in the last resolved frame
+} PassStats;
+
+typedef struct PassTime
+{
+	int pass;
+	double cpu_ms, gpu_ms; // gpu_ms < 0 if not measured
+} PassTime;
+
+typedef struct FrameRecord
+{
+	long frame;
+	std::vector<PassTime> passes;
+} FrameRecord;
+
+class FrameProfiler
+{
+public:
+	FrameProfiler();
+	~FrameProfiler();
+	void initGL(QOpenGLFunctions_3_3_Compatibility *gl); // NULL for CPU only
+	void beginFrame();
+	int begin(const char *name, bool gpu=true);
+	void end(int scope);
+	QStringList hud();
+	double ms(const char *name) const; // smoothed, the larger of CPU and GPU time
+	void setTrace(const QString &path, int frames);
+	void writeTrace();
+
+private:
+	typedef struct Sample
+	{
+		int pass;
+		qint64 start_ns, cpu_ns;
+		GLuint query[2];
+		bool gpu;
+	} Sample;
+
+	QOpenGLFunctions_3_3_Compatibility *gl;
+	QElapsedTimer clock;
+	long frame;
+	int cur;
+	std::vector<Sample> slots[PROFILER_SLOTS];
+	std::vector<GLuint> pool[PROFILER_SLOTS]; // timestamp queries per slot
+	unsigned int pool_used;
+	std::vector<PassStats> stats;
+	std::deque<FrameRecord> trace;
+	QString trace_path;
+	int trace_frames;
+
+	int passIndex(const char *name);
+	GLuint query();
+	void resolve(int slot, long frame);
+};
+
+//
+// times the enclosing block
+//
+class ProfileScope
+{
+public:
+	ProfileScope(FrameProfiler *p, const char *name, bool gpu=true)
+		: prof(p) {id = prof->begin(name, gpu);}
+	~ProfileScope() {prof->end(id);}
+private:
+	FrameProfiler *prof;
+	int id;
+};
+
+#endif
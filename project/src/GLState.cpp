@@ -0,0 +1,259 @@
+//
+//  GL state cache
+//  every call compares against the last value this cache set and only
+//  reaches the driver when it differs; anything the cache hasn't seen
+//  since the last invalidate() is issued unconditionally
+//
+#include <string.h>
+#include "GLState.h"
+
+static const char *kind_names[GLSTATE_KINDS] =
+   {"enables", "tex units", "textures", "buffers", "programs", "uniforms"};
+
+GLState::GLState()
+{
+   gl = NULL;
+   memset(count, 0, sizeof(count));
+   memset(last, 0, sizeof(last));
+   invalidate();
+}
+
+void GLState::initGL(QOpenGLFunctions *gl)
+{
+   this->gl = gl;
+   invalidate();
+}
+
+//
+//  Forget everything but uniforms and their locations, which live in
+//  the program objects
+//
+void GLState::invalidate()
+{
+   caps.clear();
+   textures.clear();
+   buffers.clear();
+   unit = 0;
+   blend[0] = blend[1] = 0;
+   cur_program = 0;
+   program_known = false;
+}
+
+void GLState::beginFrame()
+{
+   memcpy(last, count, sizeof(last));
+   memset(count, 0, sizeof(count));
+}
+
+//
+//  Count a call, true if it has to be issued
+//
+bool GLState::issue(int kind, bool redundant)
+{
+   count[redundant ? 1 : 0][kind]++;
+   return !redundant;
+}
+
+//
+//  Fixed-function texture enables belong to the active unit
+//
+static bool perUnit(GLenum cap)
+{
+   switch (cap)
+   {
+      case GL_TEXTURE_1D: case GL_TEXTURE_2D: case GL_TEXTURE_3D: case GL_TEXTURE_CUBE_MAP:
+      case GL_TEXTURE_GEN_S: case GL_TEXTURE_GEN_T: case GL_TEXTURE_GEN_R: case GL_TEXTURE_GEN_Q:
+         return true;
+   }
+   return false;
+}
+
+void GLState::set(GLenum cap, bool on)
+{
+   uint64_t key = perUnit(cap) ? ((uint64_t)unit << 32) | cap : cap;
+   std::unordered_map<uint64_t, bool>::iterator it = caps.find(key);
+   // a texture enable on an unknown unit can't be cached
+   bool known = it != caps.end() && (unit || !perUnit(cap));
+   if (!issue(GLSTATE_ENABLES, known && it->second == on)) return;
+   if (on)
+      gl->glEnable(cap);
+   else
+      gl->glDisable(cap);
+   if (unit || !perUnit(cap)) caps[key] = on;
+}
+
+void GLState::assume(GLenum cap, bool on)
+{
+   if (perUnit(cap) && !unit) return;
+   caps[perUnit(cap) ? ((uint64_t)unit << 32) | cap : cap] = on;
+}
+
+void GLState::clientState(GLenum array, bool on)
+{
+   // client arrays share the cap table, their enums don't overlap caps
+   uint64_t key = (1ull << 63) | array;
+   std::unordered_map<uint64_t, bool>::iterator it = caps.find(key);
+   if (!issue(GLSTATE_ENABLES, it != caps.end() && it->second == on)) return;
+   if (on)
+      glEnableClientState(array);
+   else
+      glDisableClientState(array);
+   caps[key] = on;
+}
+
+void GLState::blendFunc(GLenum src, GLenum dst)
+{
+   if (!issue(GLSTATE_ENABLES, blend[0] == src && blend[1] == dst && blend[0])) return;
+   gl->glBlendFunc(src, dst);
+   blend[0] = src;
+   blend[1] = dst;
+}
+
+void GLState::activeTexture(GLenum unit)
+{
+   if (!issue(GLSTATE_UNITS, this->unit == unit)) return;
+   gl->glActiveTexture(unit);
+   this->unit = unit;
+}
+
+void GLState::bindTexture(GLenum target, GLuint tex)
+{
+   uint64_t key = ((uint64_t)unit << 32) | target;
+   std::unordered_map<uint64_t, GLuint>::iterator it = textures.find(key);
+   if (!issue(GLSTATE_TEXTURES, unit && it != textures.end() && it->second == tex)) return;
+   gl->glBindTexture(target, tex);
+   if (unit) textures[key] = tex;
+}
+
+void GLState::bindTexture(const QOpenGLTexture *tex)
+{
+   bindTexture(GL_TEXTURE_2D, tex ? tex->textureId() : 0);
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buf)
+{
+   std::unordered_map<GLenum, GLuint>::iterator it = buffers.find(target);
+   if (!issue(GLSTATE_BUFFERS, it != buffers.end() && it->second == buf)) return;
+   gl->glBindBuffer(target, buf);
+   buffers[target] = buf;
+}
+
+void GLState::useProgram(QOpenGLShaderProgram *program)
+{
+   GLuint id = program ? program->programId() : 0;
+   if (!issue(GLSTATE_PROGRAMS, program_known && cur_program == id)) return;
+   gl->glUseProgram(id);
+   cur_program = id;
+   program_known = true;
+}
+
+//
+//  Names are short literals, so the key string doesn't allocate
+//
+int GLState::location(QOpenGLShaderProgram *program, const char *name)
+{
+   std::unordered_map<std::string, int> &names = locations[program->programId()];
+   std::unordered_map<std::string, int>::iterator it = names.find(name);
+   if (it != names.end()) return it->second;
+   int location = program->uniformLocation(name);
+   names[name] = location;
+   return location;
+}
+
+bool GLState::changed(GLuint program, int location, const Uniform &u)
+{
+   if (location < 0) return false;
+   uint64_t key = ((uint64_t)program << 32) | (uint32_t)location;
+   std::unordered_map<uint64_t, Uniform>::iterator it = uniforms.find(key);
+   bool same = it != uniforms.end() && memcmp(it->second.v, u.v, sizeof(u.v)) == 0;
+   if (!issue(GLSTATE_UNIFORMS, same)) return false;
+   uniforms[key] = u;
+   return true;
+}
+
+void GLState::setUniform(QOpenGLShaderProgram *program, const char *name, GLint v)
+{
+   Uniform u = {{v}};
+   int location = this->location(program, name);
+   if (changed(program->programId(), location, u))
+      gl->glUniform1i(location, v);
+}
+
+void GLState::setUniform(QOpenGLShaderProgram *program, const char *name, GLint x, GLint y, GLint z)
+{
+   Uniform u = {{x, y, z}};
+   int location = this->location(program, name);
+   if (changed(program->programId(), location, u))
+      gl->glUniform3i(location, x, y, z);
+}
+
+void GLState::setUniform(QOpenGLShaderProgram *program, const char *name, const QVector2D &v)
+{
+   Uniform u = {};
+   float f[2] = {v.x(), v.y()};
+   memcpy(u.v, f, sizeof(f));
+   int location = this->location(program, name);
+   if (changed(program->programId(), location, u))
+      gl->glUniform2f(location, f[0], f[1]);
+}
+
+void GLState::setUniform(QOpenGLShaderProgram *program, const char *name, const QVector4D &v)
+{
+   Uniform u = {};
+   float f[4] = {v.x(), v.y(), v.z(), v.w()};
+   memcpy(u.v, f, sizeof(f));
+   int location = this->location(program, name);
+   if (changed(program->programId(), location, u))
+      gl->glUniform4f(location, f[0], f[1], f[2], f[3]);
+}
+
+void GLState::setUniform(GLint location, GLint v)
+{
+   Uniform u = {{v}};
+   if (changed(cur_program, location, u))
+      gl->glUniform1i(location, v);
+}
+
+void GLState::setUniform(GLint location, GLfloat v)
+{
+   Uniform u = {};
+   memcpy(u.v, &v, sizeof(v));
+   if (changed(cur_program, location, u))
+      gl->glUniform1f(location, v);
+}
+
+void GLState::setUniform(GLint location, const glm::vec3 &v)
+{
+   Uniform u = {};
+   memcpy(u.v, &v[0], sizeof(v));
+   if (changed(cur_program, location, u))
+      gl->glUniform3fv(location, 1, &v[0]);
+}
+
+void GLState::setUniform(GLint location, const glm::vec4 &v)
+{
+   Uniform u = {};
+   memcpy(u.v, &v[0], sizeof(v));
+   if (changed(cur_program, location, u))
+      gl->glUniform4fv(location, 1, &v[0]);
+}
+
+void GLState::setUniform(GLint location, const glm::mat4 &m)
+{
+   Uniform u;
+   memcpy(u.v, &m[0][0], sizeof(m));
+   if (changed(cur_program, location, u))
+      gl->glUniformMatrix4fv(location, 1, GL_FALSE, &m[0][0]);
+}
+
+//
+//  Overlay text, issued and elided calls per kind for the last frame
+//
+QStringList GLState::hud() const
+{
+   QStringList lines;
+   lines << QString("%1 %2 %3").arg("gl state",-14).arg("issued",8).arg("elided",8);
+   for (int k = 0; k < GLSTATE_KINDS; k++)
+      lines << QString("%1 %2 %3").arg(kind_names[k],-14).arg(last[0][k],8).arg(last[1][k],8);
+   return lines;
+}
@@ -0,0 +1,89 @@
+//
+// shadow copy of the GL state the draw code changes, so redundant
+// enables, binds and uniform sets are dropped and counted
+//
+
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <QOpenGLFunctions>
+#include <QOpenGLTexture>
+#include <QOpenGLShaderProgram>
+#include <QVector2D>
+#include <QVector4D>
+#include <QStringList>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <string>
+#include <stdint.h>
+
+#define GLSTATE_ENABLES  0 // glEnable/glDisable, client arrays, blend func
+#define GLSTATE_UNITS    1 // glActiveTexture
+#define GLSTATE_TEXTURES 2
+#define GLSTATE_BUFFERS  3
+#define GLSTATE_PROGRAMS 4
+#define GLSTATE_UNIFORMS 5
+#define GLSTATE_KINDS    6
+
+class GLState
+{
+public:
+	GLState();
+	void initGL(QOpenGLFunctions *gl);
+	void invalidate();  // after code that changes state behind the cache
+	void beginFrame();  // latches the counters of the frame just drawn
+
+	void enable(GLenum cap) {set(cap, true);}
+	void disable(GLenum cap) {set(cap, false);}
+	void set(GLenum cap, bool on);
+	void assume(GLenum cap, bool on); // record state set elsewhere
+	void clientState(GLenum array, bool on);
+	void blendFunc(GLenum src, GLenum dst);
+	void activeTexture(GLenum unit);
+	void bindTexture(GLenum target, GLuint tex);     // on the active unit
+	void bindTexture(const QOpenGLTexture *tex);     // 2D, NULL unbinds
+	void bindBuffer(GLenum target, GLuint buf);
+	void useProgram(QOpenGLShaderProgram *program);  // NULL for fixed function
+	GLuint program() const {return cur_program;}
+	// uniform location, looked up in the driver once per program and name
+	int location(QOpenGLShaderProgram *program, const char *name);
+	// the program must be current
+	void setUniform(QOpenGLShaderProgram *program, const char *name, GLint v);
+	void setUniform(QOpenGLShaderProgram *program, const char *name, GLint x, GLint y, GLint z);
+	void setUniform(QOpenGLShaderProgram *program, const char *name, const QVector2D &v);
+	void setUniform(QOpenGLShaderProgram *program, const char *name, const QVector4D &v);
+	// by a location the caller looked up, in the current program
+	void setUniform(GLint location, GLint v);
+	void setUniform(GLint location, GLfloat v);
+	void setUniform(GLint location, const glm::vec3 &v);
+	void setUniform(GLint location, const glm::vec4 &v);
+	void setUniform(GLint location, const glm::mat4 &m);
+
+	QStringList hud() const;
+	long issued(int kind) const {return last[0][kind];}
+	long elided(int kind) const {return last[1][kind];}
+
+private:
+	typedef struct Uniform
+	{
+		int32_t v[16]; // raw bits, a mat4 at most, unused words zero
+	} Uniform;
+
+	QOpenGLFunctions *gl;
+	std::unordered_map<uint64_t, bool> caps;         // texture caps are per unit
+	std::unordered_map<uint64_t, GLuint> textures;   // by unit and target
+	std::unordered_map<GLenum, GLuint> buffers;
+	std::unordered_map<uint64_t, Uniform> uniforms;  // by program and location
+	std::unordered_map<GLuint, std::unordered_map<std::string, int> > locations; // by program and name
+	GLenum unit;        // 0 until known
+	GLenum blend[2];    // 0 until known
+	GLuint cur_program;
+	bool program_known;
+	long count[2][GLSTATE_KINDS]; // issued, elided in the current frame
+	long last[2][GLSTATE_KINDS];
+
+	bool issue(int kind, bool redundant);
+	bool changed(GLuint program, int location, const Uniform &u);
+};
+
+#endif
@@ -0,0 +1,168 @@
+//
+//  Asynchronous OpenGL uploads through a shared context
+//
+#include <QCoreApplication>
+#include <QImage>
+#include <memory>
+#include "GLUploader.h"
+
+//
+//  Constructor
+//  the context and offscreen surface are created on the GUI thread,
+//  then the context is handed over to the upload thread
+//
+GLUploader::GLUploader(QOpenGLContext *share, QObject *parent)
+    : QThread(parent)
+{
+   quit = false;
+   ctx = new QOpenGLContext();
+   ctx->setFormat(share->format());
+   ctx->setShareContext(share);
+   ctx->create();
+   surface = new QOffscreenSurface();
+   surface->setFormat(ctx->format());
+   surface->create();
+   ctx->moveToThread(this);
+   start();
+}
+
+GLUploader::~GLUploader()
+{
+   lock.lock();
+   quit = true;
+   wake.wakeAll();
+   lock.unlock();
+   wait();
+   delete ctx;
+   delete surface;
+}
+
+//
+//  Queue a job for the upload thread
+//
+void GLUploader::upload(Work work, Done done)
+{
+   Task task;
+   task.work = work;
+   task.done = done;
+   task.fence = 0;
+   QMutexLocker locker(&lock);
+   todo.push_back(task);
+   wake.wakeOne();
+}
+
+//
+//  Decode an image and create its texture off the GUI thread,
+//  *dest stays NULL until the texture is safe to sample
+//
+void GLUploader::uploadTexture(const QString &file, QOpenGLTexture **dest)
+{
+   std::shared_ptr<QOpenGLTexture*> tex(new QOpenGLTexture*(NULL));
+   upload([file,tex](QOpenGLExtraFunctions*)
+          {
+             *tex = new QOpenGLTexture(QImage(file));
+          },
+          [dest,tex]()
+          {
+             *dest = *tex;
+          });
+}
+
+//
+//  Copy data into a new buffer object, *dest stays 0 until it is ready
+//
+void GLUploader::uploadBuffer(GLenum target, const void *data, size_t bytes, GLuint *dest)
+{
+   const char *src = (const char*)data;
+   std::shared_ptr<std::vector<char> > copy(new std::vector<char>(src, src+bytes));
+   std::shared_ptr<GLuint> buf(new GLuint(0));
+   upload([target,copy,buf](QOpenGLExtraFunctions *f)
+          {
+             f->glGenBuffers(1, buf.get());
+             f->glBindBuffer(target, *buf);
+             f->glBufferData(target, copy->size(), copy->data(), GL_STATIC_DRAW);
+             f->glBindBuffer(target, 0);
+          },
+          [dest,buf]()
+          {
+             *dest = *buf;
+          });
+}
+
+//
+//  Publish every upload whose fence has signaled, never waits on the GPU
+//
+int GLUploader::publish(QOpenGLExtraFunctions *f)
+{
+   std::vector<Task> done;
+   lock.lock();
+   for (unsigned int i = 0; i < fenced.size(); )
+   {
+      GLenum status = f->glClientWaitSync(fenced[i].fence, 0, 0);
+      if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+      {
+         f->glDeleteSync(fenced[i].fence);
+         done.push_back(fenced[i]);
+         fenced.erase(fenced.begin()+i);
+      }
+      else
+      {
+         i++;
+      }
+   }
+   lock.unlock();
+   for (unsigned int i = 0; i < done.size(); i++)
+      done[i].done();
+   return done.size();
+}
+
+int GLUploader::pending()
+{
+   QMutexLocker locker(&lock);
+   return todo.size() + fenced.size();
+}
+
+//
+//  Upload thread main loop
+//
+void GLUploader::run()
+{
+   ctx->makeCurrent(surface);
+   QOpenGLExtraFunctions *f = ctx->extraFunctions();
+   while (true)
+   {
+      lock.lock();
+      while (todo.empty() && !quit)
+         wake.wait(&lock);
+      if (quit)
+      {
+         lock.unlock();
+         break;
+      }
+      Task task = todo.front();
+      todo.pop_front();
+      lock.unlock();
+
+      task.work(f);
+      // fence the upload and wait here until it has landed, so ready()
+      // is only emitted once publish can take it; nothing polls again
+      // for a fence publish found unsignaled
+      task.fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      GLenum status;
+      bool stop = false;
+      do
+      {
+         status = f->glClientWaitSync(task.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UPLOAD_WAIT_NS);
+         lock.lock();
+         stop = quit;
+         lock.unlock();
+      } while (status == GL_TIMEOUT_EXPIRED && !stop);
+
+      lock.lock();
+      fenced.push_back(task);
+      lock.unlock();
+      emit ready();
+   }
+   ctx->doneCurrent();
+   ctx->moveToThread(QCoreApplication::instance()->thread());
+}
@@ -0,0 +1,62 @@
+//
+// uploads textures and buffers on a worker thread through a shared context
+//
+
+#ifndef GLUPLOADER_H
+#define GLUPLOADER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLTexture>
+#include <deque>
+#include <vector>
+#include <functional>
+
+#define UPLOAD_WAIT_NS 2000000 // fence wait between checks for shutdown
+
+class GLUploader : public QThread
+{
+Q_OBJECT
+public:
+	// work runs on the upload thread with the shared context current,
+	// done runs on the thread calling publish once the upload's fence has signaled
+	typedef std::function<void(QOpenGLExtraFunctions*)> Work;
+	typedef std::function<void()> Done;
+
+	GLUploader(QOpenGLContext *share, QObject *parent=0);
+	~GLUploader();
+	void upload(Work work, Done done);
+	void uploadTexture(const QString &file, QOpenGLTexture **dest);
+	void uploadBuffer(GLenum target, const void *data, size_t bytes, GLuint *dest);
+	int publish(QOpenGLExtraFunctions *f); // call with a shared context current
+	int pending();
+
+signals:
+	void ready(); // an upload's fence has signaled, publish will find it
+
+protected:
+	void run();
+
+private:
+	typedef struct Task
+	{
+		Work work;
+		Done done;
+		GLsync fence;
+	} Task;
+
+	QOpenGLContext *ctx;
+	QOffscreenSurface *surface;
+	QMutex lock;
+	QWaitCondition wake;
+	bool quit;
+	std::deque<Task> todo;
+	std::vector<Task> fenced;
+};
+
+#endif
@@ -0,0 +1,103 @@
+//
+//  Depth pyramid
+//  each level keeps the farthest depth of the 2x2 texels under it, so
+//  a box whose nearest point is behind every texel it covers, at the
+//  level where it spans about two texels, is hidden; boxes that reach
+//  the near plane or leave the pyramid are never reported hidden;
+//  the coarse pass only samples texel centers, so level 0 is eroded
+//  by a texel to count only texels whose neighbours are covered too
+//
+#include "HiZBuffer.h"
+#include <algorithm>
+#include <math.h>
+
+HiZBuffer::HiZBuffer()
+{
+   mvp = glm::mat4(1);
+}
+
+void HiZBuffer::build(const float *depth, int w, int h, const glm::mat4 &mvp)
+{
+   this->mvp = mvp;
+   levels.resize(1);
+   levels[0].w = w;
+   levels[0].h = h;
+   // farthest depth of each texel's 3x3 neighbourhood, so a star tip
+   // or the gap between points never stands for a whole texel
+   levels[0].z.resize(w*h);
+   for (int y = 0; y < h; y++)
+      for (int x = 0; x < w; x++)
+      {
+         float z = 0;
+         for (int j = std::max(y-1, 0); j <= std::min(y+1, h-1); j++)
+            for (int i = std::max(x-1, 0); i <= std::min(x+1, w-1); i++)
+               z = std::max(z, depth[j*w+i]);
+         levels[0].z[y*w+x] = z;
+      }
+   // odd edges fold their last texel into the one beside it
+   for (int l = 1; w > 1 || h > 1; l++)
+   {
+      int pw = w, ph = h;
+      w = (w+1)/2;
+      h = (h+1)/2;
+      levels.resize(l+1);
+      const std::vector<float> &src = levels[l-1].z;
+      Level &level = levels[l];
+      level.w = w;
+      level.h = h;
+      level.z.resize(w*h);
+      for (int y = 0; y < h; y++)
+         for (int x = 0; x < w; x++)
+         {
+            int x0 = 2*x, x1 = std::min(2*x+1, pw-1);
+            int y0 = 2*y, y1 = std::min(2*y+1, ph-1);
+            level.z[y*w+x] = std::max(std::max(src[y0*pw+x0], src[y0*pw+x1]),
+                                      std::max(src[y1*pw+x0], src[y1*pw+x1]));
+         }
+   }
+}
+
+bool HiZBuffer::occluded(const float *lo, const float *hi) const
+{
+   if (levels.empty()) return false;
+   float x0 = INFINITY, y0 = INFINITY, z0 = INFINITY;
+   float x1 = -INFINITY, y1 = -INFINITY;
+   for (int i = 0; i < 8; i++)
+   {
+      glm::vec4 p = mvp*glm::vec4(i&1 ? hi[0] : lo[0], i&2 ? hi[1] : lo[1], i&4 ? hi[2] : lo[2], 1);
+      if (p.w < 1e-5f) return false;
+      float x = p.x/p.w, y = p.y/p.w, z = p.z/p.w;
+      x0 = std::min(x0, x);
+      x1 = std::max(x1, x);
+      y0 = std::min(y0, y);
+      y1 = std::max(y1, y);
+      z0 = std::min(z0, z);
+   }
+   // to level 0 texels, the part off the pyramid is left to frustum culling
+   const Level &base = levels[0];
+   x0 = std::max((0.5f*x0 + 0.5f)*base.w, 0.0f);
+   x1 = std::min((0.5f*x1 + 0.5f)*base.w, base.w - 1.0f);
+   y0 = std::max((0.5f*y0 + 0.5f)*base.h, 0.0f);
+   y1 = std::min((0.5f*y1 + 0.5f)*base.h, base.h - 1.0f);
+   if (x0 > x1 || y0 > y1) return false;
+   float z = 0.5f*z0 + 0.5f;
+
+   unsigned int l = 0;
+   for (float span = std::max(x1-x0, y1-y0); span > 2 && l+1 < levels.size(); span *= 0.5f)
+      l++;
+   const Level &level = levels[l];
+   int tx0 = (int)x0 >> l, tx1 = std::min((int)x1 >> l, level.w-1);
+   int ty0 = (int)y0 >> l, ty1 = std::min((int)y1 >> l, level.h-1);
+   for (int y = ty0; y <= ty1; y++)
+      for (int x = tx0; x <= tx1; x++)
+         if (z <= level.z[y*level.w+x]) return false;
+   return true;
+}
+
+size_t HiZBuffer::bytes() const
+{
+   size_t n = levels.capacity()*sizeof(Level);
+   for (unsigned int l = 0; l < levels.size(); l++)
+      n += levels[l].z.capacity()*sizeof(float);
+   return n;
+}
@@ -0,0 +1,40 @@
+//
+// CPU depth pyramid of a coarse occluder pass for occlusion tests
+//
+
+#ifndef HIZBUFFER_H
+#define HIZBUFFER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <stddef.h>
+
+#define HIZ_WIDTH     256  // occluder pass width, the height follows the view
+#define HIZ_OCCLUDERS 1024 // nearest landmarks drawn as occluders
+#define HIZ_MIN_ITEMS 2048 // views with fewer landmarks skip the pass
+
+class HiZBuffer
+{
+public:
+	HiZBuffer();
+	// depth is w x h window depth with the bottom row first, mvp takes
+	// the coordinates later boxes are given in to clip space
+	void build(const float *depth, int w, int h, const glm::mat4 &mvp);
+	void clear() {levels.clear();}
+	bool valid() const {return !levels.empty();}
+	// true if the box is entirely behind the occluders
+	bool occluded(const float *lo, const float *hi) const;
+	size_t bytes() const;
+
+private:
+	typedef struct Level
+	{
+		int w, h;
+		std::vector<float> z; // farthest depth under each texel
+	} Level;
+
+	std::vector<Level> levels; // level 0 is the occluder pass
+	glm::mat4 mvp;
+};
+
+#endif
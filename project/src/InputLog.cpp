@@ -0,0 +1,58 @@
+//
+//  Input log
+//  one event per line: <tick> <name> [args...], lines starting
+//  with # are comments
+//
+#include <QTextStream>
+#include "InputLog.h"
+
+bool InputLog::record(const QString &path)
+{
+   out.setFileName(path);
+   if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+      return false;
+   out.write("# tick name args\n");
+   return true;
+}
+
+bool InputLog::play(const QString &path)
+{
+   QFile in(path);
+   if (!in.open(QIODevice::ReadOnly | QIODevice::Text))
+      return false;
+   QTextStream stream(&in);
+   while (!stream.atEnd())
+   {
+      QStringList tokens = stream.readLine().split(' ', QString::SkipEmptyParts);
+      if (tokens.size() < 2 || tokens[0].startsWith('#')) continue;
+      InputEvent event;
+      event.tick = tokens.takeFirst().toLong();
+      event.name = tokens.takeFirst();
+      event.args = tokens;
+      events.push_back(event);
+   }
+   return true;
+}
+
+//
+//  Lines are flushed as they are written so a crashed session
+//  still leaves a usable log
+//
+void InputLog::add(long tick, const QString &name, const QStringList &args)
+{
+   if (!out.isOpen()) return;
+   QString line = QString::number(tick) + " " + name;
+   if (!args.isEmpty())
+      line += " " + args.join(' ');
+   out.write((line + "\n").toLatin1());
+   out.flush();
+}
+
+bool InputLog::next(long tick, InputEvent *event)
+{
+   if (events.empty() || events.front().tick > tick)
+      return false;
+   *event = events.front();
+   events.pop_front();
+   return true;
+}
@@ -0,0 +1,35 @@
+//
+// records view inputs against replay ticks and plays them back
+//
+
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <QString>
+#include <QStringList>
+#include <QFile>
+#include <deque>
+
+typedef struct InputEvent
+{
+	long tick;        // applied before this replay tick runs
+	QString name;     // mouse action or SlamViz slot
+	QStringList args;
+} InputEvent;
+
+class InputLog
+{
+public:
+	bool record(const QString &path);
+	bool play(const QString &path);
+	void add(long tick, const QString &name, const QStringList &args=QStringList());
+	bool next(long tick, InputEvent *event); // pops the next event due by tick
+	bool recording() const {return out.isOpen();}
+	bool playing() const {return !events.empty();}
+
+private:
+	QFile out;
+	std::deque<InputEvent> events;
+};
+
+#endif
@@ -0,0 +1,120 @@
+//
+//  Job system
+//  a loop is cut into chunks dealt round-robin over every thread's
+//  queue; a thread pops its own newest chunk and, when its queue runs
+//  dry, steals the oldest chunk from another, so uneven chunks balance
+//  out without a shared queue
+//
+#include "JobSystem.h"
+
+JobSystem::JobSystem(int threads)
+{
+   if (threads <= 0)
+      threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+   quit = false;
+   queued = 0;
+   for (int i = 0; i <= threads; i++)
+      queues.push_back(new Queue);
+   for (int i = 1; i <= threads; i++)
+      workers.push_back(std::thread(&JobSystem::worker, this, i));
+}
+
+JobSystem::~JobSystem()
+{
+   {
+      std::lock_guard<std::mutex> guard(sleep);
+      quit = true;
+   }
+   wake.notify_all();
+   for (unsigned int i = 0; i < workers.size(); i++)
+      workers[i].join();
+   for (unsigned int i = 0; i < queues.size(); i++)
+      delete queues[i];
+}
+
+//
+//  Run fn over [0,count) in chunks of at least grain, the calling
+//  thread works through chunks too until the whole loop is done
+//
+void JobSystem::parallelFor(int count, int grain, const Range &fn)
+{
+   if (count <= 0) return;
+   grain = std::max(grain, 1);
+   int chunks = std::min((count + grain - 1)/grain, 4*threads());
+   if (chunks == 1 || workers.empty())
+   {
+      fn(0, count);
+      return;
+   }
+   std::atomic<int> left(chunks);
+   for (int c = 0; c < chunks; c++)
+   {
+      Job job;
+      job.fn = &fn;
+      job.begin = (long)count*c/chunks;
+      job.end = (long)count*(c+1)/chunks;
+      job.left = &left;
+      Queue *q = queues[c % queues.size()];
+      std::lock_guard<std::mutex> guard(q->lock);
+      q->jobs.push_back(job);
+   }
+   {
+      std::lock_guard<std::mutex> guard(sleep);
+      queued += chunks;
+   }
+   wake.notify_all();
+   // help out, then wait for chunks other threads are still running
+   while (left > 0)
+      if (!runOne(0))
+         std::this_thread::yield();
+}
+
+//
+//  Pop from the back of our own queue, else steal from the front of
+//  another, returns false if there was nothing to run
+//
+bool JobSystem::runOne(int self)
+{
+   Job job;
+   bool found = false;
+   {
+      Queue *q = queues[self];
+      std::lock_guard<std::mutex> guard(q->lock);
+      if (!q->jobs.empty())
+      {
+         job = q->jobs.back();
+         q->jobs.pop_back();
+         found = true;
+      }
+   }
+   for (unsigned int i = 1; !found && i < queues.size(); i++)
+   {
+      Queue *q = queues[(self + i) % queues.size()];
+      std::lock_guard<std::mutex> guard(q->lock);
+      if (!q->jobs.empty())
+      {
+         job = q->jobs.front();
+         q->jobs.pop_front();
+         found = true;
+      }
+   }
+   if (!found) return false;
+   queued--;
+   (*job.fn)(job.begin, job.end);
+   (*job.left)--;
+   return true;
+}
+
+void JobSystem::worker(int self)
+{
+   for (;;)
+   {
+      {
+         std::unique_lock<std::mutex> guard(sleep);
+         wake.wait(guard, [this]() {return quit || queued > 0;});
+         if (quit) return;
+      }
+      while (runOne(self))
+         ;
+   }
+}
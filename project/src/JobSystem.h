@@ -0,0 +1,52 @@
+//
+// small work-stealing thread pool for per-frame parallel loops
+//
+
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+class JobSystem
+{
+public:
+	typedef std::function<void(int begin, int end)> Range;
+
+	JobSystem(int threads=0); // 0 uses one worker per extra core
+	~JobSystem();
+	void parallelFor(int count, int grain, const Range &fn); // returns when done
+	int threads() const {return workers.size()+1;}           // including the caller
+
+private:
+	typedef struct Job
+	{
+		const Range *fn;
+		int begin, end;
+		std::atomic<int> *left; // jobs of the same loop still running
+	} Job;
+
+	typedef struct Queue
+	{
+		std::mutex lock;
+		std::deque<Job> jobs;
+	} Queue;
+
+	std::vector<std::thread> workers;
+	std::vector<Queue*> queues; // queues[0] belongs to the calling thread
+	std::mutex sleep;
+	std::condition_variable wake;
+	std::atomic<int> queued;
+	bool quit;
+
+	bool runOne(int self);
+	void worker(int self);
+};
+
+#endif
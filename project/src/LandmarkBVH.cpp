@@ -0,0 +1,380 @@
+//
+//  Landmark BVH
+//  moved landmarks only refit node bounds; new landmarks sit in a small
+//  pending list that is tested linearly, every BVH_PENDING of them are
+//  built into a subtree grafted under the smallest node that holds them,
+//  and the whole tree is rebuilt once grafts or removals pile up
+//
+#include "LandmarkBVH.h"
+#include "MemoryBudget.h"
+#include <algorithm>
+#include <math.h>
+#include <cmath>
+
+#define LEAF_SIZE 4
+
+LandmarkBVH::LandmarkBVH()
+{
+   dead = grafted = 0;
+   moved = false;
+}
+
+void LandmarkBVH::update(unsigned long id, const float *center, float radius)
+{
+   std::unordered_map<unsigned long, int>::iterator it = lookup.find(id);
+   if (it != lookup.end())
+   {
+      Item &item = items[it->second];
+      for (int i = 0; i < 3; i++)
+         item.c[i] = center[i];
+      item.r = radius;
+      moved = true;
+      return;
+   }
+   Item item;
+   item.id = id;
+   for (int i = 0; i < 3; i++)
+      item.c[i] = center[i];
+   item.r = radius;
+   item.alive = true;
+   lookup[id] = items.size();
+   pending.push_back(items.size());
+   items.push_back(item);
+}
+
+void LandmarkBVH::remove(unsigned long id)
+{
+   std::unordered_map<unsigned long, int>::iterator it = lookup.find(id);
+   if (it == lookup.end()) return;
+   items[it->second].alive = false;
+   lookup.erase(it);
+   dead++;
+}
+
+size_t LandmarkBVH::bytes() const
+{
+   return items.capacity()*sizeof(Item) + order.capacity()*sizeof(int) +
+          nodes.capacity()*sizeof(Node) + pending.capacity()*sizeof(int) +
+          MemoryBudget::hashMapBytes(lookup);
+}
+
+//
+//  Bring the tree up to date, call once after a batch of updates
+//
+void LandmarkBVH::refit()
+{
+   // rebuild when grafted subtrees or dead items would slow queries
+   if (nodes.empty() || grafted > BVH_PENDING + (int)items.size()/16 || dead > (int)items.size()/4)
+   {
+      rebuild();
+      return;
+   }
+   if (moved)
+   {
+      refitNode(0);
+      moved = false;
+   }
+   if (pending.size() >= BVH_PENDING) graft();
+}
+
+//
+//  Grafted nodes can sit after their children, so bounds are refit
+//  depth first rather than by a sweep over the array
+//
+void LandmarkBVH::refitNode(int n)
+{
+   Node &node = nodes[n];
+   if (node.count)
+   {
+      bound(node);
+      return;
+   }
+   refitNode(node.first);
+   refitNode(node.first+1);
+   const Node &a = nodes[node.first], &b = nodes[node.first+1];
+   for (int i = 0; i < 3; i++)
+   {
+      node.lo[i] = std::min(a.lo[i], b.lo[i]);
+      node.hi[i] = std::max(a.hi[i], b.hi[i]);
+   }
+}
+
+//
+//  The pending items become a subtree over a new range at the end of
+//  order. It is paired with a copy of the deepest node whose box holds
+//  all of them, and that node turns into their parent
+//
+void LandmarkBVH::graft()
+{
+   int first = order.size(), count = pending.size();
+   order.insert(order.end(), pending.begin(), pending.end());
+   Node batch;
+   batch.first = first;
+   batch.count = count;
+   bound(batch);
+
+   std::vector<int> path(1, 0);
+   for (;;)
+   {
+      const Node &node = nodes[path.back()];
+      if (node.count) break;
+      int next = -1;
+      for (int c = node.first; c <= node.first+1 && next < 0; c++)
+      {
+         bool inside = true;
+         for (int i = 0; i < 3; i++)
+            inside = inside && nodes[c].lo[i] <= batch.lo[i] && batch.hi[i] <= nodes[c].hi[i];
+         if (inside) next = c;
+      }
+      if (next < 0) break;
+      path.push_back(next);
+   }
+
+   int n = path.back(), left = nodes.size();
+   nodes.resize(left+2);
+   nodes[left] = nodes[n];
+   build(left+1, first, count);
+   Node &node = nodes[n];
+   node.first = left;
+   node.count = 0;
+   for (int k = path.size()-1; k >= 0; k--)
+   {
+      Node &up = nodes[path[k]];
+      for (int i = 0; i < 3; i++)
+      {
+         up.lo[i] = std::min(up.lo[i], batch.lo[i]);
+         up.hi[i] = std::max(up.hi[i], batch.hi[i]);
+      }
+   }
+   grafted += count;
+   pending.clear();
+}
+
+void LandmarkBVH::rebuild()
+{
+   // compact away removed items
+   std::vector<Item> live;
+   lookup.clear();
+   for (unsigned int i = 0; i < items.size(); i++)
+      if (items[i].alive)
+      {
+         lookup[items[i].id] = live.size();
+         live.push_back(items[i]);
+      }
+   items.swap(live);
+   dead = grafted = 0;
+   pending.clear();
+   moved = false;
+
+   order.resize(items.size());
+   for (unsigned int i = 0; i < order.size(); i++)
+      order[i] = i;
+   nodes.clear();
+   if (!items.empty())
+   {
+      nodes.reserve(2*items.size()/LEAF_SIZE + 1);
+      nodes.resize(1);
+      build(0, 0, items.size());
+   }
+}
+
+void LandmarkBVH::bound(Node &node) const
+{
+   for (int i = 0; i < 3; i++)
+   {
+      node.lo[i] = INFINITY;
+      node.hi[i] = -INFINITY;
+   }
+   for (int k = node.first; k < node.first+node.count; k++)
+   {
+      const Item &item = items[order[k]];
+      for (int i = 0; i < 3; i++)
+      {
+         node.lo[i] = std::min(node.lo[i], item.c[i]-item.r);
+         node.hi[i] = std::max(node.hi[i], item.c[i]+item.r);
+      }
+   }
+}
+
+//
+//  Median split on the longest axis into nodes[n]
+//
+void LandmarkBVH::build(int n, int first, int count)
+{
+   Node &node = nodes[n];
+   node.first = first;
+   node.count = count;
+   bound(node);
+   if (count <= LEAF_SIZE) return;
+
+   int axis = 0;
+   for (int i = 1; i < 3; i++)
+      if (node.hi[i]-node.lo[i] > node.hi[axis]-node.lo[axis])
+         axis = i;
+   int half = count/2;
+   std::nth_element(order.begin()+first, order.begin()+first+half, order.begin()+first+count,
+                    [this,axis](int a, int b) {return items[a].c[axis] < items[b].c[axis];});
+
+   // children are allocated as a pair so the right child is left+1
+   int left = nodes.size();
+   nodes.resize(left+2);
+   nodes[n].first = left;
+   nodes[n].count = 0;
+   build(left, first, half);
+   build(left+1, first+half, count-half);
+}
+
+bool LandmarkBVH::hitSphere(const Item &item, const float *o, const float *d, float *t) const
+{
+   float oc[3] = {o[0]-item.c[0], o[1]-item.c[1], o[2]-item.c[2]};
+   float b = oc[0]*d[0] + oc[1]*d[1] + oc[2]*d[2];
+   float c = oc[0]*oc[0] + oc[1]*oc[1] + oc[2]*oc[2] - item.r*item.r;
+   float disc = b*b - c;
+   if (disc < 0) return false;
+   float s = sqrtf(disc);
+   *t = (-b - s >= 0) ? -b - s : -b + s;
+   return *t >= 0;
+}
+
+bool LandmarkBVH::hitBox(const Node &node, const float *o, const float *inv, float tmax) const
+{
+   float t0 = 0, t1 = tmax;
+   for (int i = 0; i < 3; i++)
+   {
+      // a ray parallel to the slab, 0*inf would be NaN on its faces
+      if (std::isinf(inv[i]))
+      {
+         if (o[i] < node.lo[i] || o[i] > node.hi[i]) return false;
+         continue;
+      }
+      float a = (node.lo[i]-o[i])*inv[i];
+      float b = (node.hi[i]-o[i])*inv[i];
+      if (a > b) std::swap(a, b);
+      t0 = std::max(t0, a);
+      t1 = std::min(t1, b);
+      if (t0 > t1) return false;
+   }
+   return true;
+}
+
+//
+//  Nearest accepted sphere along a ray, dir must be normalized
+//
+bool LandmarkBVH::raycast(const float *origin, const float *dir,
+                         std::function<bool(unsigned long)> accept,
+                         unsigned long *id, float *t) const
+{
+   float inv[3], best = INFINITY, hit;
+   bool found = false;
+   for (int i = 0; i < 3; i++)
+      inv[i] = 1.0f/dir[i];
+
+   // landmarks added since the last rebuild
+   for (unsigned int k = 0; k < pending.size(); k++)
+   {
+      const Item &item = items[pending[k]];
+      if (item.alive && hitSphere(item, origin, dir, &hit) && hit < best && accept(item.id))
+      {
+         best = hit;
+         *id = item.id;
+         found = true;
+      }
+   }
+
+   std::vector<int> stack;
+   if (!nodes.empty()) stack.push_back(0);
+   while (!stack.empty())
+   {
+      const Node &node = nodes[stack.back()];
+      stack.pop_back();
+      if (!hitBox(node, origin, inv, best)) continue;
+      if (node.count == 0)
+      {
+         stack.push_back(node.first);
+         stack.push_back(node.first+1);
+         continue;
+      }
+      for (int k = node.first; k < node.first+node.count; k++)
+      {
+         const Item &item = items[order[k]];
+         if (item.alive && hitSphere(item, origin, dir, &hit) && hit < best && accept(item.id))
+         {
+            best = hit;
+            *id = item.id;
+            found = true;
+         }
+      }
+   }
+   if (found) *t = best;
+   return found;
+}
+
+//
+//  A hidden node takes its whole subtree, so a test near the root
+//  settles thousands of landmarks; leaves test their items one by one
+//
+void LandmarkBVH::cull(std::function<bool(const float *lo, const float *hi)> hidden,
+                       std::vector<unsigned long> &ids) const
+{
+   float lo[3], hi[3];
+   // landmarks added since the last rebuild
+   for (unsigned int k = 0; k < pending.size(); k++)
+   {
+      const Item &item = items[pending[k]];
+      if (!item.alive) continue;
+      for (int i = 0; i < 3; i++)
+      {
+         lo[i] = item.c[i]-item.r;
+         hi[i] = item.c[i]+item.r;
+      }
+      if (hidden(lo, hi)) ids.push_back(item.id);
+   }
+
+   std::vector<int> stack;
+   if (!nodes.empty()) stack.push_back(0);
+   while (!stack.empty())
+   {
+      const Node &node = nodes[stack.back()];
+      stack.pop_back();
+      if (hidden(node.lo, node.hi))
+      {
+         subtree(&node - nodes.data(), ids);
+         continue;
+      }
+      if (node.count == 0)
+      {
+         stack.push_back(node.first);
+         stack.push_back(node.first+1);
+         continue;
+      }
+      if (node.count == 1) continue;
+      for (int k = node.first; k < node.first+node.count; k++)
+      {
+         const Item &item = items[order[k]];
+         if (!item.alive) continue;
+         for (int i = 0; i < 3; i++)
+         {
+            lo[i] = item.c[i]-item.r;
+            hi[i] = item.c[i]+item.r;
+         }
+         if (hidden(lo, hi)) ids.push_back(item.id);
+      }
+   }
+}
+
+//
+//  Every live item under node n, grafts break up the ranges in order
+//
+void LandmarkBVH::subtree(int n, std::vector<unsigned long> &ids) const
+{
+   const Node &node = nodes[n];
+   if (node.count == 0)
+   {
+      subtree(node.first, ids);
+      subtree(node.first+1, ids);
+      return;
+   }
+   for (int k = node.first; k < node.first+node.count; k++)
+      if (items[order[k]].alive)
+         ids.push_back(items[order[k]].id);
+}
@@ -0,0 +1,66 @@
+//
+// bounding volume hierarchy over landmark spheres for ray picking
+//
+
+#ifndef LANDMARKBVH_H
+#define LANDMARKBVH_H
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <stddef.h>
+
+#define BVH_PENDING 256 // new items tested linearly before they are grafted into the tree
+
+class LandmarkBVH
+{
+public:
+	LandmarkBVH();
+	void update(unsigned long id, const float *center, float radius); // insert or move
+	void remove(unsigned long id);
+	void refit();
+	bool raycast(const float *origin, const float *dir,
+				 std::function<bool(unsigned long)> accept,
+				 unsigned long *id, float *t) const;
+	// appends the ids of live items in boxes hidden() accepts
+	void cull(std::function<bool(const float *lo, const float *hi)> hidden,
+			  std::vector<unsigned long> &ids) const;
+	unsigned int size() const {return lookup.size();}
+	size_t bytes() const;
+
+private:
+	typedef struct Item
+	{
+		unsigned long id;
+		float c[3];
+		float r;
+		bool alive;
+	} Item;
+
+	typedef struct Node
+	{
+		float lo[3], hi[3];
+		int first;  // left child for inner nodes, first order index for leaves
+		int count;  // items in a leaf, 0 for inner nodes
+	} Node;
+
+	std::vector<Item> items;
+	std::vector<int> order;   // item indices, leaves reference ranges
+	std::vector<Node> nodes;  // children are allocated as adjacent pairs
+	std::vector<int> pending; // items added since the last graft, at most BVH_PENDING
+	std::unordered_map<unsigned long, int> lookup;
+	int dead;
+	int grafted;              // items grafted in since the last build
+	bool moved;
+
+	void rebuild();
+	void graft();
+	void build(int n, int first, int count);
+	void refitNode(int n);
+	void subtree(int n, std::vector<unsigned long> &ids) const;
+	void bound(Node &node) const;
+	bool hitSphere(const Item &item, const float *o, const float *d, float *t) const;
+	bool hitBox(const Node &node, const float *o, const float *inv, float tmax) const;
+};
+
+#endif
@@ -0,0 +1,150 @@
+//
+//  Clustered light binning
+//  the view frustum is split into nx*ny screen tiles and nz exponential
+//  depth slices, and every light is added to the clusters its bounding
+//  box touches so the fragment shader only loops over nearby lights
+//
+#include "LightClusters.h"
+#include <algorithm>
+#include <math.h>
+
+LightClusters::LightClusters(int nx, int ny, int nz)
+{
+   this->nx = nx;
+   this->ny = ny;
+   this->nz = nz;
+   table.assign(2*nx*ny*nz, 0);
+   setProjection(60, 1, 1, 100);
+}
+
+//
+//  Match the perspective set by SlamViz::project
+//
+void LightClusters::setProjection(double fov, double asp, double znear, double zfar)
+{
+   yscale = 1.0/tan(fov*3.1415926/360.0);
+   xscale = yscale/asp;
+   this->znear = znear;
+   this->zfar = zfar;
+}
+
+//
+//  Exponential depth slice for a positive view depth
+//
+int LightClusters::slice(double depth) const
+{
+   if (depth <= znear) return 0;
+   int k = int(log(depth/znear)/log(zfar/znear)*nz);
+   return std::min(std::max(k,0),nz-1);
+}
+
+//
+//  Conservative cluster range of a light, false if it is off screen
+//
+bool LightClusters::bounds(const ClusterLight &light, int *lo, int *hi) const
+{
+   double cz = -light.pos[2];
+   double r = light.radius;
+   if (cz + r < znear || cz - r > zfar) return false;
+   lo[2] = slice(cz - r);
+   hi[2] = slice(cz + r);
+   // a sphere crossing the near plane can cover any tile
+   double dmin = cz - r, dmax = cz + r;
+   if (dmin <= znear)
+   {
+      lo[0] = lo[1] = 0;
+      hi[0] = nx-1;
+      hi[1] = ny-1;
+      return true;
+   }
+   // project the view-space box at its nearest and farthest depths
+   double ext[2][2];
+   for (int a = 0; a < 2; a++)
+   {
+      double scale = a ? yscale : xscale;
+      double v0 = light.pos[a] - r, v1 = light.pos[a] + r;
+      ext[a][0] = scale*std::min(v0/dmin, v0/dmax);
+      ext[a][1] = scale*std::max(v1/dmin, v1/dmax);
+      if (ext[a][1] < -1 || ext[a][0] > 1) return false;
+   }
+   int n[2] = {nx, ny};
+   for (int a = 0; a < 2; a++)
+   {
+      lo[a] = std::min(std::max(int((ext[a][0]+1)/2*n[a]),0),n[a]-1);
+      hi[a] = std::min(std::max(int((ext[a][1]+1)/2*n[a]),0),n[a]-1);
+   }
+   return true;
+}
+
+//
+//  Bin lights in parallel: each task counts its chunk per cluster,
+//  a prefix sum over (cluster,task) gives every task its own write
+//  offsets, then each task scatters its indices without locking
+//
+void LightClusters::build(const std::vector<ClusterLight> &lights, JobSystem *jobs)
+{
+   int nclusters = nx*ny*nz;
+   int nlights = lights.size();
+   int nthreads = std::min(jobs->threads(), nlights/1024 + 1);
+   std::vector<std::vector<unsigned int> > counts(nthreads, std::vector<unsigned int>(nclusters, 0));
+   std::vector<int> ranges(6*nlights);
+
+   // count pass
+   auto count = [&](int t)
+   {
+      int first = (long)nlights*t/nthreads, last = (long)nlights*(t+1)/nthreads;
+      for (int i = first; i < last; i++)
+      {
+         int *lo = &ranges[6*i], *hi = lo+3;
+         if (!bounds(lights[i], lo, hi))
+         {
+            lo[0] = lo[1] = lo[2] = 1;  // empty range
+            hi[0] = hi[1] = hi[2] = 0;
+            continue;
+         }
+         for (int z = lo[2]; z <= hi[2]; z++)
+            for (int y = lo[1]; y <= hi[1]; y++)
+               for (int x = lo[0]; x <= hi[0]; x++)
+                  counts[t][clusterIndex(x,y,z)]++;
+      }
+   };
+   jobs->parallelFor(nthreads, 1, [&](int t0, int t1)
+   {
+      for (int t = t0; t < t1; t++)
+         count(t);
+   });
+
+   // prefix sum, counts become per-thread write offsets
+   unsigned int total = 0;
+   for (int c = 0; c < nclusters; c++)
+   {
+      table[2*c] = total;
+      for (int t = 0; t < nthreads; t++)
+      {
+         unsigned int n = counts[t][c];
+         counts[t][c] = total;
+         total += n;
+      }
+      table[2*c+1] = total - table[2*c];
+   }
+   indices.resize(total);
+
+   // scatter pass
+   auto scatter = [&](int t)
+   {
+      int first = (long)nlights*t/nthreads, last = (long)nlights*(t+1)/nthreads;
+      for (int i = first; i < last; i++)
+      {
+         int *lo = &ranges[6*i], *hi = lo+3;
+         for (int z = lo[2]; z <= hi[2]; z++)
+            for (int y = lo[1]; y <= hi[1]; y++)
+               for (int x = lo[0]; x <= hi[0]; x++)
+                  indices[counts[t][clusterIndex(x,y,z)]++] = i;
+      }
+   };
+   jobs->parallelFor(nthreads, 1, [&](int t0, int t1)
+   {
+      for (int t = t0; t < t1; t++)
+         scatter(t);
+   });
+}
@@ -0,0 +1,40 @@
+//
+// bins point lights into a view-space cluster grid for forward shading
+//
+
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <vector>
+#include "JobSystem.h"
+
+// laid out as two RGBA32F texels for the light buffer texture
+typedef struct ClusterLight
+{
+	float pos[3];      // view space
+	float radius;      // light has no effect past this distance
+	float color[3];
+	float intensity;
+} ClusterLight;
+
+class LightClusters
+{
+public:
+	LightClusters(int nx, int ny, int nz);
+	void setProjection(double fov, double asp, double znear, double zfar);
+	void build(const std::vector<ClusterLight> &lights, JobSystem *jobs);
+	int clusterIndex(int x, int y, int z) const {return (z*ny + y)*nx + x;}
+
+	int nx, ny, nz;
+	double znear, zfar;
+	std::vector<unsigned int> table;   // offset,count into indices per cluster
+	std::vector<unsigned int> indices; // light indices grouped by cluster
+
+private:
+	double xscale, yscale; // projection matrix [0][0] and [1][1]
+
+	bool bounds(const ClusterLight &light, int *lo, int *hi) const;
+	int slice(double depth) const;
+};
+
+#endif
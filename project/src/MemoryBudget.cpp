@@ -0,0 +1,111 @@
+//
+//  Memory budget
+//  the counters are estimates refreshed after every ingest, containers
+//  are charged for their capacity plus allocator node overhead
+//
+#include <QTextStream>
+#include "MemoryBudget.h"
+
+static const char *pool_names[MEM_POOLS] =
+   {"landmarks", "trajectory", "textures", "meshes", "gpu buffers"};
+
+MemoryBudget::MemoryBudget()
+{
+   for (int i = 0; i < MEM_POOLS; i++)
+      pools[i] = 0;
+   soft_limit = hard_limit = 0;
+   decimated = spilled = evicted = 0;
+}
+
+void MemoryBudget::set(int pool, size_t bytes)
+{
+   pools[pool] = bytes;
+}
+
+size_t MemoryBudget::total() const
+{
+   size_t sum = 0;
+   for (int i = 0; i < MEM_POOLS; i++)
+      sum += pools[i];
+   return sum;
+}
+
+void MemoryBudget::setLimits(size_t soft, size_t hard)
+{
+   soft_limit = soft;
+   hard_limit = hard;
+   // a hard limit below the soft one would skip straight to evicting
+   if (hard_limit && soft_limit > hard_limit)
+      soft_limit = hard_limit;
+}
+
+int MemoryBudget::pressure() const
+{
+   if (hard_limit && growing() > hard_limit) return MEM_HARD;
+   if (soft_limit && growing() > soft_limit) return MEM_SOFT;
+   return MEM_OK;
+}
+
+size_t MemoryBudget::excess() const
+{
+   size_t limit = soft_limit ? soft_limit : hard_limit;
+   return limit && growing() > limit ? growing() - limit : 0;
+}
+
+//
+//  Overlay text, one line per pool
+//
+QStringList MemoryBudget::hud() const
+{
+   QStringList lines;
+   lines << QString("%1 %2").arg("memory",-14).arg("MB",8);
+   for (int i = 0; i < MEM_POOLS; i++)
+      lines << QString("%1 %2").arg(pool_names[i],-14).arg(pools[i]/1048576.0,8,'f',2);
+   QString limits;
+   if (soft_limit) limits += QString("  soft %1").arg(soft_limit/1048576.0,0,'f',0);
+   if (hard_limit) limits += QString("  hard %1").arg(hard_limit/1048576.0,0,'f',0);
+   lines << QString("%1 %2%3").arg("total",-14).arg(total()/1048576.0,8,'f',2).arg(limits);
+   if (decimated || spilled || evicted)
+      lines << QString("thinned %1 poses, spilled %2, evicted %3 lmrks")
+               .arg(decimated).arg(spilled).arg(evicted);
+   return lines;
+}
+
+bool MemoryBudget::setLog(const QString &path)
+{
+   file.setFileName(path);
+   if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+      return false;
+   QTextStream out(&file);
+   out << "tick";
+   for (int i = 0; i < MEM_POOLS; i++)
+      out << "," << QString(pool_names[i]).replace(' ', '_');
+   out << ",total,decimated,spilled,evicted\n";
+   return true;
+}
+
+void MemoryBudget::log(long tick)
+{
+   if (!file.isOpen()) return;
+   QTextStream out(&file);
+   out << tick;
+   for (int i = 0; i < MEM_POOLS; i++)
+      out << "," << (qulonglong)pools[i];
+   out << "," << (qulonglong)total() << "," << decimated << "," << spilled << "," << evicted << "\n";
+   out.flush();
+   file.flush();
+}
+
+//
+//  Texel storage of a texture, a mip chain adds a third
+//
+size_t MemoryBudget::textureBytes(const QOpenGLTexture *tex)
+{
+   if (!tex || !tex->isCreated()) return 0;
+   size_t texels = (size_t)tex->width()*tex->height();
+   QOpenGLTexture::TextureFormat format = tex->format();
+   size_t bytes = (format == QOpenGLTexture::RGB_DXT1 || format == QOpenGLTexture::RGBA_DXT1)
+                  ? texels/2 : 4*texels;
+   if (tex->mipLevels() > 1) bytes += bytes/3;
+   return bytes;
+}
@@ -0,0 +1,61 @@
+//
+// per-subsystem memory accounting with soft and hard limits
+//
+
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <QString>
+#include <QStringList>
+#include <QFile>
+#include <QOpenGLTexture>
+#include <stddef.h>
+
+#define MEM_LANDMARKS   0
+#define MEM_TRAJECTORY  1
+#define MEM_TEXTURES    2
+#define MEM_MESHES      3
+#define MEM_GPU_BUFFERS 4
+#define MEM_POOLS       5
+
+#define MEM_OK   0 // under the soft limit
+#define MEM_SOFT 1 // over the soft limit
+#define MEM_HARD 2 // over the hard limit
+
+#define MEM_MAP_NODE  32  // std::map node header (colour and three links)
+#define MEM_LOG_TICKS 256 // replay ticks between log rows
+
+class MemoryBudget
+{
+public:
+	MemoryBudget();
+	void set(int pool, size_t bytes);
+	size_t bytes(int pool) const {return pools[pool];}
+	size_t total() const;
+	// the limits cover the landmark store and trajectory, the only
+	// pools that grow with the length of a run; 0 disables a limit
+	void setLimits(size_t soft, size_t hard);
+	size_t softLimit() const {return soft_limit;}
+	size_t growing() const {return pools[MEM_LANDMARKS] + pools[MEM_TRAJECTORY];}
+	int pressure() const;
+	// bytes over the soft limit, or the hard one if there is no soft limit
+	size_t excess() const;
+	QStringList hud() const;
+	bool setLog(const QString &path); // CSV, one row every MEM_LOG_TICKS
+	void log(long tick);
+	static size_t textureBytes(const QOpenGLTexture *tex);
+	// an unordered map's entries, each a node with a next link, and buckets
+	template<class M> static size_t hashMapBytes(const M &m)
+		{return m.size()*(sizeof(typename M::value_type) + sizeof(void*)) + m.bucket_count()*sizeof(void*);}
+
+	long decimated; // trajectory poses thinned out
+	long spilled;   // inactive landmarks written to the spill file
+	long evicted;   // inactive landmarks dropped
+
+private:
+	size_t pools[MEM_POOLS];
+	size_t soft_limit, hard_limit;
+	QFile file;
+};
+
+#endif
@@ -0,0 +1,71 @@
+//
+//  View setup and frustum culling shared by every camera
+//
+#include "MultiView.h"
+
+void setPerspective(ViewCam &cam, double fov, double asp, double znear, double zfar)
+{
+   cam.perspective = true;
+   cam.fov = fov;
+   cam.asp = asp;
+   cam.znear = znear;
+   cam.zfar = zfar;
+   cam.proj = glm::perspective(glm::radians((float)fov), (float)asp, (float)znear, (float)zfar);
+}
+
+void setOrtho(ViewCam &cam, double w, double h, double znear, double zfar)
+{
+   cam.perspective = false;
+   cam.fov = 0;
+   cam.asp = w/h;
+   cam.znear = znear;
+   cam.zfar = zfar;
+   cam.proj = glm::ortho(-w, w, -h, h, znear, zfar);
+}
+
+void setLookAt(ViewCam &cam, glm::vec3 eye, glm::vec3 center, glm::vec3 up)
+{
+   cam.eye = eye;
+   cam.center = center;
+   cam.view = glm::lookAt(eye, center, up);
+}
+
+//
+//  Extract the frustum planes from the combined clip matrix
+//
+void setFrustum(ViewCam &cam)
+{
+   glm::mat4 m = glm::transpose(cam.proj*cam.view);
+   cam.planes[0] = m[3] + m[0];  // left
+   cam.planes[1] = m[3] - m[0];  // right
+   cam.planes[2] = m[3] + m[1];  // bottom
+   cam.planes[3] = m[3] - m[1];  // top
+   cam.planes[4] = m[3] + m[2];  // near
+   cam.planes[5] = m[3] - m[2];  // far
+   for (int i = 0; i < 6; i++)
+      cam.planes[i] /= glm::length(glm::vec3(cam.planes[i]));
+}
+
+bool sphereInView(const ViewCam &cam, const glm::vec3 &c, float r)
+{
+   for (int i = 0; i < 6; i++)
+      if (glm::dot(glm::vec3(cam.planes[i]), c) + cam.planes[i].w < -r)
+         return false;
+   return true;
+}
+
+//
+//  Conservative, a box is only rejected when its corner farthest
+//  along a plane's normal is outside it
+//
+bool boxInView(const ViewCam &cam, const glm::vec3 &lo, const glm::vec3 &hi)
+{
+   for (int i = 0; i < 6; i++)
+   {
+      const glm::vec4 &p = cam.planes[i];
+      glm::vec3 c(p.x > 0 ? hi.x : lo.x, p.y > 0 ? hi.y : lo.y, p.z > 0 ? hi.z : lo.z);
+      if (glm::dot(glm::vec3(p), c) + p.w < 0)
+         return false;
+   }
+   return true;
+}
@@ -0,0 +1,46 @@
+//
+// camera views and the culled draw list they share
+//
+
+#ifndef MULTIVIEW_H
+#define MULTIVIEW_H
+
+#define GLM_ENABLE_EXPERIMENTAL
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#define MAX_VIEWS 32 // one bit per view in DrawItem::views
+
+typedef struct ViewCam
+{
+	glm::mat4 proj;
+	glm::mat4 view;
+	int vp[4];           // viewport x, y, width, height
+	glm::vec3 eye;
+	glm::vec3 center;
+	bool perspective;
+	double fov, asp, znear, zfar;
+	glm::vec4 planes[6]; // frustum planes, inside is positive
+} ViewCam;
+
+// a landmark that survived culling for at least one view
+typedef struct DrawItem
+{
+	unsigned long id;
+	glm::vec3 point;     // landmark coordinates, drawn under Rx(-90)
+	glm::vec3 world;     // point in world coordinates
+	float quality;
+	bool active;
+	unsigned int views;  // bit v set if visible in view v
+	float key;           // draw order, squared distance from the first view
+} DrawItem;
+
+void setPerspective(ViewCam &cam, double fov, double asp, double znear, double zfar);
+void setOrtho(ViewCam &cam, double w, double h, double znear, double zfar);
+void setLookAt(ViewCam &cam, glm::vec3 eye, glm::vec3 center, glm::vec3 up);
+void setFrustum(ViewCam &cam);
+bool sphereInView(const ViewCam &cam, const glm::vec3 &c, float r);
+bool boxInView(const ViewCam &cam, const glm::vec3 &lo, const glm::vec3 &hi);
+
+#endif
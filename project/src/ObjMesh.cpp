@@ -0,0 +1,277 @@
+#include "ObjMesh.h"
+#include <string>
+#include <unordered_map>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define OBJ_MAX_EXPONENT 64 // larger float exponents are clamped
+
+typedef struct MeshHeader
+{
+	char magic[4];
+	int64_t src_size;
+	int64_t src_mtime;
+	uint32_t nvertices;
+	uint32_t nindices;
+} MeshHeader;
+
+// position/uv/normal index tuple for one face corner, -1 if missing
+typedef struct Corner
+{
+	long v, vt, vn;
+	bool operator==(const Corner &c) const
+	{
+		return v == c.v && vt == c.vt && vn == c.vn;
+	}
+} Corner;
+
+struct CornerHash
+{
+	size_t operator()(const Corner &c) const
+	{
+		return (size_t)(c.v*73856093L ^ c.vt*19349663L ^ c.vn*83492791L);
+	}
+};
+
+static void skipSpace(const char *&p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+}
+
+static void skipLine(const char *&p, const char *end)
+{
+	while (p < end && *p != '\n')
+		p++;
+	if (p < end) p++;
+}
+
+static bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// parse a float without requiring a terminated buffer
+static float parseFloat(const char *&p, const char *end)
+{
+	double sign = 1, value = 0, scale = 1;
+	int exponent = 0, exp_sign = 1;
+	skipSpace(p, end);
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		if (*p == '-') sign = -1;
+		p++;
+	}
+	while (p < end && isDigit(*p))
+		value = 10*value + (*p++ - '0');
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && isDigit(*p))
+		{
+			scale *= 0.1;
+			value += (*p++ - '0')*scale;
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			if (*p == '-') exp_sign = -1;
+			p++;
+		}
+		// digits past the clamp are consumed but can't overflow
+		while (p < end && isDigit(*p))
+			exponent = std::min(10*exponent + (*p++ - '0'), OBJ_MAX_EXPONENT);
+		value *= pow(10.0, exp_sign*exponent);
+	}
+	return sign*value;
+}
+
+static long parseInt(const char *&p, const char *end)
+{
+	long sign = 1, value = 0;
+	if (p < end && *p == '-')
+	{
+		sign = -1;
+		p++;
+	}
+	while (p < end && isDigit(*p))
+		value = 10*value + (*p++ - '0');
+	return sign*value;
+}
+
+// convert a 1-based (or negative, relative) OBJ index to 0-based,
+// zero or a relative index before the first element maps to count
+// so the range check rejects it instead of treating it as missing
+static long fixIndex(long idx, size_t count)
+{
+	if (idx > 0) return idx-1;
+	if (idx < 0 && (long)count + idx >= 0) return (long)count + idx;
+	return (long)count;
+}
+
+bool parseOBJ(const char *data, size_t size, Mesh &mesh)
+{
+	const char *p = data, *end = data + size;
+	std::vector<float> positions, uvs, normals;
+	std::unordered_map<Corner, unsigned int, CornerHash> lookup;
+	std::vector<unsigned int> face;
+
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	while (p < end)
+	{
+		skipSpace(p, end);
+		if (end-p > 2 && p[0] == 'v' && p[1] == ' ')
+		{
+			p += 2;
+			for (int i = 0; i < 3; i++)
+				positions.push_back(parseFloat(p, end));
+		}
+		else if (end-p > 3 && p[0] == 'v' && p[1] == 't' && p[2] == ' ')
+		{
+			p += 3;
+			for (int i = 0; i < 2; i++)
+				uvs.push_back(parseFloat(p, end));
+		}
+		else if (end-p > 3 && p[0] == 'v' && p[1] == 'n' && p[2] == ' ')
+		{
+			p += 3;
+			for (int i = 0; i < 3; i++)
+				normals.push_back(parseFloat(p, end));
+		}
+		else if (end-p > 2 && p[0] == 'f' && p[1] == ' ')
+		{
+			p += 2;
+			face.clear();
+			skipSpace(p, end);
+			while (p < end && *p != '\n' && *p != '#')
+			{
+				Corner c;
+				const char *start = p;
+				c.v = fixIndex(parseInt(p, end), positions.size()/3);
+				if (p == start) return false; // not an index
+				c.vt = c.vn = -1;
+				if (p < end && *p == '/')
+				{
+					p++;
+					if (p < end && *p != '/')
+						c.vt = fixIndex(parseInt(p, end), uvs.size()/2);
+					if (p < end && *p == '/')
+					{
+						p++;
+						c.vn = fixIndex(parseInt(p, end), normals.size()/3);
+					}
+				}
+				if (c.v < 0 || 3*c.v >= (long)positions.size() ||
+					2*c.vt >= (long)uvs.size() || 3*c.vn >= (long)normals.size())
+					return false;
+
+				// reuse the vertex if this tuple has been seen before
+				std::unordered_map<Corner, unsigned int, CornerHash>::iterator it = lookup.find(c);
+				if (it != lookup.end())
+				{
+					face.push_back(it->second);
+				}
+				else
+				{
+					unsigned int idx = mesh.vertices.size()/MESH_STRIDE;
+					for (int i = 0; i < 3; i++)
+						mesh.vertices.push_back(positions[3*c.v+i]);
+					for (int i = 0; i < 2; i++)
+						mesh.vertices.push_back(c.vt < 0 ? 0 : uvs[2*c.vt+i]);
+					for (int i = 0; i < 3; i++)
+						mesh.vertices.push_back(c.vn < 0 ? 0 : normals[3*c.vn+i]);
+					lookup[c] = idx;
+					face.push_back(idx);
+				}
+				skipSpace(p, end);
+			}
+			// triangulate polygons as a fan
+			for (unsigned int i = 1; i+1 < face.size(); i++)
+			{
+				mesh.indices.push_back(face[0]);
+				mesh.indices.push_back(face[i]);
+				mesh.indices.push_back(face[i+1]);
+			}
+		}
+		skipLine(p, end);
+	}
+	return !mesh.indices.empty();
+}
+
+bool readMeshCache(const char *path, long src_size, long src_mtime, Mesh &mesh)
+{
+	MeshHeader head;
+	struct stat st;
+	FILE *f = fopen(path, "rb");
+	bool ok = false;
+	if (!f) return false;
+	// the counts must account for exactly the rest of the file,
+	// so a corrupt header cannot make us allocate more than it holds
+	if (fstat(fileno(f), &st) == 0 &&
+		fread(&head, sizeof(head), 1, f) == 1 &&
+		memcmp(head.magic, "SMB1", 4) == 0 &&
+		head.src_size == src_size && head.src_mtime == src_mtime &&
+		(uint64_t)st.st_size == sizeof(head) +
+			(uint64_t)head.nvertices*MESH_STRIDE*sizeof(float) +
+			(uint64_t)head.nindices*sizeof(unsigned int))
+	{
+		mesh.vertices.resize((size_t)head.nvertices*MESH_STRIDE);
+		mesh.indices.resize(head.nindices);
+		ok = fread(mesh.vertices.data(), sizeof(float), mesh.vertices.size(), f) == mesh.vertices.size() &&
+			 fread(mesh.indices.data(), sizeof(unsigned int), mesh.indices.size(), f) == mesh.indices.size();
+		for (size_t i = 0; ok && i < mesh.indices.size(); i++)
+			ok = mesh.indices[i] < head.nvertices;
+	}
+	fclose(f);
+	return ok;
+}
+
+bool writeMeshCache(const char *path, long src_size, long src_mtime, const Mesh &mesh)
+{
+	MeshHeader head = {};
+	std::string tmp = std::string(path) + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "wb");
+	if (!f) return false;
+	memcpy(head.magic, "SMB1", 4);
+	head.src_size = src_size;
+	head.src_mtime = src_mtime;
+	head.nvertices = mesh.vertices.size()/MESH_STRIDE;
+	head.nindices = mesh.indices.size();
+	bool ok = fwrite(&head, sizeof(head), 1, f) == 1 &&
+			  fwrite(mesh.vertices.data(), sizeof(float), mesh.vertices.size(), f) == mesh.vertices.size() &&
+			  fwrite(mesh.indices.data(), sizeof(unsigned int), mesh.indices.size(), f) == mesh.indices.size();
+	ok = (fclose(f) == 0) && ok;
+	// rename into place so a reader never sees half a file
+	return ok && rename(tmp.c_str(), path) == 0;
+}
+
+bool loadMesh(const char *path, Mesh &mesh)
+{
+	struct stat st;
+	std::string cache = std::string(path) + ".mesh";
+	if (stat(path, &st) != 0 || st.st_size == 0) return false;
+	if (readMeshCache(cache.c_str(), st.st_size, st.st_mtime, mesh))
+		return true;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return false;
+	bool ok = parseOBJ((const char*)data, st.st_size, mesh);
+	munmap(data, st.st_size);
+
+	if (ok) writeMeshCache(cache.c_str(), st.st_size, st.st_mtime, mesh);
+	return ok;
+}
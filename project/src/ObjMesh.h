@@ -0,0 +1,25 @@
+//
+// indexed Wavefront OBJ loading with a binary cache next to the source
+//
+
+#ifndef OBJMESH_H
+#define OBJMESH_H
+
+#include <vector>
+#include <stddef.h>
+
+#define MESH_STRIDE 8 // floats per vertex: x,y,z, u,v, nx,ny,nz
+
+typedef struct Mesh
+{
+	std::vector<float> vertices;       // interleaved, MESH_STRIDE per vertex
+	std::vector<unsigned int> indices; // triangles
+} Mesh;
+
+// loads path+".mesh" if it is current, otherwise parses path and writes it
+bool loadMesh(const char *path, Mesh &mesh);
+bool parseOBJ(const char *data, size_t size, Mesh &mesh);
+bool readMeshCache(const char *path, long src_size, long src_mtime, Mesh &mesh);
+bool writeMeshCache(const char *path, long src_size, long src_mtime, const Mesh &mesh);
+
+#endif
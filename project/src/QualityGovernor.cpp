@@ -0,0 +1,95 @@
+//
+//  Quality governor
+//  each level lowers one or two settings, cheapest to notice first;
+//  a drop needs a run of slow frames and a raise a much longer run of
+//  fast ones, and a raise that is undone soon after makes the next
+//  raise wait twice as long, so quality settles instead of oscillating
+//
+#include "QualityGovernor.h"
+#include <algorithm>
+
+static const Quality levels[QUALITY_LEVELS] =
+{
+   {0,  1.5, 15, 1.0},
+   {0,  1.5, 10, 1.0},
+   {0,  3.0, 10, 1.0},
+   {1,  3.0, 10, 1.0},
+   {1,  3.0,  6, 0.85},
+   {1,  6.0,  6, 0.75},
+   {2,  6.0,  4, 0.65},
+   {2, 12.0,  3, 0.5},
+};
+
+QualityGovernor::QualityGovernor()
+{
+   target_ms = 1000.0/GOVERNOR_FPS;
+   last_ms = 0;
+   cur = 0;
+   slow = fast = 0;
+   settle = GOVERNOR_SETTLE;
+   up_wait = GOVERNOR_UP;
+   since_raise = 8*GOVERNOR_UP;
+}
+
+void QualityGovernor::setTarget(double fps)
+{
+   target_ms = fps > 0 ? 1000.0/fps : 0;
+   if (!target_ms) cur = 0;
+}
+
+const Quality &QualityGovernor::quality() const
+{
+   return levels[cur];
+}
+
+bool QualityGovernor::update(double frame_ms)
+{
+   last_ms = frame_ms;
+   if (!target_ms || frame_ms <= 0) return false;
+   if (since_raise < 16*GOVERNOR_UP) since_raise++;
+   if (settle > 0)
+   {
+      settle--;
+      return false;
+   }
+   slow = frame_ms > GOVERNOR_SLOW*target_ms ? slow+1 : 0;
+   fast = frame_ms < GOVERNOR_FAST*target_ms ? fast+1 : 0;
+   if (slow >= GOVERNOR_DOWN && cur < QUALITY_LEVELS-1)
+   {
+      // the level just raised to couldn't hold the target
+      if (since_raise < up_wait + GOVERNOR_SETTLE)
+         up_wait = std::min(2*up_wait, 8*GOVERNOR_UP);
+      cur++;
+   }
+   else if (fast >= up_wait && cur > 0)
+   {
+      cur--;
+      since_raise = 0;
+   }
+   else
+   {
+      // a long stable stretch forgets old failures
+      if (since_raise > 8*GOVERNOR_UP && up_wait > GOVERNOR_UP)
+         up_wait = std::max(up_wait/2, GOVERNOR_UP);
+      return false;
+   }
+   slow = fast = 0;
+   settle = GOVERNOR_SETTLE;
+   return true;
+}
+
+QStringList QualityGovernor::hud() const
+{
+   const Quality &q = levels[cur];
+   QStringList lines;
+   if (!target_ms)
+   {
+      lines << QString("quality fixed, frame %1 ms").arg(last_ms,0,'f',1);
+      return lines;
+   }
+   lines << QString("quality %1/%2  frame %3 ms  target %4 ms")
+            .arg(cur).arg(QUALITY_LEVELS-1).arg(last_ms,0,'f',1).arg(target_ms,0,'f',1);
+   lines << QString("shadow 1/%1  lod %2 px  smoke %3  scale %4")
+            .arg(1 << q.shadow_shift).arg(q.lod_pixels,0,'f',1).arg(q.smoke_puffs).arg(q.scale,0,'f',2);
+   return lines;
+}
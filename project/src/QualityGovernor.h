@@ -0,0 +1,46 @@
+//
+// steps rendering quality down and up to hold a target frame time
+//
+
+#ifndef QUALITYGOVERNOR_H
+#define QUALITYGOVERNOR_H
+
+#include <QStringList>
+
+#define GOVERNOR_FPS    30   // default target
+#define QUALITY_LEVELS  8    // 0 is full quality
+#define GOVERNOR_SLOW   1.10 // frames over target by this factor count toward a drop
+#define GOVERNOR_FAST   0.70 // frames under target by this factor count toward a raise
+#define GOVERNOR_DOWN   15   // consecutive slow frames before dropping a level
+#define GOVERNOR_UP     90   // consecutive fast frames before raising one
+#define GOVERNOR_SETTLE 30   // frames ignored after a change while timings catch up
+
+typedef struct Quality
+{
+	int shadow_shift;   // shadow map is the largest supported size >> shadow_shift
+	double lod_pixels;  // stars smaller than this on screen are drawn as points
+	int smoke_puffs;    // trajectory puffs drawn
+	double scale;       // render resolution relative to the window
+} Quality;
+
+class QualityGovernor
+{
+public:
+	QualityGovernor();
+	void setTarget(double fps);    // 0 holds full quality
+	bool update(double frame_ms);  // true if the level changed
+	const Quality &quality() const;
+	int level() const {return cur;}
+	QStringList hud() const;
+
+private:
+	double target_ms;
+	double last_ms;
+	int cur;
+	int slow, fast;   // consecutive frames over and under target
+	int settle;       // frames left to ignore
+	int up_wait;      // fast frames needed to raise, grows if raises fail
+	int since_raise;  // frames since the last raise
+};
+
+#endif
@@ -0,0 +1,57 @@
+//
+//  Render thread
+//  owns a context shared with the widget, so everything it draws into
+//  its own framebuffers can be sampled by the widget's context
+//
+#include "RenderThread.h"
+
+//
+//  Constructor
+//  like the upload thread, the context and offscreen surface are
+//  created on the GUI thread and the context is handed over
+//
+RenderThread::RenderThread(QOpenGLContext *share, Task init, Task frame, Task cleanup)
+{
+   quit = false;
+   this->init = init;
+   this->frame = frame;
+   this->cleanup = cleanup;
+   ctx = new QOpenGLContext();
+   ctx->setFormat(share->format());
+   ctx->setShareContext(share);
+   ctx->create();
+   surface = new QOffscreenSurface();
+   surface->setFormat(ctx->format());
+   surface->create();
+   ctx->moveToThread(this);
+   start();
+}
+
+RenderThread::~RenderThread()
+{
+   quit = true;
+   wake();
+   wait();
+   delete ctx;
+   delete surface;
+}
+
+void RenderThread::wake()
+{
+   wakes.release();
+}
+
+void RenderThread::run()
+{
+   ctx->makeCurrent(surface);
+   init();
+   while (!quit)
+   {
+      frame();
+      // wakes that arrived while drawing are all served by the next frame
+      wakes.tryAcquire(1, RENDER_IDLE_MS);
+      while (wakes.tryAcquire()) ;
+   }
+   cleanup();
+   ctx->doneCurrent();
+}
@@ -0,0 +1,39 @@
+//
+// draws on its own thread through a context shared with the widget
+//
+
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <QThread>
+#include <QSemaphore>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <atomic>
+#include <functional>
+
+#define RENDER_IDLE_MS 16 // longest wait between frame calls without a wake
+
+class RenderThread : public QThread
+{
+public:
+	// all three run on the render thread with its context current,
+	// frame runs after every wake and at least every RENDER_IDLE_MS
+	typedef std::function<void()> Task;
+
+	RenderThread(QOpenGLContext *share, Task init, Task frame, Task cleanup);
+	~RenderThread(); // runs cleanup and joins the thread
+	void wake();     // any thread
+
+protected:
+	void run();
+
+private:
+	QOpenGLContext *ctx;
+	QOffscreenSurface *surface;
+	QSemaphore wakes;
+	std::atomic<bool> quit;
+	Task init, frame, cleanup;
+};
+
+#endif
@@ -0,0 +1,175 @@
+//
+//  Scene graph
+//  transform nodes are few and stored parents first, so one forward pass
+//  refreshes every stale world matrix; landmark leaves keep a cached
+//  world center and are only recomputed when they move or the root does
+//
+#include "SceneGraph.h"
+#include "Star.h"
+#include "MemoryBudget.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+
+SceneGraph::SceneGraph()
+{
+   updates = 0;
+   addNode(-1, glm::rotate(glm::mat4(1), glm::radians(-90.0f), glm::vec3(1,0,0)));
+   addNode(SCENE_ROOT);
+}
+
+int SceneGraph::addNode(int parent, const glm::mat4 &local)
+{
+   Node node;
+   node.parent = parent;
+   node.dirty = true;
+   node.local = local;
+   node.world = parent < 0 ? local : nodes[parent].world*local;
+   nodes.push_back(node);
+   return nodes.size()-1;
+}
+
+void SceneGraph::setLocal(int node, const glm::mat4 &local)
+{
+   if (nodes[node].local == local) return;
+   nodes[node].local = local;
+   nodes[node].dirty = true;
+}
+
+void SceneGraph::setLandmark(unsigned long id, const glm::vec3 &point, float quality, bool active)
+{
+   std::unordered_map<unsigned long, int>::iterator it = lookup.find(id);
+   int slot;
+   if (it != lookup.end())
+   {
+      slot = it->second;
+      Leaf &leaf = leaves[slot];
+      if (leaf.point == point && leaf.quality == quality && leaf.active == active) return;
+   }
+   else if (!free_leaves.empty())
+   {
+      slot = free_leaves.back();
+      free_leaves.pop_back();
+      lookup[id] = slot;
+   }
+   else
+   {
+      slot = leaves.size();
+      leaves.push_back(Leaf());
+      leaves[slot].dirty = false;
+      lookup[id] = slot;
+   }
+   Leaf &leaf = leaves[slot];
+   leaf.id = id;
+   leaf.point = point;
+   leaf.quality = quality;
+   leaf.active = active;
+   leaf.alive = true;
+   if (!leaf.dirty)
+   {
+      leaf.dirty = true;
+      dirty_leaves.push_back(slot);
+   }
+}
+
+void SceneGraph::removeLandmark(unsigned long id)
+{
+   std::unordered_map<unsigned long, int>::iterator it = lookup.find(id);
+   if (it == lookup.end()) return;
+   // a dirty slot stays on the dirty list, update() skips dead ones
+   leaves[it->second].alive = false;
+   free_leaves.push_back(it->second);
+   lookup.erase(it);
+}
+
+void SceneGraph::update()
+{
+   std::vector<bool> changed(nodes.size(), false);
+   for (unsigned int i = 0; i < nodes.size(); i++)
+   {
+      Node &node = nodes[i];
+      changed[i] = node.dirty || (node.parent >= 0 && changed[node.parent]);
+      if (!changed[i]) continue;
+      node.world = node.parent < 0 ? node.local : nodes[node.parent].world*node.local;
+      node.dirty = false;
+   }
+
+   const glm::mat4 &root = nodes[SCENE_ROOT].world;
+   updates = 0;
+   if (changed[SCENE_ROOT])
+   {
+      dirty_leaves.resize(leaves.size());
+      for (unsigned int i = 0; i < leaves.size(); i++)
+         dirty_leaves[i] = i;
+   }
+   for (unsigned int i = 0; i < dirty_leaves.size(); i++)
+   {
+      Leaf &leaf = leaves[dirty_leaves[i]];
+      leaf.dirty = false;
+      if (!leaf.alive) continue;
+      leaf.world = glm::vec3(root*glm::vec4(leaf.point, 1));
+      updates++;
+   }
+   dirty_leaves.clear();
+}
+
+void SceneGraph::collect(const std::vector<ViewCam> &views, float lwr_bound, bool inactive,
+                         JobSystem *jobs, std::vector<DrawItem> &list,
+                         const std::vector<unsigned long> *ids) const
+{
+   list.clear();
+   auto add = [&](const Leaf &leaf)
+   {
+      if (!leaf.alive || leaf.quality < lwr_bound || (!leaf.active && !inactive)) return;
+      DrawItem item;
+      item.id = leaf.id;
+      item.point = leaf.point;
+      item.world = leaf.world;
+      item.quality = leaf.quality;
+      item.active = leaf.active;
+      item.views = 0;
+      list.push_back(item);
+   };
+   if (ids)
+   {
+      // ids not in the graph are paged out or dropped
+      for (unsigned int i = 0; i < ids->size(); i++)
+      {
+         std::unordered_map<unsigned long, int>::const_iterator it = lookup.find((*ids)[i]);
+         if (it != lookup.end()) add(leaves[it->second]);
+      }
+   }
+   else
+   {
+      for (unsigned int i = 0; i < leaves.size(); i++)
+         add(leaves[i]);
+   }
+   // frustum tests run in parallel chunks, then the list is compacted
+   glm::vec3 eye = views.empty() ? glm::vec3(0) : views[0].eye;
+   jobs->parallelFor(list.size(), 512, [&](int begin, int end)
+   {
+      for (int i = begin; i < end; i++)
+      {
+         DrawItem &item = list[i];
+         // bound covers the star mesh and the reach of its light
+         float r = std::max(STAR_RADIUS*item.quality, 1.0 + 3.0*item.quality);
+         for (unsigned int v = 0; v < views.size(); v++)
+            if (sphereInView(views[v], item.world, r))
+               item.views |= 1u << v;
+         glm::vec3 d = item.world - eye;
+         item.key = glm::dot(d, d);
+      }
+   });
+   list.erase(std::remove_if(list.begin(), list.end(),
+                             [](const DrawItem &item) {return item.views == 0;}),
+              list.end());
+   // front to back, so early depth tests reject hidden stars
+   std::sort(list.begin(), list.end(),
+             [](const DrawItem &a, const DrawItem &b) {return a.key < b.key;});
+}
+
+size_t SceneGraph::bytes() const
+{
+   return nodes.capacity()*sizeof(Node) + leaves.capacity()*sizeof(Leaf) +
+          (free_leaves.capacity() + dirty_leaves.capacity())*sizeof(int) +
+          MemoryBudget::hashMapBytes(lookup);
+}
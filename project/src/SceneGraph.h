@@ -0,0 +1,70 @@
+//
+// transform hierarchy of the airplane and landmarks, world matrices and
+// bounds are cached per node and only recomputed when a pose or landmark
+// changes, culling against a set of views gives the shared draw list
+//
+
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#define GLM_ENABLE_EXPERIMENTAL
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+#include <stddef.h>
+#include "MultiView.h"
+#include "JobSystem.h"
+
+#define SCENE_ROOT 0 // Rx(-90), landmark to world coordinates
+#define SCENE_POSE 1 // current pose T_WS under the root
+
+class SceneGraph
+{
+public:
+	SceneGraph();
+	int addNode(int parent, const glm::mat4 &local=glm::mat4(1));
+	void setLocal(int node, const glm::mat4 &local);
+	const glm::mat4 &world(int node) const {return nodes[node].world;}
+	// landmarks are leaves under SCENE_ROOT, unchanged values are ignored
+	void setLandmark(unsigned long id, const glm::vec3 &point, float quality, bool active);
+	void removeLandmark(unsigned long id);
+	void update(); // recompute every world matrix and bound that is stale
+	// landmarks at or above lwr_bound visible in any of views, nearest
+	// to the eye of views[0] first; only those in ids if it is given
+	void collect(const std::vector<ViewCam> &views, float lwr_bound, bool inactive,
+	             JobSystem *jobs, std::vector<DrawItem> &list,
+	             const std::vector<unsigned long> *ids=NULL) const;
+	unsigned int size() const {return lookup.size();}
+	long recomputed() const {return updates;} // leaf bounds in the last update
+	size_t bytes() const;
+
+private:
+	typedef struct Node
+	{
+		int parent;     // -1 for the root
+		bool dirty;     // local changed since the last update
+		glm::mat4 local;
+		glm::mat4 world;
+	} Node;
+
+	typedef struct Leaf
+	{
+		unsigned long id;
+		glm::vec3 point;  // landmark coordinates
+		glm::vec3 world;  // cached center under SCENE_ROOT
+		float quality;
+		bool active;
+		bool alive;
+		bool dirty;
+	} Leaf;
+
+	std::vector<Node> nodes;   // parents always come before their children
+	std::vector<Leaf> leaves;
+	std::vector<int> free_leaves;
+	std::vector<int> dirty_leaves;
+	std::unordered_map<unsigned long, int> lookup;
+	long updates;
+};
+
+#endif
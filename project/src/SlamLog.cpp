@@ -0,0 +1,203 @@
+//
+//  SLAM log records
+//  one text line per pose and per landmark sighting; the parsers are
+//  free functions over a line so the benchmarks time exactly the code
+//  the replay runs
+//
+#include "SlamLog.h"
+#include <sstream>
+#include <math.h>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+#include <glm/gtx/norm.hpp>
+
+void parsePose(const std::string &line, double scale, Pose &pose)
+{
+   std::istringstream ss(line);
+   std::string token;
+   std::getline(ss, token, ' ');
+   pose.timestamp = std::stod(token);
+   glm::vec3 translation;
+   for (int i = 0; i < 3; i++)
+   {
+      std::getline(ss, token, ' ');
+      translation[i] = scale*std::stof(token);
+   }
+
+   std::vector<float> quat_vals;
+   for (int i = 0; i < 4; i++)
+   {
+      std::getline(ss, token, ' ');
+      quat_vals.push_back(std::stof(token));
+   }
+   glm::quat rotation(quat_vals[3],quat_vals[0],quat_vals[1],quat_vals[2]);
+   glm::mat4 rotation_mat = glm::toMat4(rotation);
+   glm::mat4 T_mat = glm::translate(glm::mat4(1), translation);
+
+   pose.T_WS = T_mat * rotation_mat;
+}
+
+void parseLandmark(const std::string &line, unsigned int stamp, double scale,
+                   unsigned long &id, Landmark &lmrk)
+{
+   std::istringstream ss(line);
+   std::string token;
+   std::getline(ss, token, ' ');
+   id = std::stol(token);
+   lmrk.timestamp = stamp;
+   lmrk.slot = 0;
+   std::getline(ss, token, ' ');
+   lmrk.quality = std::stod(token);
+   for (int i = 0; i < 3; i++)
+   {
+      std::getline(ss, token, ' ');
+      lmrk.point[i] = scale*std::stof(token);
+   }
+}
+
+void marginalize(std::map<unsigned long, Landmark> &active, PackedLandmarks &inactive,
+                 unsigned int stamp, FrameTable &frames, std::vector<unsigned long> &ids)
+{
+   size_t first = ids.size();
+   for (std::map<unsigned long, Landmark>::iterator it = active.begin();
+      it != active.end(); it++)
+   {
+      if (it->second.timestamp < stamp)
+         ids.push_back(it->first);
+   }
+   for (size_t i = first; i < ids.size(); i++)
+   {
+      Landmark marginalized = active.at(ids[i]);
+      active.erase(ids[i]);
+      inactive.insert(std::pair<unsigned long, PackedLandmark>(ids[i],packLandmark(marginalized, frames)));
+   }
+}
+
+bool readLandmarkFrame(std::istream &log, double scale,
+                       std::map<unsigned long, Landmark> &active, PackedLandmarks &inactive,
+                       FrameTable &frames, TimeIndex &times,
+                       std::vector<unsigned long> &sighted, std::vector<unsigned long> &marginalized)
+{
+   std::string line;
+   if (!std::getline(log, line)) return false;
+   // insert new landmarks
+   unsigned int stamp = std::stod(line);
+   uint32_t frame = frames.index(stamp);
+   std::getline(log, line);
+   while (line != "")
+   {
+      unsigned long id;
+      Landmark lmrk;
+      parseLandmark(line, stamp, scale, id, lmrk);
+      // update timestamp if landmark already exists, one seen again
+      // after it was marginalized, even with its tile on disk, keeps
+      // its first-seen frame
+      std::map<unsigned long, Landmark>::iterator it = active.find(id);
+      if (it != active.end())
+      {
+         lmrk.slot = it->second.slot;
+         times.seen(lmrk.slot, frame);
+         it->second = lmrk;
+      }
+      else
+      {
+         if (times.find(id, lmrk.slot))
+            times.seen(lmrk.slot, frame);
+         else
+            lmrk.slot = times.add(id, frame);
+         active.insert(std::pair<unsigned long, Landmark>(id, lmrk));
+      }
+      sighted.push_back(id);
+      std::getline(log, line);
+   }
+   // remove old landmarks
+   marginalize(active, inactive, stamp, frames, marginalized);
+   return true;
+}
+
+//
+//  Stamps only grow, older ones are found by binary search
+//
+uint32_t FrameTable::index(double stamp)
+{
+   if (stamps.empty() || stamp > stamps.back())
+   {
+      stamps.push_back(stamp);
+      return stamps.size()-1;
+   }
+   return std::lower_bound(stamps.begin(), stamps.end(), stamp) - stamps.begin();
+}
+
+bool FrameTable::range(double t0, double t1, uint32_t &f0, uint32_t &f1) const
+{
+   f0 = std::lower_bound(stamps.begin(), stamps.end(), t0) - stamps.begin();
+   size_t end = std::upper_bound(stamps.begin(), stamps.end(), t1) - stamps.begin();
+   if (end <= f0) return false;
+   f1 = end - 1;
+   return true;
+}
+
+//
+//  Positions are floor(x/QUANT_TILE) cubes plus an offset rounded to the
+//  nearest of QUANT_STEPS steps, so the error is under a 4000th of a unit
+//
+PackedLandmark packLandmark(const Landmark &lmrk, FrameTable &frames)
+{
+   PackedLandmark p;
+   for (int i = 0; i < 3; i++)
+   {
+      double t = floor(lmrk.point[i]/QUANT_TILE);
+      long q = lround((lmrk.point[i]/QUANT_TILE - t)*QUANT_STEPS);
+      // rounding up to the next cube's corner
+      if (q >= QUANT_STEPS)
+      {
+         t++;
+         q = 0;
+      }
+      p.tile[i] = t;
+      p.pos[i] = q;
+   }
+   uint32_t frame = std::min(frames.index(lmrk.timestamp), QUANT_FRAMES-1);
+   long quality = lround(std::max(std::min(lmrk.quality, 1.0), 0.0)*255);
+   p.frame_quality = frame << 8 | quality;
+   p.slot = lmrk.slot;
+   return p;
+}
+
+glm::vec3 packedPoint(const PackedLandmark &p)
+{
+   return glm::vec3((p.tile[0] + p.pos[0]/QUANT_STEPS)*QUANT_TILE,
+                    (p.tile[1] + p.pos[1]/QUANT_STEPS)*QUANT_TILE,
+                    (p.tile[2] + p.pos[2]/QUANT_STEPS)*QUANT_TILE);
+}
+
+float packedQuality(const PackedLandmark &p)
+{
+   return (p.frame_quality & 0xff)/255.0f;
+}
+
+Landmark unpackLandmark(const PackedLandmark &p, const FrameTable &frames)
+{
+   Landmark lmrk;
+   lmrk.point = packedPoint(p);
+   lmrk.quality = packedQuality(p);
+   lmrk.timestamp = frames.stamp(p.frame_quality >> 8);
+   lmrk.slot = p.slot;
+   return lmrk;
+}
+
+double poseDistance(const Pose &a, const Pose &b)
+{
+   // get translation component from both poses
+   glm::vec3 scale;
+   glm::quat rotation;
+   glm::vec3 a_trans;
+   glm::vec3 b_trans;
+   glm::vec3 skew;
+   glm::vec4 perspective;
+   glm::decompose(a.T_WS, scale, rotation, a_trans, skew, perspective);
+   glm::decompose(b.T_WS, scale, rotation, b_trans, skew, perspective);
+   return sqrt(glm::length2(a_trans - b_trans));
+}
@@ -0,0 +1,93 @@
+//
+// pose and landmark log records, parsed without any GL or Qt so the
+// visualizer and the benchmarks share one copy
+//
+
+#ifndef SLAMLOG_H
+#define SLAMLOG_H
+
+#define GLM_ENABLE_EXPERIMENTAL
+
+#include <glm/glm.hpp>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <istream>
+#include <algorithm>
+#include <stdint.h>
+#include <stddef.h>
+#include "TimeIndex.h"
+
+#define POSE_SPACING 0.5 // trajectory poses closer than this to the last are dropped
+
+#define QUANT_TILE   32.0    // edge of the cubes packed positions are relative to
+#define QUANT_STEPS  65536.0 // fixed point steps along a cube edge
+#define QUANT_FRAMES (1u << 24) // frame indices a packed landmark can hold
+
+typedef struct Pose
+{
+	glm::mat4 T_WS;
+	double timestamp;
+} Pose;
+
+typedef struct Landmark
+{
+	glm::vec3 point;
+	double timestamp;  // last seen
+	double quality;
+	uint32_t slot;     // TimeIndex entry, with the first and last frames seen
+} Landmark;
+
+// an inactive landmark in 20 bytes: a 16-bit fixed point offset within
+// its QUANT_TILE cube, quality in 8 bits, the index of the log frame it
+// was last seen in and its TimeIndex slot
+typedef struct PackedLandmark
+{
+	int16_t tile[3];
+	uint16_t pos[3];
+	uint32_t frame_quality; // frame << 8 | quality in 1/255 steps
+	uint32_t slot;
+} PackedLandmark;
+
+typedef std::unordered_map<unsigned long, PackedLandmark> PackedLandmarks;
+
+// log frame stamps in arrival order, the table packed landmarks index
+class FrameTable
+{
+public:
+	uint32_t index(double stamp); // appends stamps past the last one
+	double stamp(uint32_t index) const {return stamps.empty() ? 0 : stamps[std::min<size_t>(index, stamps.size()-1)];}
+	// first and last frames stamped t0 to t1, false if there are none
+	bool range(double t0, double t1, uint32_t &f0, uint32_t &f1) const;
+	size_t bytes() const {return stamps.capacity()*sizeof(double);}
+
+private:
+	std::vector<double> stamps;
+};
+
+// "stamp x y z qx qy qz qw", positions multiplied by scale
+void parsePose(const std::string &line, double scale, Pose &pose);
+// "id quality x y z" of a landmark seen in the frame at stamp
+void parseLandmark(const std::string &line, unsigned int stamp, double scale,
+				   unsigned long &id, Landmark &lmrk);
+// moves landmarks not seen since before stamp from active to inactive,
+// packed, appending their ids
+void marginalize(std::map<unsigned long, Landmark> &active, PackedLandmarks &inactive,
+				 unsigned int stamp, FrameTable &frames, std::vector<unsigned long> &ids);
+// reads the next frame of a landmark log, a stamp line then landmark
+// lines up to a blank one, into the active map and time index and
+// marginalizes the landmarks it did not see; sighted and marginalized
+// get the ids in the order they were applied, false at the end of the log
+bool readLandmarkFrame(std::istream &log, double scale,
+					   std::map<unsigned long, Landmark> &active, PackedLandmarks &inactive,
+					   FrameTable &frames, TimeIndex &times,
+					   std::vector<unsigned long> &sighted, std::vector<unsigned long> &marginalized);
+PackedLandmark packLandmark(const Landmark &lmrk, FrameTable &frames);
+Landmark unpackLandmark(const PackedLandmark &p, const FrameTable &frames);
+glm::vec3 packedPoint(const PackedLandmark &p);
+float packedQuality(const PackedLandmark &p);
+// length of the translation between two poses
+double poseDistance(const Pose &a, const Pose &b);
+
+#endif
@@ -1,7 +1,8 @@
 //
 //  OpenGL Lorenz Widget
 //
-#include <QtOpenGL>
+#include <QtWidgets>
+#include <algorithm>
 #include "SlamViz.h"
 #include "CSCIx229.h"
 
@@ -9,7 +10,7 @@
 //  Constructor
 //
 SlamViz::SlamViz(QWidget* parent)
-    : QGLWidget(parent)
+    : QOpenGLWidget(parent)
 {
    th = ph = 30;      //  Set intial display angles
    asp = 1;           //  Aspect ratio
@@ -29,19 +30,223 @@ SlamViz::SlamViz(QWidget* parent)
    last_time = 0.0;
    last_stamp = 0.0;
    scale_factor = 2.0;
-   framebuf = 0;
+   framebuf = static_framebuf = 0;
+   shadowtex = static_shadowtex = 0;
+   shadow_max = 0;
+   uploader = NULL;
+   loader = NULL;
+   render = NULL;
+   render_ready = false;
+   replay_done = false;
+   export_waiting = false;
+   frame_w = frame_h = 0;
+   textures = picks = 0;
+   serial = -1;
+   target_fbo = 0;
+   static_shadow_dirty = true;
+   lmrk_lights = false;
+   multi_view = false;
+   show_profiler = false;
+   profiler = new FrameProfiler();
+   // -trace <file> keeps a rolling CSV (or .json) trace of pass times
+   QStringList args = QCoreApplication::arguments();
+   int trace_arg = args.indexOf("-trace");
+   if (trace_arg >= 0 && trace_arg+1 < args.size())
+      profiler->setTrace(args[trace_arg+1], 600);
+   // -mem-soft/-mem-hard <MB> bound the landmark store and trajectory,
+   // -memlog <file> writes the memory counters as CSV
+   memory = new MemoryBudget();
+   // -target-fps <fps> is held by lowering quality, 0 keeps full quality
+   governor = new QualityGovernor();
+   render_scale = 1;
+   glyphs = gui_glyphs = NULL;
+   label_lmrks = args.contains("-labels");
+   int fps_arg = args.indexOf("-target-fps");
+   if (fps_arg >= 0 && fps_arg+1 < args.size())
+      governor->setTarget(args[fps_arg+1].toDouble());
+   state = new GLState();
+   double mem_soft = 0, mem_hard = 0;
+   int mem_arg = args.indexOf("-mem-soft");
+   if (mem_arg >= 0 && mem_arg+1 < args.size())
+      mem_soft = args[mem_arg+1].toDouble();
+   mem_arg = args.indexOf("-mem-hard");
+   if (mem_arg >= 0 && mem_arg+1 < args.size())
+      mem_hard = args[mem_arg+1].toDouble();
+   memory->setLimits((size_t)(mem_soft*1048576), (size_t)(mem_hard*1048576));
+   mem_arg = args.indexOf("-memlog");
+   if (mem_arg >= 0 && mem_arg+1 < args.size() && !memory->setLog(args[mem_arg+1]))
+      fprintf(stderr, "cannot write memory log %s\n", args[mem_arg+1].toLocal8Bit().constData());
+   spill_path = "lmrk_spill.txt";
+   mem_arg = args.indexOf("-spill");
+   if (mem_arg >= 0 && mem_arg+1 < args.size())
+      spill_path = args[mem_arg+1];
+   spill_file = NULL;
+   // -tiles <file> pages inactive landmarks out to a tiled store,
+   // keeping at most -tile-budget of them in memory
+   tiles = NULL;
+   tile_budget = TILE_BUDGET;
+   tile_frame = 0;
+   tile_eye = glm::vec3(0);
+   mem_arg = args.indexOf("-tiles");
+   if (mem_arg >= 0 && mem_arg+1 < args.size())
+   {
+      tiles = new TileStore();
+      if (!tiles->open(args[mem_arg+1].toLocal8Bit().constData()))
+      {
+         fprintf(stderr, "cannot write landmark tiles to %s\n", args[mem_arg+1].toLocal8Bit().constData());
+         delete tiles;
+         tiles = NULL;
+      }
+   }
+   mem_arg = args.indexOf("-tile-budget");
+   if (mem_arg >= 0 && mem_arg+1 < args.size())
+      tile_budget = args[mem_arg+1].toLong();
+   inst_bytes[0] = inst_bytes[1] = 0;
+   cluster_bytes[0] = cluster_bytes[1] = cluster_bytes[2] = 0;
+   frame_bytes = 0;
+   // -export <dir|file.y4m> [-size WxH] renders every replay tick offscreen
+   // and encodes it, -headless does so without a window, as fast as it can
+   exporter = NULL;
+   export_frame = false;
+   headless = args.contains("-headless");
+   int export_arg = args.indexOf("-export");
+   if (export_arg >= 0 && export_arg+1 < args.size())
+   {
+      int w = 1280, h = 720;
+      int size_arg = args.indexOf("-size");
+      if (size_arg >= 0 && size_arg+1 < args.size())
+      {
+         QStringList wh = args[size_arg+1].split('x');
+         if (wh.size() == 2 && wh[0].toInt() > 0 && wh[1].toInt() > 0)
+         {
+            w = wh[0].toInt();
+            h = wh[1].toInt();
+         }
+      }
+      exporter = new FrameExporter(args[export_arg+1], w, h);
+   }
+   // -record <file> logs mouse and control input against replay ticks,
+   // -play <file> feeds such a log back, -camera <file> follows a
+   // keyframed camera path
+   tick = 0;
+   input = new InputLog();
+   cam_path = new CameraPath();
+   int record_arg = args.indexOf("-record");
+   if (record_arg >= 0 && record_arg+1 < args.size() && !input->record(args[record_arg+1]))
+      fprintf(stderr, "cannot record input to %s\n", args[record_arg+1].toLocal8Bit().constData());
+   int play_arg = args.indexOf("-play");
+   if (play_arg >= 0 && play_arg+1 < args.size() && !input->play(args[play_arg+1]))
+      fprintf(stderr, "cannot play input from %s\n", args[play_arg+1].toLocal8Bit().constData());
+   int camera_arg = args.indexOf("-camera");
+   if (camera_arg >= 0 && camera_arg+1 < args.size() && !cam_path->load(args[camera_arg+1]))
+      fprintf(stderr, "cannot read camera path %s\n", args[camera_arg+1].toLocal8Bit().constData());
+   gl33 = NULL;
+   cluster_shader = NULL;
+   clusters = NULL;
+   lmrk_bvh = new LandmarkBVH();
+   graph = new SceneGraph();
+   // -no-occlusion draws landmarks hidden behind the nearest ones
+   hiz = new HiZBuffer();
+   occlusion = !args.contains("-no-occlusion");
+   hiz_fbo = hiz_tex = 0;
+   hiz_w = hiz_h = 0;
+   hiz_tested = hiz_hidden = 0;
+   // -core draws the airplane, landmarks and shadow casters through the
+   // OpenGL 3.3 core renderer, the fixed-function path stays the default
+   want_core = args.contains("-core");
+   renderer = NULL;
+   star_mesh = star_depth_mesh = point_mesh = NULL;
+   core_pass = false;
+   // -no-bg-cache redraws the sky or grid and inactive landmarks every
+   // frame instead of keeping them in a layer while the camera is still
+   bg_cache = !args.contains("-no-bg-cache");
+   bg_active = false;
+   bg_dirty = true;
+   bg_sky = false;
+   bg_fbo = NULL;
+   layer = LAYER_ALL;
+   plane_node = graph->addNode(SCENE_POSE);
+   shadow_bit = 0;
+   //  Light position
+   Lpos[0] = 2;
+   Lpos[1] = 2;
+   Lpos[2] = 0;
+   Lpos[3] = 1;
+   // exports always render at full quality so runs stay reproducible
+   if (exporter) governor->setTarget(0);
+   jobs = new JobSystem();
+   inst_buf[0] = inst_buf[1] = 0;
+   shadow_buf = 0;
+   shadow_bytes = 0;
+   // -shadow-min <texels> skips landmarks whose shadow would be smaller,
+   // 0 keeps every caster in the light frustum
+   shadow_min_texels = SHADOW_MIN_TEXELS;
+   int shadow_arg = args.indexOf("-shadow-min");
+   if (shadow_arg >= 0 && shadow_arg+1 < args.size())
+      shadow_min_texels = args[shadow_arg+1].toDouble();
+   picked = false;
+   picked_id = 0;
    light = pose_track = disp_inactive_lmrks = disp_prev_poses = disp_sky = axes = false; 
    lmrk_lwr_bound = 0.03;
+   time_window = false;
+   time_from = 0;
+   time_to = TIME_WINDOW_END;
    mode = true;
+   // the GUI thread's copy of the view, see publish()
+   gui.th = th;
+   gui.ph = ph;
+   gui.dim = dim;
+   gui.center = glm::vec3(0);
+   gui.mode = mode;
+   gui.axes = axes;
+   gui.disp_sky = disp_sky;
+   gui.disp_inactive_lmrks = disp_inactive_lmrks;
+   gui.pose_track = pose_track;
+   gui.disp_prev_poses = disp_prev_poses;
+   gui.lmrk_lights = lmrk_lights;
+   gui.multi_view = multi_view;
+   gui.show_profiler = show_profiler;
+   gui.lmrk_lwr_bound = lmrk_lwr_bound;
+   gui.time_window = time_window;
+   gui.time_from = time_from;
+   gui.time_to = time_to;
+   gui.width = gui.height = 0;
+   gui.textures = gui.picks = 0;
+   gui.tick = 0;
+   gui.serial = 0;
+   gui.export_frame = false;
    timer = new QTimer(this);
    connect(timer, SIGNAL(timeout()), this, SLOT(timerEvent()));
-   timer->start(16);
+   timer->start(exporter && headless ? 0 : 16);
    pose_file = new std::ifstream();
    pose_file->open("pose_log.txt");
    lmrk_file = new std::ifstream();
    lmrk_file->open("lmrk_log.txt");
 }
 
+SlamViz::~SlamViz()
+{
+   // stop drawing, then the upload thread, before the widget context goes away
+   delete render;
+   makeCurrent();
+   delete gui_glyphs;
+   delete uploader;
+   doneCurrent();
+   delete exporter;   // only left over if the render thread never ran
+   delete profiler;
+   delete memory;
+   delete governor;
+   delete state;
+   delete spill_file;
+   delete tiles;
+   delete lmrk_bvh;
+   delete graph;
+   delete hiz;
+   delete input;
+   delete cam_path;
+   delete jobs;
+}
+
 /********************************************************************/
 /*************************  Set parameters  *************************/
 /********************************************************************/
@@ -51,8 +256,9 @@ SlamViz::SlamViz(QWidget* parent)
 //
 void SlamViz::toggleAxes(void)
 {
-   axes = !axes;
-   update();
+   recordInput("toggleAxes");
+   gui.axes = !gui.axes;
+   publish();
 }
 
 //
@@ -60,32 +266,79 @@ void SlamViz::toggleAxes(void)
 //
 void SlamViz::toggleSky(void)
 {
-   disp_sky = !disp_sky;
-   update();
+   recordInput("toggleSky");
+   gui.disp_sky = !gui.disp_sky;
+   publish();
 }
 
 void SlamViz::setLmrkDispBound(double bound)
 {
-   lmrk_lwr_bound = bound;
-   update();
+   recordInput("setLmrkDispBound", QStringList(QString::number(bound,'g',17)));
+   gui.lmrk_lwr_bound = bound;
+   publish();
 }
 
 void SlamViz::toggleInactive(void)
 {
-   disp_inactive_lmrks = !disp_inactive_lmrks;
-   update();
+   recordInput("toggleInactive");
+   gui.disp_inactive_lmrks = !gui.disp_inactive_lmrks;
+   publish();
+}
+
+void SlamViz::toggleTimeWindow(void)
+{
+   recordInput("toggleTimeWindow");
+   gui.time_window = !gui.time_window;
+   publish();
+}
+
+void SlamViz::setTimeFrom(double stamp)
+{
+   recordInput("setTimeFrom", QStringList(QString::number(stamp,'g',17)));
+   gui.time_from = stamp;
+   publish();
+}
+
+void SlamViz::setTimeTo(double stamp)
+{
+   recordInput("setTimeTo", QStringList(QString::number(stamp,'g',17)));
+   gui.time_to = stamp;
+   publish();
 }
 
 void SlamViz::togglePoseTrack(void)
 {
-   pose_track = !pose_track;
-   update();
+   recordInput("togglePoseTrack");
+   gui.pose_track = !gui.pose_track;
+   publish();
 }
 
 void SlamViz::togglePrevPoses(void)
 {
-   disp_prev_poses = !disp_prev_poses;
-   update();
+   recordInput("togglePrevPoses");
+   gui.disp_prev_poses = !gui.disp_prev_poses;
+   publish();
+}
+
+void SlamViz::toggleLmrkLights(void)
+{
+   recordInput("toggleLmrkLights");
+   gui.lmrk_lights = !gui.lmrk_lights;
+   publish();
+}
+
+void SlamViz::toggleMultiView(void)
+{
+   recordInput("toggleMultiView");
+   gui.multi_view = !gui.multi_view;
+   publish();
+}
+
+void SlamViz::toggleProfiler(void)
+{
+   recordInput("toggleProfiler");
+   gui.show_profiler = !gui.show_profiler;
+   publish();
 }
 
 //
@@ -93,18 +346,16 @@ void SlamViz::togglePrevPoses(void)
 //
 void SlamViz::toggleDisplay(void)
 {
-   mode = !mode;
-   if (mode)
-      project(60,asp/2,dim);
-   else
-      project(60,asp,dim);
-   update();
+   recordInput("toggleDisplay");
+   gui.mode = !gui.mode;
+   publish();
 }
 
 void SlamViz::switchTexture(void)
 {
-   plane->changeTexture();
-   update();
+   recordInput("switchTexture");
+   gui.textures++;
+   publish();
 }
 
 //
@@ -112,9 +363,9 @@ void SlamViz::switchTexture(void)
 //
 void SlamViz::reset(void)
 {
-   th = ph = 0;  //  Set parameter
-   shadowMap();
-   update();     //  Request redisplay
+   recordInput("reset");
+   gui.th = gui.ph = 0;  //  Set parameter
+   publish();            //  Request redisplay
 }
 
 //
@@ -122,14 +373,10 @@ void SlamViz::reset(void)
 //
 void SlamViz::setDIM(double DIM)
 {
-   dim = DIM;    //  Set parameter
+   recordInput("setDIM", QStringList(QString::number(DIM,'g',17)));
+   gui.dim = DIM;    //  Set parameter
    //emit dimen(QString::number(dim));
-   shadowMap();
-   if (mode)
-      project(60,asp/2,dim);
-   else
-      project(60,asp/2,dim);
-   update();     //  Request redisplay
+   publish();        //  Request redisplay
 }
 
 /******************************************************************/
@@ -140,10 +387,18 @@ void SlamViz::setDIM(double DIM)
 //
 void SlamViz::mousePressEvent(QMouseEvent* e)
 {
+   recordInput("press", QStringList() << QString::number(e->x()) << QString::number(e->y())
+                                      << QString::number(e->button()));
    if (e->button() == Qt::RightButton)
       r_mouse = true;
    if (e->button() == Qt::LeftButton)
+   {
+      // the render thread picks against the views it last drew
       l_mouse = true;
+      gui.picks++;
+      gui.pick_pos = e->pos();
+      publish();
+   }
    pos = e->pos();  //  Remember mouse location
 }
 
@@ -152,6 +407,8 @@ void SlamViz::mousePressEvent(QMouseEvent* e)
 //
 void SlamViz::mouseReleaseEvent(QMouseEvent* e)
 {
+   recordInput("release", QStringList() << QString::number(e->x()) << QString::number(e->y())
+                                        << QString::number(e->button()));
    if (e->button() == Qt::RightButton)
       r_mouse = false;
    else if (e->button() == Qt::LeftButton)
@@ -163,17 +420,20 @@ void SlamViz::mouseReleaseEvent(QMouseEvent* e)
 //
 void SlamViz::mouseMoveEvent(QMouseEvent* e)
 {
+   // without a button held a move only updates pos, which the
+   // next press overwrites, so those moves aren't recorded
+   if (r_mouse || l_mouse)
+      recordInput("move", QStringList() << QString::number(e->x()) << QString::number(e->y()));
    QPoint d = e->pos()-pos;  //  Change in mouse location
    // rotate field of view if right mouse
    if (r_mouse)
    {
-      th = (th+d.x())%360;      //  Translate x movement to azimuth
-      ph = (ph+d.y())%360;      //  Translate y movement to elevation
+      gui.th = (gui.th+d.x())%360;      //  Translate x movement to azimuth
+      gui.ph = (gui.ph+d.y())%360;      //  Translate y movement to elevation
+      publish();                        //  Request redisplay
    }
 
    pos = e->pos();           //  Remember new location
-   shadowMap();
-   update();                 //  Request redisplay
 }
 
 //
@@ -183,13 +443,91 @@ void SlamViz::wheelEvent(QWheelEvent* e)
 {
    //  Zoom out
    if (e->delta()<0)
-      setDIM(dim+1);
+      setDIM(gui.dim+1);
    //  Zoom in
-   else if (dim>1)
-      setDIM(dim-1);
+   else if (gui.dim>1)
+      setDIM(gui.dim-1);
    //  Signal to change dimension spinbox
 }
 
+/******************************************************************/
+/**********************  Recorded Input  **************************/
+/******************************************************************/
+//
+//  Log an input against the tick it will be applied before on
+//  playback, wheel zooms are logged by setDIM
+//
+void SlamViz::recordInput(const QString &name, const QStringList &args)
+{
+   if (input->recording())
+      input->add(gui.tick+1, name, args);
+}
+
+//
+//  Re-inject a logged input through the same handler or slot
+//
+void SlamViz::replayInput(const InputEvent &event)
+{
+   if (event.name == "press" || event.name == "release" || event.name == "move")
+   {
+      QPoint p(event.args.value(0).toInt(), event.args.value(1).toInt());
+      Qt::MouseButton button = (Qt::MouseButton)event.args.value(2).toInt();
+      if (event.name == "press")
+      {
+         QMouseEvent e(QEvent::MouseButtonPress, p, button, button, Qt::NoModifier);
+         mousePressEvent(&e);
+      }
+      else if (event.name == "release")
+      {
+         QMouseEvent e(QEvent::MouseButtonRelease, p, button, Qt::NoButton, Qt::NoModifier);
+         mouseReleaseEvent(&e);
+      }
+      else
+      {
+         QMouseEvent e(QEvent::MouseMove, p, Qt::NoButton, Qt::NoButton, Qt::NoModifier);
+         mouseMoveEvent(&e);
+      }
+   }
+   else if (event.args.isEmpty())
+   {
+      QMetaObject::invokeMethod(this, event.name.toLatin1().constData());
+   }
+   else
+   {
+      QMetaObject::invokeMethod(this, event.name.toLatin1().constData(),
+                                Q_ARG(double, event.args[0].toDouble()));
+   }
+}
+
+//
+//  Drive the orbit camera from the -camera path
+//
+void SlamViz::followCameraPath()
+{
+   CamKey key;
+   if (!cam_path->sample(16.0*gui.tick, &key)) return;
+   gui.th = (int)floor(key.th + 0.5) % 360;
+   gui.ph = (int)floor(key.ph + 0.5) % 360;
+   gui.dim = key.dim;
+   if (key.has_center)
+      gui.center = glm::vec3(key.center[0], key.center[1], key.center[2]);
+   // sent along with the tick
+   gui.serial++;
+}
+
+//
+//  Hand the GUI's view state to the render thread. While exporting
+//  only ticks are sent, so every change lands on a replay tick
+//
+void SlamViz::publish(bool changed)
+{
+   if (changed) gui.serial++;
+   if (!render || (exporter && !gui.export_frame)) return;
+   params.back() = gui;
+   params.publish();
+   render->wake();
+}
+
 /*******************************************************************/
 /*************************  OpenGL Events  *************************/
 /*******************************************************************/
@@ -198,40 +536,141 @@ void SlamViz::wheelEvent(QWheelEvent* e)
 //  Initialize
 //
 void SlamViz::initializeGL()
+{
+   setMouseTracking(true);  //  Ask for mouse events
+   // textures and meshes are decoded on the thread pool, uploaded on a
+   // shared context and published by the render thread once their
+   // fences signal, run with -compress to cache opaque textures as DXT1
+   uploader = new GLUploader(context(), this);
+   loader = new AssetLoader(uploader,
+      QCoreApplication::arguments().contains("-compress") &&
+      context()->hasExtension("GL_EXT_texture_compression_s3tc"));
+   // the scene is drawn on its own thread into framebuffers that
+   // paintGL only composites, so a slow frame never stalls the controls
+   render = new RenderThread(context(),
+                             [this]() {initRender();},
+                             [this]() {renderFrame();},
+                             [this]() {releaseRender();});
+   connect(uploader, &GLUploader::ready, [this]() {render->wake();});
+   gui_glyphs = new TextRenderer();
+   gui_glyphs->initGL(context()->functions());
+   publish(false);
+}
+
+//
+//  Render thread setup, with the render context current
+//
+void SlamViz::initRender()
 {
    initializeOpenGLFunctions();
-   initializeGLFunctions();
    glFuncs = QOpenGLContext::currentContext()->functions();
    glFuncs->glEnable(GL_DEPTH_TEST); //  Enable Z-buffer depth testing
    glFuncs->glEnable(GL_CULL_FACE);
    glFuncs->glDepthFunc(GL_LEQUAL);
    glFuncs->glPolygonOffset(4,0);
-   setMouseTracking(true);  //  Ask for mouse events
-   texture[0] = new QOpenGLTexture(QImage(QString("yellow_fabric.bmp")));
-   texture[1] = new QOpenGLTexture(QImage(QString("metal.bmp")));
-   texture[2] = new QOpenGLTexture(QImage(QString("bricks.bmp")));
-   sky = new QOpenGLTexture(QImage(QString("sky2.jpg")));
-   plane = new airplane(texture,3,glFuncs);
-   star = new Star();
-   smoke = new SmokeBB();
+   state->initGL(glFuncs);
+   glyphs = new TextRenderer();
+   glyphs->initGL(glFuncs);
+   texture[0] = texture[1] = texture[2] = sky = NULL;
+   loader->loadTexture(QString("yellow_fabric.bmp"), &texture[0]);
+   loader->loadTexture(QString("metal.bmp"), &texture[1]);
+   loader->loadTexture(QString("bricks.bmp"), &texture[2]);
+   loader->loadTexture(QString("sky2.jpg"), &sky);
+   plane = new airplane(texture,3,glFuncs,state);
+   star = new Star(loader,glFuncs,state);
+   smoke = new SmokeBB(loader,state);
    //initShaders();
    initMap();
+   initClusters();
+   star->initInstancing(gl33);
+   glGenBuffers(2, inst_buf);
+   glGenBuffers(1, &shadow_buf);
+   profiler->initGL(gl33);
+   if (want_core)
+   {
+      renderer = new CoreRenderer();
+      if (!renderer->initGL(gl33, state))
+      {
+         fprintf(stderr, "core renderer unavailable, drawing fixed-function\n");
+         delete renderer;
+         renderer = NULL;
+      }
+   }
+   if (exporter)
+   {
+      exporter->initGL(QOpenGLContext::currentContext()->extraFunctions());
+      if (!exporter->ok())
+         fprintf(stderr, "cannot export frames, check the -export path\n");
+   }
+   render_ready = true;
+}
+
+//
+//  Render thread teardown
+//
+void SlamViz::releaseRender()
+{
+   QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+   delete exporter;   // encodes the frames still being read back
+   exporter = NULL;
+   delete cluster_shader;
+   cluster_shader = NULL;
+   delete glyphs;
+   glyphs = NULL;
+   delete renderer;
+   renderer = NULL;
+   delete bg_fbo;
+   bg_fbo = NULL;
+   for (int i = 0; i < 3; i++)
+   {
+      FrameOut &out = frames.slot(i);
+      delete out.fbo;
+      if (out.drawn) f->glDeleteSync(out.drawn);
+      if (out.shown) f->glDeleteSync(out.shown);
+   }
 }
 
+//
+//  Replay clock, runs on the GUI thread and only publishes the tick,
+//  the render thread reads the logs as it catches up
+//
 void SlamViz::timerEvent(void)
 {
-   cur_time += 16;
-   zh = (zh + 1) % 360;
-   if (cur_time - last_time >= 64)
+   if (!render) return;
+   // exactly one exported frame per tick, the next tick waits for it
+   // without blocking the GUI thread
+   if (export_waiting)
    {
-      last_time = cur_time;
-      addToPrevPoses();
-      readPose();
-      readLmrks();
-      shadowMap();
-      updateGL();
+      if (!frame_done.tryAcquire(1, headless ? 5 : 0)) return;
+      export_waiting = false;
+      if (headless && replay_done)
+      {
+         fprintf(stderr, "exported %ld frames\n", exporter->frames());
+         timer->stop();
+         QCoreApplication::quit();
+         return;
+      }
+   }
+   // an export only starts once every asset is on the GPU,
+   // so the frames don't depend on how long loading took
+   if (exporter && (!render_ready || loader->busy() || uploader->pending()))
+      return;
+   gui.tick++;
+   InputEvent event;
+   while (input->next(gui.tick, &event))
+      replayInput(event);
+   followCameraPath();
+   if (exporter)
+   {
+      gui.export_frame = true;
+      publish(false);
+      gui.export_frame = false;
+      export_waiting = true;
+   }
+   else
+   {
+      publish(false);
    }
-   
 }
 
 //
@@ -239,57 +678,310 @@ void SlamViz::timerEvent(void)
 //
 void SlamViz::resizeGL(int width, int height)
 {
-   //  Window aspect ration
-   asp = (width && height) ? width / (float)height : 1;
-   //  Viewport is whole screen
-   glFuncs->glViewport(0,0,width,height);
-   //  Set projection
-   if (mode)
-      project(60,asp/2,dim);
-   else
-      project(60,asp,dim);
+   gui.width = width;
+   gui.height = height;
+   publish();
 }
 
 //
-//  Draw the window
+//  Composite the newest frame from the render thread
 //
 void SlamViz::paintGL()
 {
-   int id;
+   QOpenGLExtraFunctions *f = context()->extraFunctions();
+   f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   frames.update();
+   FrameOut &out = frames.front();
+   if (!out.fbo) return;  // nothing drawn yet
+
+   // the frame was drawn on the render context, wait for it on the GPU
+   f->glWaitSync(out.drawn, 0, GL_TIMEOUT_IGNORED);
+   f->glDisable(GL_DEPTH_TEST);
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+   f->glActiveTexture(GL_TEXTURE0);
+   f->glBindTexture(GL_TEXTURE_2D, out.fbo->texture());
+   // frames drawn at a reduced render scale are stretched to the window
+   f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   f->glEnable(GL_TEXTURE_2D);
+   glColor3f(1.0f,1.0f,1.0f);
+   glBegin(GL_QUADS);
+   glTexCoord2f(0,0);glVertex2f(-1,-1);
+   glTexCoord2f(1,0);glVertex2f(+1,-1);
+   glTexCoord2f(1,1);glVertex2f(+1,+1);
+   glTexCoord2f(0,1);glVertex2f(-1,+1);
+   glEnd();
+   f->glDisable(GL_TEXTURE_2D);
+   f->glBindTexture(GL_TEXTURE_2D, 0);
+   // the render thread may redraw into this framebuffer after this fence
+   if (out.shown) f->glDeleteSync(out.shown);
+   out.shown = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   f->glFlush();
+   gui_glyphs->draw(out.labels, width(), height());
+}
+
+//
+//  Render thread frame: adopt the newest view, run the ticks it asks
+//  for and draw if anything changed
+//
+void SlamViz::renderFrame()
+{
+   bool redraw = uploader->publish(QOpenGLContext::currentContext()->extraFunctions()) > 0;
+   // the cached layer may have been drawn before a texture arrived
+   if (redraw) bg_dirty = true;
+   bool to_export = false;
+   if (params.update())
+   {
+      const ViewParams &p = params.front();
+      if (adoptParams(p)) redraw = true;
+      to_export = p.export_frame;
+   }
+   if (redraw || to_export)
+      drawFrame(to_export);
+}
 
-   double Ex = (-2)*dim*Sind(th)*Cosd(ph);
-   double Ey = (2)*dim        *Sind(ph);
-   double Ez = (2)*dim*Cosd(th)*Cosd(ph);
-   //emit dimen(QString::number(Ex)+", "+QString::number(Ey)+", "+QString::number(Ez));
+//
+//  Copy a GUI snapshot into the render state, returns true if the
+//  frame has to be redrawn
+//
+bool SlamViz::adoptParams(const ViewParams &p)
+{
+   bool changed = p.serial != serial;
+   // the static shadow layer holds exactly the inactive landmarks drawn
+   if (p.disp_inactive_lmrks != disp_inactive_lmrks || p.lmrk_lwr_bound != lmrk_lwr_bound ||
+       p.time_window != time_window ||
+       (p.time_window && (p.time_from != time_from || p.time_to != time_to)))
+      static_shadow_dirty = true;
+   serial = p.serial;
+   th = p.th;
+   ph = p.ph;
+   dim = p.dim;
+   mode = p.mode;
+   axes = p.axes;
+   disp_sky = p.disp_sky;
+   disp_inactive_lmrks = p.disp_inactive_lmrks;
+   pose_track = p.pose_track;
+   disp_prev_poses = p.disp_prev_poses;
+   lmrk_lights = p.lmrk_lights;
+   multi_view = p.multi_view;
+   show_profiler = p.show_profiler;
+   lmrk_lwr_bound = p.lmrk_lwr_bound;
+   time_window = p.time_window;
+   time_from = p.time_from;
+   time_to = p.time_to;
+   frame_w = p.width;
+   frame_h = p.height;
+   asp = (frame_w && frame_h) ? frame_w / (double)frame_h : 1;
+   while (textures < p.textures)
+   {
+      plane->changeTexture();
+      textures++;
+   }
+   if (!pose_track && glm::vec3(v_x,v_y,v_z) != p.center)
+   {
+      v_x = p.center.x;
+      v_y = p.center.y;
+      v_z = p.center.z;
+   }
+   // clicks pick against the views the user clicked on
+   if (picks != p.picks)
+   {
+      picks = p.picks;
+      pick(p.pick_pos);
+   }
+   while (tick < p.tick)
+      if (advance()) changed = true;
+   return changed;
+}
+
+//
+//  One replay tick of 16 ms, the logs are read every fourth tick
+//
+bool SlamViz::advance()
+{
+   tick++;
+   cur_time += 16;
+   zh = (zh + 1) % 360;
+   if (cur_time - last_time < 64) return false;
+   last_time = cur_time;
+   {
+      ProfileScope scope(profiler, "ingest", false);
+      addToPrevPoses();
+      readPose();
+      readLmrks();
+      enforceBudget();
+   }
+   if (tick % MEM_LOG_TICKS == 0)
+      memory->log(tick);
+   if (!pose_file->good() && !lmrk_file->good())
+      replay_done = true;
+   return true;
+}
+
+//
+//  Draw a frame into the back framebuffer, or into the exporter's
+//  and then scaled into the back framebuffer
+//
+void SlamViz::drawFrame(bool to_export)
+{
+   QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
 
-   //  Clear screen and Z-buffer
-   glFuncs->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-   glFuncs->glDisable(GL_LIGHTING);
+   profiler->beginFrame();
+   ProfileScope frame_scope(profiler, "frame");
+   bool requality = !to_export && governor->update(profiler->ms("frame"));
+   render_scale = governor->quality().scale;
 
-   QSize size = this->size();
+   // the widget may still be sampling this framebuffer from the last
+   // time it was shown
+   FrameOut &out = frames.back();
+   if (out.shown)
+   {
+      f->glWaitSync(out.shown, 0, GL_TIMEOUT_IGNORED);
+      f->glDeleteSync(out.shown);
+      out.shown = 0;
+   }
+   if (out.drawn)
+   {
+      f->glDeleteSync(out.drawn);
+      out.drawn = 0;
+   }
+   QSize size(std::max((int)(render_scale*frame_w + 0.5),1), std::max((int)(render_scale*frame_h + 0.5),1));
+   if (!out.fbo || out.fbo->size() != size)
+   {
+      QOpenGLFramebufferObjectFormat format;
+      format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+      if (out.fbo) frame_bytes -= 8*out.fbo->width()*out.fbo->height();
+      delete out.fbo;
+      out.fbo = new QOpenGLFramebufferObject(size, format);
+      frame_bytes += 8*size.width()*size.height();
+   }
 
-   // set projection
-   if (mode)
+   // export frames are drawn offscreen at the export resolution
+   export_frame = to_export && exporter->handle();
+   target_fbo = out.fbo->handle();
+   if (export_frame)
    {
-      
-      //gluLookAt(Ex+x,Ey+y,Ez+z, x,y,z, 0,Cos(ph),0);
-      project(60,asp/2,dim);
-      glFuncs->glViewport(0,0,size.width()/2,size.height());
-      
+      target_fbo = exporter->handle();
+      size = exporter->size();
    }
-   //  Orthogonal - set world orientation
+   drawn_size = size;
+   glFuncs->glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+   // uploads and label drawing touch state between frames
+   state->beginFrame();
+   state->invalidate();
+   state->activeTexture(GL_TEXTURE0);
+   if (requality) applyQuality();
+
+   // cull landmarks once for every view and the light, then build
+   // the depth map and draw each view from the shared list
+   setupViews(size.width(), size.height());
+   pageTiles();
+   // landmark lights change how inactive landmarks are lit every frame
+   bg_active = bg_cache && !multi_view && !lmrk_lights;
+   // the static shadow layer goes stale with the same static set
+   if (!bg_active || requality || static_shadow_dirty) bg_dirty = true;
+   buildDrawList();
+   occlusionCull();
+   shadowMap();
+   labels.clear();
+
+   state->disable(GL_LIGHTING);
+   if (bg_active)
+      drawBackground(size);
    else
    {
-      
-      //glRotatef(ph,1,0,0);
-      //glRotatef(th,0,1,0);
-      project(60,asp,dim);
-      glFuncs->glViewport(0,0,size.width()/2,size.height());
-      
+      //  Clear screen and Z-buffer
+      glFuncs->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      for (unsigned int v = 0; v < views.size(); v++)
+         drawView(views[v], 1u << v);
+   }
+   
+   if (mode && !multi_view)
+   {
+      project(0,asp/2,1);
+      glViewport(size.width()/2+1,0,size.width()/2,size.height());
+      state->activeTexture(GL_TEXTURE1);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_COMPARE_MODE,GL_NONE);
+      state->enable(GL_TEXTURE_2D);
+      glColor3f(1.0f,1.0f,1.0f);
+      glBegin(GL_QUADS);
+      glMultiTexCoord2f(GL_TEXTURE1,0,0);glVertex2f(-1,-1);
+      glMultiTexCoord2f(GL_TEXTURE1,1,0);glVertex2f(+1,-1);
+      glMultiTexCoord2f(GL_TEXTURE1,1,1);glVertex2f(+1,+1);
+      glMultiTexCoord2f(GL_TEXTURE1,0,1);glVertex2f(-1,+1);
+      glEnd();
+      state->disable(GL_TEXTURE_2D);
+      state->activeTexture(GL_TEXTURE0);
+   }
+   // pass times differ from run to run, keep them out of exports,
+   // overlay lines are spaced in window pixels
+   if (show_profiler && !export_frame)
+   {
+      QStringList lines = profiler->hud() + QStringList("") + memory->hud() +
+                          QStringList("") + state->hud() + QStringList("") + governor->hud();
+      if (hiz->valid())
+         lines << QString("occlusion %1 of %2 hidden").arg(hiz_hidden).arg(hiz_tested);
+      if (tiles)
+         lines << QString("tiles %1  %2 landmarks resident  %3 on disk  %4 loads  %5 evictions")
+                  .arg(tiles->count()).arg(tiles->resident()).arg(tiles->stored())
+                  .arg(tiles->loads).arg(tiles->evictions);
+      for (int i = 0; i < lines.size(); i++)
+      {
+         Label label;
+         label.x = 10*render_scale;
+         label.y = size.height() - (20 + glyphs->glyph().height()*i)*render_scale;
+         label.text = lines[i];
+         label.priority = LABEL_HUD;
+         labels.push_back(label);
+      }
+   }
+   if (export_frame)
+   {
+      {
+         ProfileScope scope(profiler, "labels");
+         TextRenderer::declutter(labels, size.width(), size.height(), glyphs->glyph());
+         glFuncs->glViewport(0, 0, size.width(), size.height());
+         glyphs->draw(labels, size.width(), size.height());
+      }
+      state->invalidate();
+      exporter->capture();
+      // the window shows the exported frame, labels included
+      f->glBindFramebuffer(GL_READ_FRAMEBUFFER, target_fbo);
+      f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, out.fbo->handle());
+      f->glBlitFramebuffer(0,0,size.width(),size.height(), 0,0,out.fbo->width(),out.fbo->height(),
+                           GL_COLOR_BUFFER_BIT, GL_LINEAR);
+      labels.clear();
    }
-   gluLookAt(Ex,Ey,Ez, 0,0,0, 0,Cosd(ph),0);
-   // track pose if pose tracking enabled
-   glTranslated(-v_x,-v_y,-v_z);
+   glFuncs->glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   //  Done, labels go back to window coordinates and are thinned
+   //  out there, the widget only batches them
+   out.labels = labels;
+   for (unsigned int i = 0; i < out.labels.size(); i++)
+   {
+      out.labels[i].x /= render_scale;
+      out.labels[i].y /= render_scale;
+   }
+   TextRenderer::declutter(out.labels, frame_w, frame_h, glyphs->glyph());
+   out.drawn = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   glFlush();
+   frames.publish();
+   if (to_export) frame_done.release();
+   QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+}
+
+//
+//  Draw the scene for one camera, bit selects this view's landmarks
+//  in the shared draw list
+//
+void SlamViz::drawView(const ViewCam &cam, unsigned int bit)
+{
+   glFuncs->glViewport(cam.vp[0],cam.vp[1],cam.vp[2],cam.vp[3]);
+   glMatrixMode(GL_PROJECTION);
+   glLoadMatrixf(glm::value_ptr(cam.proj));
+   glMatrixMode(GL_MODELVIEW);
+   glLoadMatrixf(glm::value_ptr(cam.view));
 
    /*
 
@@ -335,7 +1027,15 @@ void SlamViz::paintGL()
    //if (!mode && pose_track)
    //   glTranslated(-x,-y,-z);
    */
-   ball(Lpos[0],Lpos[1],Lpos[2],0.25);
+   bool dynamic = layer != LAYER_STATIC, still = layer != LAYER_DYNAMIC;
+   if (dynamic)
+      ball(Lpos[0],Lpos[1],Lpos[2],0.25);
+   bool clustered = lmrk_lights && cluster_shader && cam.perspective;
+   if (clustered)
+   {
+      updateClusters(cam, bit);
+      bindClusters();
+   }
    /*
    shadow_shader->bind();
    id = shadow_shader->uniformLocation("tex");
@@ -351,27 +1051,39 @@ void SlamViz::paintGL()
    glFuncs->glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_COMPARE_MODE,GL_COMPARE_R_TO_TEXTURE);
    glFuncs->glActiveTexture(GL_TEXTURE0);
    */
-   Scene(true);
+   if (renderer && !clustered)
+      drawCore(cam, bit);
+   else
+      Scene(true, bit);
    //shadow_shader->release();
+   if (clustered)
+      state->useProgram(NULL);
+   if (dynamic)
+      drawPicked();
 
    //dispLandmarks();
 
-   if (axes)
+   if (axes && dynamic)
      drawAxes(2.0, true);
    
-   if (disp_sky)
+   if (still)
    {
-      Sky(3.0*dim);
-   }
-   else
-   {
-      displayGrid(5);
+      ProfileScope scope(profiler, "grid/sky");
+      if (disp_sky)
+      {
+         Sky(3.0*dim);
+      }
+      else
+      {
+         displayGrid(5);
+      }
    }
 
    
-   if (disp_prev_poses)
+   if (disp_prev_poses && dynamic)
    {
-      float num_poses = 15.0;
+      ProfileScope scope(profiler, "smoke");
+      float num_poses = governor->quality().smoke_puffs;
       for (int i = prev_poses.size()-1; i >= 0; i--)
       {
          glPushMatrix();
@@ -395,37 +1107,427 @@ void SlamViz::paintGL()
                float y = prev_poses[i].T_WS[3][2];
                glTranslatef(x,y,z);
 
-               smoke->DrawSmoke(Ex+v_x,Ey+v_y,Ez+v_z, 
-                                v_x,v_y,v_z, 
+               smoke->DrawSmoke(cam.eye.x,cam.eye.y,cam.eye.z, 
+                                cam.center.x,cam.center.y,cam.center.z, 
                                 0.05*max_age/age);
                num_poses--;
             }
          }
          glPopMatrix();
       }
+      smoke->release();
    }
-   
-   if (mode)
+   if (label_lmrks && dynamic)
+      labelScene(cam, bit);
+}
+
+//
+//  Single view, the sky or grid and the inactive landmarks are kept in
+//  a colour and depth layer that is only redrawn when the camera or the
+//  static set changes; each frame copies it into the target and draws
+//  the airplane, active landmarks and smoke over it
+//
+void SlamViz::drawBackground(QSize size)
+{
+   QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+   const ViewCam &cam = views[0];
+   // depth is blitted, so the layer matches the target's depth format
+   QOpenGLFramebufferObject::Attachment attach = export_frame ? QOpenGLFramebufferObject::Depth :
+                                                 QOpenGLFramebufferObject::CombinedDepthStencil;
+   if (!bg_fbo || bg_fbo->size() != size || bg_fbo->attachment() != attach)
+   {
+      QOpenGLFramebufferObjectFormat format;
+      format.setAttachment(attach);
+      format.setInternalTextureFormat(GL_RGBA8);
+      if (bg_fbo) frame_bytes -= 8*bg_fbo->width()*bg_fbo->height();
+      delete bg_fbo;
+      bg_fbo = new QOpenGLFramebufferObject(size, format);
+      frame_bytes += 8*size.width()*size.height();
+      bg_dirty = true;
+   }
+   glm::mat4 view_proj = cam.proj*cam.view;
+   if (view_proj != bg_view_proj || disp_sky != bg_sky) bg_dirty = true;
+
+   if (bg_dirty)
+   {
+      ProfileScope scope(profiler, "background");
+      glFuncs->glBindFramebuffer(GL_FRAMEBUFFER, bg_fbo->handle());
+      glFuncs->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      layer = LAYER_STATIC;
+      drawView(cam, 1u);
+      bg_view_proj = view_proj;
+      bg_sky = disp_sky;
+      bg_dirty = false;
+   }
+   f->glBindFramebuffer(GL_READ_FRAMEBUFFER, bg_fbo->handle());
+   f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_fbo);
+   f->glBlitFramebuffer(0,0,size.width(),size.height(), 0,0,size.width(),size.height(),
+                        GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+   glFuncs->glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+   layer = LAYER_DYNAMIC;
+   drawView(cam, 1u);
+   layer = LAYER_ALL;
+}
+
+//
+//  Orbit camera, plus top-down, chase and cockpit cameras in multi-view
+//
+void SlamViz::setupViews(int width, int height)
+{
+   double Ex = (-2)*dim*Sind(th)*Cosd(ph);
+   double Ey = (2)*dim        *Sind(ph);
+   double Ez = (2)*dim*Cosd(th)*Cosd(ph);
+   glm::vec3 center(v_x,v_y,v_z);
+   double aspect = (width && height) ? width / (double)height : 1;
+   ViewCam cam;
+
+   views.clear();
+   if (!multi_view)
+   {
+      cam.vp[0] = cam.vp[1] = 0;
+      cam.vp[2] = mode ? width/2 : width;
+      cam.vp[3] = height;
+      setPerspective(cam, 60, mode ? aspect/2 : aspect, dim/16, 16*dim);
+      setLookAt(cam, center+glm::vec3(Ex,Ey,Ez), center, glm::vec3(0,Cosd(ph),0));
+      views.push_back(cam);
+   }
+   else
+   {
+      // robot body frame in world coordinates, forward is body z, up is body x
+      const glm::mat4 &R = graph->world(SCENE_POSE);
+      glm::vec3 pos(R[3]);
+      glm::vec3 fwd = glm::normalize(glm::vec3(R*glm::vec4(0,0,1,0)));
+      glm::vec3 up = glm::normalize(glm::vec3(R*glm::vec4(1,0,0,0)));
+      int w = width/2, h = height/2;
+      for (int v = 0; v < 4; v++)
+      {
+         cam.vp[0] = (v%2)*w;
+         cam.vp[1] = (v<2) ? h : 0;
+         cam.vp[2] = w;
+         cam.vp[3] = h;
+         if (v == 0)       // orbit
+         {
+            setPerspective(cam, 60, aspect, dim/16, 16*dim);
+            setLookAt(cam, center+glm::vec3(Ex,Ey,Ez), center, glm::vec3(0,Cosd(ph),0));
+         }
+         else if (v == 1)  // top-down orthographic
+         {
+            setOrtho(cam, dim*aspect, dim, -16*dim, 16*dim);
+            setLookAt(cam, center+glm::vec3(0,8*dim,0), center, glm::vec3(0,0,-1));
+         }
+         else if (v == 2)  // chase
+         {
+            setPerspective(cam, 60, aspect, 0.1, 16*dim);
+            setLookAt(cam, pos - 3.0f*fwd + 1.0f*up, pos + fwd, up);
+         }
+         else              // cockpit
+         {
+            setPerspective(cam, 70, aspect, 0.05, 16*dim);
+            setLookAt(cam, pos + 0.3f*fwd + 0.2f*up, pos + 5.0f*fwd, up);
+         }
+         views.push_back(cam);
+      }
+   }
+   for (unsigned int v = 0; v < views.size(); v++)
+      setFrustum(views[v]);
+
+   // the light looks at the view center from Lpos, the static
+   // shadow layer is stale once it looks anywhere else
+   glm::mat4 last_light = shadow_cam.proj*shadow_cam.view;
+   double Dim = 2.0;
+   double Ldist = sqrt(Lpos[0]*Lpos[0] + Lpos[1]*Lpos[1] + Lpos[2]*Lpos[2]);
+   if(Ldist < 1.1*Dim) Ldist = 1.1*Dim;
+   setPerspective(shadow_cam, 114.6*atan(Dim/Ldist),1,Ldist-Dim,Ldist+Dim);
+   setLookAt(shadow_cam, glm::vec3(Lpos[0],Lpos[1],Lpos[2]), center, glm::vec3(0,1,0));
+   shadow_cam.vp[0] = shadow_cam.vp[1] = 0;
+   shadow_cam.vp[2] = shadow_cam.vp[3] = shadowdim;
+   setFrustum(shadow_cam);
+   if (shadow_cam.proj*shadow_cam.view != last_light) static_shadow_dirty = true;
+}
+
+//
+//  Single pass over the landmark sets, keeping each landmark that is
+//  visible in any view along with a mask of the views that see it
+//
+void SlamViz::buildDrawList()
+{
+   ProfileScope scope(profiler, "drawList", false);
+   graph->update();
+   // the light gets the bit after the last view, so the caster
+   // passes read the same list
+   std::vector<ViewCam> cams(views);
+   shadow_bit = 1u << cams.size();
+   cams.push_back(shadow_cam);
+   if (!time_window)
+   {
+      graph->collect(cams, lmrk_lwr_bound, disp_inactive_lmrks, jobs, draw_list);
+      return;
+   }
+   // only the landmarks the time index finds in the window are culled
+   window_ids.clear();
+   uint32_t f0, f1;
+   if (frame_table.range(time_from, time_to, f0, f1))
+      times.query(f0, f1, window_ids);
+   graph->collect(cams, lmrk_lwr_bound, disp_inactive_lmrks, jobs, draw_list, &window_ids);
+}
+
+//
+//  Occlusion culling for the first view: the airplane and the nearest
+//  landmarks are drawn depth-only into a small framebuffer and read
+//  back into a depth pyramid, landmark BVH nodes behind it are then
+//  dropped from the view's draw list entries. Skipped while landmarks
+//  are lights, since hidden ones still light what is visible
+//
+void SlamViz::occlusionCull()
+{
+   hiz->clear();
+   hiz_tested = hiz_hidden = 0;
+   if (!occlusion || lmrk_lights || views.empty() || !views[0].perspective) return;
+   // the cached layer must hold every inactive landmark, the airplane
+   // and active ones move off them without it being redrawn
+   for (unsigned int i = 0; i < draw_list.size(); i++)
+      if ((draw_list[i].views & 1u) && (!bg_active || draw_list[i].active)) hiz_tested++;
+   if (hiz_tested < HIZ_MIN_ITEMS) return;
+   ProfileScope scope(profiler, "occlusion");
+   const ViewCam &cam = views[0];
+
+   int w = HIZ_WIDTH, h = std::max((int)(HIZ_WIDTH*cam.vp[3]/(double)cam.vp[2] + 0.5), 1);
+   if (!hiz_fbo)
+   {
+      glFuncs->glGenTextures(1, &hiz_tex);
+      glFuncs->glGenFramebuffers(1, &hiz_fbo);
+   }
+   if (w != hiz_w || h != hiz_h)
+   {
+      hiz_w = w;
+      hiz_h = h;
+      state->bindTexture(GL_TEXTURE_2D, hiz_tex);
+      glFuncs->glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, w, h, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+      glFuncs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glFuncs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      state->bindTexture(GL_TEXTURE_2D, 0);
+      glFuncs->glBindFramebuffer(GL_FRAMEBUFFER, hiz_fbo);
+      glFuncs->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, hiz_tex, 0);
+      glDrawBuffer(GL_NONE);
+      glReadBuffer(GL_NONE);
+      if (glFuncs->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      {
+         fprintf(stderr, "occluder framebuffer incomplete, occlusion culling off\n");
+         occlusion = false;
+         glFuncs->glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+         return;
+      }
+   }
+
+   // the draw list is nearest first, its head are the occluders
+   float up[3] = {1, 0, 0};
+   float center[3] = {(float)v_x, (float)v_y, (float)v_z};
+   caster_mats.clear();
+   for (unsigned int i = 0; i < draw_list.size() && caster_mats.size() < 16*HIZ_OCCLUDERS; i++)
+   {
+      const DrawItem &item = draw_list[i];
+      if (!(item.views & 1u)) continue;
+      const float *pt = glm::value_ptr(item.point);
+      float d[3] = {pt[0]-center[0], pt[1]-center[1], pt[2]-center[2]};
+      caster_mats.resize(caster_mats.size() + 16);
+      Star::facing(pt, d, up, item.quality, &caster_mats[caster_mats.size()-16]);
+   }
+
+   glFuncs->glBindFramebuffer(GL_FRAMEBUFFER, hiz_fbo);
+   glFuncs->glViewport(0, 0, w, h);
+   glClear(GL_DEPTH_BUFFER_BIT);
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadMatrixf(glm::value_ptr(cam.proj));
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glLoadMatrixf(glm::value_ptr(cam.view));
+   Light(false);
+   drawDepthCasters(cam, true);
+   glPopMatrix();
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_MODELVIEW);
+
+   // a synchronous read of a small buffer, which software GL does too
+   hiz_depth.resize(w*h);
+   glFuncs->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+   glFuncs->glReadPixels(0, 0, w, h, GL_DEPTH_COMPONENT, GL_FLOAT, hiz_depth.data());
+   glFuncs->glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+   hiz->build(hiz_depth.data(), w, h, cam.proj*cam.view*graph->world(SCENE_ROOT));
+
+   // BVH boxes are in landmark coordinates, as the pyramid's matrix expects
+   std::vector<unsigned long> hidden;
+   lmrk_bvh->cull([this](const float *lo, const float *hi) {return hiz->occluded(lo, hi);}, hidden);
+   std::sort(hidden.begin(), hidden.end());
+   for (unsigned int i = 0; i < draw_list.size(); i++)
+   {
+      DrawItem &item = draw_list[i];
+      if ((item.views & 1u) && (!bg_active || item.active) &&
+          std::binary_search(hidden.begin(), hidden.end(), item.id))
+      {
+         item.views &= ~1u;
+         hiz_hidden++;
+      }
+   }
+}
+
+//
+//  Instanced landmark drawing for one view: a parallel pass picks a
+//  level of detail per star and counts per chunk, a prefix sum gives
+//  each chunk its write offsets, and a second parallel pass writes
+//  stars straight into mapped buffers. The star shader takes 8-byte
+//  StarInstances, 16-bit steps from the view center sized to the
+//  farthest star, and builds the facing matrix itself; the core
+//  renderer still reads matrices and float points
+//
+void SlamViz::drawInstanced(const ViewCam &cam, unsigned int bit)
+{
+   int n = draw_list.size();
+   int nchunks = std::min(n/512 + 1, 4*jobs->threads());
+   std::vector<int> meshes(nchunks+1, 0), points(nchunks+1, 0);
+   std::vector<float> extent(nchunks, 0);
+   float center[3] = {(float)v_x, (float)v_y, (float)v_z};
+   // projected radius in pixels is STAR_RADIUS*quality*pix/distance
+   float pix = 0.5f*cam.proj[1][1]*cam.vp[3];
+   float lod_pixels = governor->quality().lod_pixels;
+   lmrk_lod.resize(n);
+
+   jobs->parallelFor(nchunks, 1, [&](int c0, int c1)
+   {
+      for (int c = c0; c < c1; c++)
+      {
+         int first = (long)n*c/nchunks, last = (long)n*(c+1)/nchunks;
+         for (int i = first; i < last; i++)
+         {
+            const DrawItem &item = draw_list[i];
+            lmrk_lod[i] = LOD_CULLED;
+            if (!(item.views & bit) || !inLayer(item)) continue;
+            for (int k = 0; k < 3; k++)
+               extent[c] = std::max(extent[c], fabsf(item.point[k] - center[k]));
+            float dist = cam.perspective ? std::max(-(cam.view*glm::vec4(item.world,1)).z, 1e-3f) : 1.0f;
+            if (STAR_RADIUS*item.quality*pix/dist < lod_pixels)
+            {
+               lmrk_lod[i] = LOD_POINT;
+               points[c+1]++;
+            }
+            else
+            {
+               lmrk_lod[i] = LOD_MESH;
+               meshes[c+1]++;
+            }
+         }
+      }
+   });
+   float reach = 0;
+   for (int c = 0; c < nchunks; c++)
+   {
+      meshes[c+1] += meshes[c];
+      points[c+1] += points[c];
+      reach = std::max(reach, extent[c]);
+   }
+   // short of 32767 so rounding never overflows
+   float step = std::max(reach/32000, 1e-6f);
+   size_t mesh_size = core_pass ? 16*sizeof(float) : sizeof(StarInstance);
+   size_t point_size = core_pass ? 3*sizeof(float) : sizeof(StarInstance);
+
+   // orphan and map both buffers, chunks fill disjoint ranges
+   char *mat = NULL, *pos = NULL;
+   if (meshes[nchunks])
+   {
+      state->bindBuffer(GL_ARRAY_BUFFER, inst_buf[0]);
+      glBufferData(GL_ARRAY_BUFFER, meshes[nchunks]*mesh_size, NULL, GL_STREAM_DRAW);
+      inst_bytes[0] = meshes[nchunks]*mesh_size;
+      mat = (char*)gl33->glMapBufferRange(GL_ARRAY_BUFFER, 0, meshes[nchunks]*mesh_size,
+                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+   }
+   if (points[nchunks])
+   {
+      state->bindBuffer(GL_ARRAY_BUFFER, inst_buf[1]);
+      glBufferData(GL_ARRAY_BUFFER, points[nchunks]*point_size, NULL, GL_STREAM_DRAW);
+      inst_bytes[1] = points[nchunks]*point_size;
+      pos = (char*)gl33->glMapBufferRange(GL_ARRAY_BUFFER, 0, points[nchunks]*point_size,
+                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+   }
+   float up[3] = {1, 0, 0};
+   jobs->parallelFor(nchunks, 1, [&](int c0, int c1)
+   {
+      for (int c = c0; c < c1; c++)
+      {
+         int first = (long)n*c/nchunks, last = (long)n*(c+1)/nchunks;
+         char *m = mat ? mat + mesh_size*meshes[c] : NULL;
+         char *p = pos ? pos + point_size*points[c] : NULL;
+         for (int i = first; i < last; i++)
+         {
+            const float *pt = glm::value_ptr(draw_list[i].point);
+            char *out;
+            if (lmrk_lod[i] == LOD_MESH && m)
+            {
+               out = m;
+               m += mesh_size;
+               if (core_pass)
+               {
+                  float d[3] = {pt[0]-center[0], pt[1]-center[1], pt[2]-center[2]};
+                  Star::facing(pt, d, up, draw_list[i].quality, (float*)out);
+                  continue;
+               }
+            }
+            else if (lmrk_lod[i] == LOD_POINT && p)
+            {
+               out = p;
+               p += point_size;
+               if (core_pass)
+               {
+                  memcpy(out, pt, 3*sizeof(float));
+                  continue;
+               }
+            }
+            else
+            {
+               continue;
+            }
+            StarInstance *inst = (StarInstance*)out;
+            for (int k = 0; k < 3; k++)
+               inst->p[k] = lroundf((pt[k] - center[k])/step);
+            inst->quality = lroundf(std::min(std::max(draw_list[i].quality, 0.0f), 1.0f)*255);
+            inst->pad = 0;
+         }
+      }
+   });
+   // a failed map (or unmap) just drops this frame's stars
+   bool ok[2] = {true, true};
+   if (meshes[nchunks])
+   {
+      state->bindBuffer(GL_ARRAY_BUFFER, inst_buf[0]);
+      ok[0] = mat && gl33->glUnmapBuffer(GL_ARRAY_BUFFER);
+   }
+   if (points[nchunks])
+   {
+      state->bindBuffer(GL_ARRAY_BUFFER, inst_buf[1]);
+      ok[1] = pos && gl33->glUnmapBuffer(GL_ARRAY_BUFFER);
+   }
+   state->bindBuffer(GL_ARRAY_BUFFER, 0);
+
+   // the core pass draws the filled buffers with the rest of its list
+   if (core_pass)
    {
-      QSize size = this->size();
-      int n, ix=size.width()/2+5,iy=size.height()-5;
-      project(0,asp/2,1);
-      glViewport(size.width()/2+1,0,size.width()/2,size.height());
-      glFuncs->glActiveTexture(GL_TEXTURE1);
-      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_COMPARE_MODE,GL_NONE);
-      glEnable(GL_TEXTURE_2D);
-      glColor3f(1.0f,1.0f,1.0f);
-      glBegin(GL_QUADS);
-      glMultiTexCoord2f(GL_TEXTURE1,0,0);glVertex2f(-1,-1);
-      glMultiTexCoord2f(GL_TEXTURE1,1,0);glVertex2f(+1,-1);
-      glMultiTexCoord2f(GL_TEXTURE1,1,1);glVertex2f(+1,+1);
-      glMultiTexCoord2f(GL_TEXTURE1,0,1);glVertex2f(-1,+1);
-      glEnd();
-      glDisable(GL_TEXTURE_2D);
-      glFuncs->glActiveTexture(GL_TEXTURE0);
+      glm::mat4 root = graph->world(SCENE_ROOT);
+      Material m = Material();
+      m.color = glm::vec4(1);
+      if (ok[1] && points[nchunks]) scene_list.add(point_mesh, m, root, points[nchunks]);
+      const QOpenGLTexture *tex = star->texture();
+      m.textured = true;
+      m.texture = tex && tex->isCreated() ? tex->textureId() : 0;
+      if (ok[0] && meshes[nchunks])
+         scene_list.addInstanced(star_mesh, m, root, inst_buf[0], meshes[nchunks]);
+      return;
    }
-   //  Done
-   glFlush();
+
+   glPushMatrix();
+   glMultMatrixf(glm::value_ptr(graph->world(SCENE_ROOT)));
+   if (ok[0]) star->drawInstances(inst_buf[0], meshes[nchunks], center, step);
+   if (ok[1]) star->drawPoints(inst_buf[1], points[nchunks], center, step);
+   glPopMatrix();
 }
 
 /*
@@ -539,10 +1641,11 @@ void SlamViz::displayGrid(double D)
 void SlamViz::Sky(double D)
 {
    glColor3f(1,1,1);
-   glFuncs->glEnable(GL_TEXTURE_2D);
+   if (!sky) return; // still uploading
+   state->enable(GL_TEXTURE_2D);
 
    //  Sides
-   sky->bind();
+   state->bindTexture(sky);
    glBegin(GL_QUADS);
    glTexCoord2f(0.25,0.6667); glVertex3f(-D,-D,-D);
    glTexCoord2f(0.5,0.6667); glVertex3f(+D,-D,-D);
@@ -578,8 +1681,7 @@ void SlamViz::Sky(double D)
    glTexCoord2f(0.5,0.6667); glVertex3f(+D,-D,-D);
    glTexCoord2f(0.25,0.6667); glVertex3f(-D,-D,-D);
    glEnd();
-   sky->release();
-   glFuncs->glDisable(GL_TEXTURE_2D);
+   state->disable(GL_TEXTURE_2D);
 }
 
 void SlamViz::readPose()
@@ -587,90 +1689,43 @@ void SlamViz::readPose()
    std::string line;
    if (std::getline(*pose_file,line))
    {
-      std::istringstream ss(line);
-      std::string token;
-      std::getline(ss, token, ' ');
-      cur_pose.timestamp = std::stod(token);
-      glm::vec3 translation;
-      for (int i = 0; i < 3; i++)
-      {
-         std::getline(ss, token, ' ');
-         translation[i] = scale_factor*std::stof(token);
-      }
-
-      std::vector<float> quat_vals;
-      for (int i = 0; i < 4; i++)
-      {
-         std::getline(ss, token, ' ');
-         quat_vals.push_back(std::stof(token));
-      }
-      glm::quat rotation(quat_vals[3],quat_vals[0],quat_vals[1],quat_vals[2]);
-      glm::mat4 rotation_mat = glm::toMat4(rotation);
-      glm::mat4 T_mat = glm::translate(glm::mat4(1), translation);
-
-      cur_pose.T_WS = T_mat * rotation_mat;
+      parsePose(line, scale_factor, cur_pose);
+      graph->setLocal(SCENE_POSE, cur_pose.T_WS);
 
+      // otherwise the center comes from the GUI's view
       if (pose_track)
       {
+         glm::vec3 translation(cur_pose.T_WS[3]);
          v_x = translation[0];
          v_y = translation[2];
          v_z = -translation[1];
       }
-      else
-      {
-         v_x = v_y = v_z = 0;
-      }
    }
 }
 
 void SlamViz::readLmrks()
 {
-   std::string line;
-   if (std::getline(*lmrk_file, line))
+   std::vector<unsigned long> sighted_ids, marginalized_ids;
+   if (readLandmarkFrame(*lmrk_file, scale_factor, lmrks, inactive_lmrks, frame_table, times,
+                         sighted_ids, marginalized_ids))
    {
-      // insert new landmarks
-      unsigned int stamp = std::stod(line);
-      std::getline(*lmrk_file, line);
-      while (line != "")
-      {
-         std::istringstream ss(line);
-         std::string token;
-         std::getline(ss, token, ' ');
-         unsigned long id = std::stol(token);
-         Landmark lmrk;
-         lmrk.timestamp = stamp;
-         std::getline(ss, token, ' ');
-         lmrk.quality = std::stod(token);
-         for (int i = 0; i < 3; i++)
-         {
-            std::getline(ss, token, ' ');
-            lmrk.point[i] = scale_factor*std::stof(token);
-         }
-         // update timestamp if landmark already exists
-         if (lmrks.find(id) != lmrks.end())
-         {
-            lmrks.at(id) = lmrk;
-         }
-         else
-         {
-            lmrks.insert(std::pair<unsigned long, Landmark>(id, lmrk));
-         }
-         std::getline(*lmrk_file, line);
-      }
-      // remove old landmarks
-      std::vector<unsigned long> marginalized_ids;
-      for (std::map<unsigned long, Landmark>::iterator it = lmrks.begin();
-         it != lmrks.end(); it++)
+      for (unsigned int i = 0; i < sighted_ids.size(); i++)
       {
-         if (it->second.timestamp < stamp)
-            marginalized_ids.push_back(it->first);
+         const Landmark &lmrk = lmrks.at(sighted_ids[i]);
+         lmrk_bvh->update(sighted_ids[i], glm::value_ptr(lmrk.point), STAR_RADIUS*lmrk.quality);
+         graph->setLandmark(sighted_ids[i], lmrk.point, lmrk.quality, true);
       }
-      for (int i = 0; i < marginalized_ids.size(); i++)
+      for (unsigned int i = 0; i < marginalized_ids.size(); i++)
       {
-         Landmark marginalized = lmrks.at(marginalized_ids[i]);
-         lmrks.erase(marginalized_ids[i]);
-         inactive_lmrks.insert(std::pair<unsigned long, Landmark>(marginalized_ids[i],marginalized));
+         // shown as stored, a packed landmark may move by a fraction of a step
+         const PackedLandmark &marginalized = inactive_lmrks.at(marginalized_ids[i]);
+         glm::vec3 point = packedPoint(marginalized);
+         lmrk_bvh->update(marginalized_ids[i], glm::value_ptr(point), STAR_RADIUS*packedQuality(marginalized));
+         graph->setLandmark(marginalized_ids[i], point, packedQuality(marginalized), false);
+         if (tiles) tiles->add(marginalized_ids[i], marginalized);
       }
+      if (!marginalized_ids.empty()) static_shadow_dirty = true;
+      lmrk_bvh->refit();
    }
 }
 
@@ -690,10 +1745,149 @@ void SlamViz::drawAxes(double len, bool draw_labels)
    glColor3d(1.0,1.0,1.0);
    if (draw_labels)
    {
-      renderText(len, 0.0, 0.0, QString("X"));
-      renderText(0.0, len, 0.0, QString("Y"));
-      renderText(0.0, 0.0, len, QString("Z"));
+      addLabel(len, 0.0, 0.0, QString("X"), LABEL_AXES);
+      addLabel(0.0, len, 0.0, QString("Y"), LABEL_AXES);
+      addLabel(0.0, 0.0, len, QString("Z"), LABEL_AXES);
+   }
+}
+
+//
+//  Queue a text label at a point in the current modelview,
+//  labels are batched over the frame by the text renderer
+//
+void SlamViz::addLabel(double x, double y, double z, const QString &text, int priority)
+{
+   double model[16], proj[16], wz;
+   int view[4];
+   Label label;
+   glGetDoublev(GL_MODELVIEW_MATRIX, model);
+   glGetDoublev(GL_PROJECTION_MATRIX, proj);
+   glGetIntegerv(GL_VIEWPORT, view);
+   if (gluProject(x,y,z, model,proj,view, &label.x,&label.y,&wz) && wz < 1.0)
+   {
+      label.text = text;
+      label.priority = priority;
+      labels.push_back(label);
+   }
+}
+
+//
+//  Same for a world point seen by cam, without reading back GL state,
+//  points outside the view's frustum get no label
+//
+void SlamViz::addLabel(const ViewCam &cam, const glm::vec3 &world, const QString &text, int priority)
+{
+   glm::vec4 clip = cam.proj*cam.view*glm::vec4(world, 1);
+   if (clip.w <= 0) return;
+   glm::vec3 ndc = glm::vec3(clip)/clip.w;
+   if (fabs(ndc.x) > 1 || fabs(ndc.y) > 1 || fabs(ndc.z) > 1) return;
+   Label label;
+   label.x = cam.vp[0] + 0.5*(ndc.x + 1)*cam.vp[2];
+   label.y = cam.vp[1] + 0.5*(ndc.y + 1)*cam.vp[3];
+   label.text = text;
+   label.priority = priority;
+   labels.push_back(label);
+}
+
+//
+//  With -labels, every landmark in the view is labelled with its id
+//  and every trajectory pose with its stamp; nearer landmarks come
+//  first in the draw list, so they win when labels are decluttered
+//
+void SlamViz::labelScene(const ViewCam &cam, unsigned int bit)
+{
+   ProfileScope scope(profiler, "labels", false);
+   for (unsigned int i = 0; i < draw_list.size(); i++)
+      if (draw_list[i].views & bit)
+         addLabel(cam, draw_list[i].world, QString::number(draw_list[i].id), LABEL_LMRK);
+   const glm::mat4 &root = graph->world(SCENE_ROOT);
+   for (int i = prev_poses.size()-1; i >= 0; i--)
+      addLabel(cam, glm::vec3(root*prev_poses[i].T_WS[3]),
+               QString::number(prev_poses[i].timestamp,'f',1), LABEL_POSE);
+}
+
+//
+//  Landmarks are only pickable while they are displayed
+//
+bool SlamViz::pickable(unsigned long id)
+{
+   std::map<unsigned long, Landmark>::iterator it = lmrks.find(id);
+   if (it != lmrks.end()) return it->second.quality >= lmrk_lwr_bound && inWindow(it->second.slot);
+   if (!disp_inactive_lmrks) return false;
+   PackedLandmarks::iterator in = inactive_lmrks.find(id);
+   return in != inactive_lmrks.end() && packedQuality(in->second) >= lmrk_lwr_bound &&
+          inWindow(in->second.slot);
+}
+
+bool SlamViz::inWindow(uint32_t slot) const
+{
+   uint32_t f0, f1;
+   return !time_window || (frame_table.range(time_from, time_to, f0, f1) && times.overlaps(slot, f0, f1));
+}
+
+//
+//  Cast a ray through the clicked pixel of the view under the
+//  cursor and select the nearest landmark it hits
+//
+void SlamViz::pick(QPoint p)
+{
+   // views are laid out over the last frame drawn, the window's at the
+   // render scale or the exporter's
+   if (!frame_w || !frame_h) return;
+   glm::vec2 scale(drawn_size.width()/(float)frame_w, drawn_size.height()/(float)frame_h);
+   glm::vec2 win(scale.x*p.x(), scale.y*(frame_h-p.y()));
+   picked = false;
+   for (unsigned int v = 0; v < views.size(); v++)
+   {
+      const ViewCam &cam = views[v];
+      glm::vec4 vp(cam.vp[0],cam.vp[1],cam.vp[2],cam.vp[3]);
+      if (win.x < vp[0] || win.x >= vp[0]+vp[2] || win.y < vp[1] || win.y >= vp[1]+vp[3])
+         continue;
+      glm::vec3 n = glm::unProject(glm::vec3(win,0), cam.view, cam.proj, vp);
+      glm::vec3 f = glm::unProject(glm::vec3(win,1), cam.view, cam.proj, vp);
+      // world (x,y,z) is landmark (x,-z,y)
+      glm::vec3 org(n.x, -n.z, n.y);
+      glm::vec3 dir = glm::normalize(glm::vec3(f.x, -f.z, f.y) - org);
+      float t;
+      picked = lmrk_bvh->raycast(glm::value_ptr(org), glm::value_ptr(dir),
+         [this](unsigned long id) {return pickable(id);}, &picked_id, &t);
+      break;
+   }
+   if (picked)
+   {
+      bool active = lmrks.find(picked_id) != lmrks.end();
+      Landmark lmrk = active ? lmrks.at(picked_id) : unpackLandmark(inactive_lmrks.at(picked_id), frame_table);
+      emit pickInfo(QString("Lmrk %1 %2\nquality %3\nseen %4 to %5")
+         .arg(picked_id).arg(active ? "active" : "inactive")
+         .arg(lmrk.quality,0,'f',3).arg(frame_table.stamp(times.first(lmrk.slot)),0,'f',0)
+         .arg(lmrk.timestamp,0,'f',0));
    }
+   else
+   {
+      emit pickInfo(QString());
+   }
+}
+
+//
+//  Outline the picked landmark and label it with its id
+//
+void SlamViz::drawPicked()
+{
+   if (!picked || !pickable(picked_id)) return;
+   std::map<unsigned long, Landmark>::iterator it = lmrks.find(picked_id);
+   Landmark lmrk = it != lmrks.end() ? it->second : unpackLandmark(inactive_lmrks.at(picked_id), frame_table);
+   const glm::vec3 &pt = lmrk.point;
+   GLUquadric *quad = gluNewQuadric();
+   gluQuadricDrawStyle(quad, GLU_LINE);
+   glPushMatrix();
+   glMultMatrixf(glm::value_ptr(graph->world(SCENE_ROOT)));
+   glTranslated(pt[0],pt[1],pt[2]);
+   glColor3f(1,1,0);
+   gluSphere(quad, 1.2*STAR_RADIUS*lmrk.quality, 12, 8);
+   glColor3f(1,1,1);
+   addLabel(0,0,0, QString::number(picked_id), LABEL_PICK);
+   glPopMatrix();
+   gluDeleteQuadric(quad);
 }
 
 // add pose to previous pose vector if it is above a 
@@ -706,29 +1900,243 @@ void SlamViz::addToPrevPoses()
    }
    else
    {
-      // get translation component from current pose and
-      // last pose in previous pose vector
-      glm::vec3 scale;
-      glm::quat rotation;
-      glm::vec3 cur_trans;
-      glm::vec3 prev_trans;
-      glm::vec3 skew;
-      glm::vec4 perspective;
-      glm::decompose(cur_pose.T_WS, scale, rotation, cur_trans, skew, perspective);
-      glm::decompose(prev_poses.back().T_WS, scale, rotation, prev_trans, skew, perspective);
-
-
-      // calculate the magnitude of the translation
-      // between the current pose and last pose
-      double dist = sqrt(glm::length2(cur_trans - prev_trans));
-
       // if distance from last pose is greater than threshold, 
       // add to previous pose vector
-      if (dist > 0.5)
+      if (poseDistance(cur_pose, prev_poses.back()) > POSE_SPACING)
          prev_poses.push_back(cur_pose);
    }
 }
 
+/******************************************************************/
+/*************************  Memory Budget  ************************/
+/******************************************************************/
+//
+//  Refresh the per-subsystem byte counters
+//
+void SlamViz::accountMemory()
+{
+   size_t node = sizeof(std::pair<const unsigned long, Landmark>) + MEM_MAP_NODE;
+   memory->set(MEM_LANDMARKS, lmrks.size()*node + MemoryBudget::hashMapBytes(inactive_lmrks) +
+               frame_table.bytes() + times.bytes() +
+               window_ids.capacity()*sizeof(unsigned long) + lmrk_bvh->bytes() +
+               graph->bytes() + draw_list.capacity()*sizeof(DrawItem) + lmrk_lod.capacity() +
+               hiz->bytes() + hiz_depth.capacity()*sizeof(float) + (tiles ? tiles->bytes() : 0) +
+               lmrk_light_list.capacity()*sizeof(ClusterLight));
+   memory->set(MEM_TRAJECTORY, prev_poses.capacity()*sizeof(Pose));
+   size_t tex = MemoryBudget::textureBytes(sky) +
+                MemoryBudget::textureBytes(star->texture()) +
+                MemoryBudget::textureBytes(smoke->texture());
+   for (int i = 0; i < 3; i++)
+      tex += MemoryBudget::textureBytes(texture[i]);
+   memory->set(MEM_TEXTURES, tex);
+   memory->set(MEM_MESHES, star->meshBytes());
+   // both shadow layers, occluder depth, frame and export framebuffers,
+   // streamed buffers
+   size_t gpu = (size_t)8*shadowdim*shadowdim + (size_t)4*hiz_w*hiz_h + frame_bytes + inst_bytes[0] + inst_bytes[1] +
+                cluster_bytes[0] + cluster_bytes[1] + cluster_bytes[2] + shadow_bytes;
+   if (renderer) gpu += renderer->bytes();
+   if (exporter) gpu += exporter->bytes();
+   memory->set(MEM_GPU_BUFFERS, gpu);
+}
+
+//
+//  Past the soft limit old trajectory is thinned out and then the
+//  oldest inactive landmarks are spilled to disk, past the hard limit
+//  they are dropped without the disk write
+//
+void SlamViz::enforceBudget()
+{
+   accountMemory();
+   int pressure = memory->pressure();
+   if (pressure == MEM_OK) return;
+   decimateTrajectory();
+   accountMemory();
+   if (memory->pressure() == MEM_OK || inactive_lmrks.empty()) return;
+   // tiles out of view go to disk before any landmark is dropped
+   if (tiles)
+   {
+      int tile;
+      while (memory->pressure() != MEM_OK && (tile = tiles->lru(tile_frame)) >= 0 && pageOutTile(tile))
+         accountMemory();
+      lmrk_bvh->refit();
+      static_shadow_dirty = true;
+      if (memory->pressure() == MEM_OK || inactive_lmrks.empty()) return;
+   }
+   // enough landmarks to get back under the limit that was crossed,
+   // at the store's average cost per landmark
+   size_t excess = memory->excess();
+   if (!excess) return;
+   size_t per = memory->bytes(MEM_LANDMARKS) / (lmrks.size() + inactive_lmrks.size());
+   dropInactive(std::min(excess/std::max(per,(size_t)1) + 1, inactive_lmrks.size()),
+                pressure == MEM_SOFT);
+   accountMemory();
+}
+
+//
+//  Drop every other pose older than the newest MEM_KEEP_POSES,
+//  the smoke trail only ever shows recent ones
+//
+void SlamViz::decimateTrajectory()
+{
+   if (prev_poses.size() <= MEM_KEEP_POSES + 1) return;
+   size_t old = prev_poses.size() - MEM_KEEP_POSES;
+   std::vector<Pose> kept;
+   kept.reserve(old/2 + 1 + MEM_KEEP_POSES);
+   for (size_t i = 0; i < old; i += 2)
+      kept.push_back(prev_poses[i]);
+   kept.insert(kept.end(), prev_poses.begin() + old, prev_poses.end());
+   memory->decimated += prev_poses.size() - kept.size();
+   prev_poses.swap(kept);
+}
+
+//
+//  Remove the count oldest inactive landmarks, appending them to the
+//  spill file as "<id> <stamp> <quality> <x> <y> <z>" if spill is set
+//
+void SlamViz::dropInactive(size_t count, bool spill)
+{
+   // frame indices order like the stamps they stand for
+   std::vector<std::pair<uint32_t, unsigned long> > age;
+   age.reserve(inactive_lmrks.size());
+   for (PackedLandmarks::iterator it = inactive_lmrks.begin(); it != inactive_lmrks.end(); it++)
+      age.push_back(std::make_pair(it->second.frame_quality >> 8, it->first));
+   std::nth_element(age.begin(), age.begin() + count - 1, age.end());
+   if (spill && !spill_file)
+   {
+      spill_file = new std::ofstream(spill_path.toLocal8Bit().constData(), std::ios::app);
+      if (!spill_file->good())
+         fprintf(stderr, "cannot spill landmarks to %s, evicting instead\n",
+                 spill_path.toLocal8Bit().constData());
+   }
+   spill = spill && spill_file->good();
+   for (size_t i = 0; i < count; i++)
+   {
+      unsigned long id = age[i].second;
+      if (spill)
+      {
+         Landmark lmrk = unpackLandmark(inactive_lmrks.at(id), frame_table);
+         *spill_file << id << " " << lmrk.timestamp << " " << lmrk.quality << " "
+                     << lmrk.point[0] << " " << lmrk.point[1] << " " << lmrk.point[2] << "\n";
+      }
+      // a landmark seen again since lives on as its active copy
+      bool active = lmrks.find(id) != lmrks.end();
+      if (!active) times.remove(inactive_lmrks.at(id).slot);
+      if (tiles) tiles->remove(id);
+      inactive_lmrks.erase(id);
+      if (active) continue;
+      lmrk_bvh->remove(id);
+      graph->removeLandmark(id);
+      if (picked && picked_id == id)
+      {
+         picked = false;
+         emit pickInfo(QString());
+      }
+   }
+   if (count) static_shadow_dirty = true;
+   if (spill)
+   {
+      spill_file->flush();
+      memory->spilled += count;
+   }
+   else
+   {
+      memory->evicted += count;
+   }
+   lmrk_bvh->refit();
+}
+
+//
+//  Page inactive landmark tiles for this frame's views: tiles in a view
+//  are read back first, then those in the views moved ahead by the
+//  camera's recent motion, at most TILE_LOADS a frame. Past the budget
+//  the least recently used tiles not in a view go back to disk
+//
+void SlamViz::pageTiles()
+{
+   if (!tiles || views.empty()) return;
+   ProfileScope scope(profiler, "tiles", false);
+   tile_frame++;
+   glm::vec3 motion = (float)TILE_PREFETCH*(views[0].eye - tile_eye);
+   tile_eye = views[0].eye;
+   bool changed = false;
+
+   std::vector<int> wanted;
+   if (disp_inactive_lmrks)
+   {
+      const glm::mat4 &root = graph->world(SCENE_ROOT);
+      int passes = glm::length(motion) > 0 ? 2 : 1;
+      for (int pass = 0; pass < passes; pass++)
+         for (unsigned int v = 0; v < views.size(); v++)
+         {
+            // frustum planes in landmark coordinates, grown by the largest star
+            ViewCam cam = views[v];
+            cam.view = cam.view*glm::translate(glm::mat4(1), -(float)pass*motion)*root;
+            setFrustum(cam);
+            glm::vec3 pad(STAR_RADIUS);
+            tiles->find([&](const glm::vec3 &lo, const glm::vec3 &hi)
+                        {return boxInView(cam, lo - pad, hi + pad);}, wanted);
+         }
+   }
+   int loads = 0;
+   std::vector<std::pair<unsigned long, PackedLandmark> > in;
+   for (unsigned int i = 0; i < wanted.size(); i++)
+   {
+      tiles->touch(wanted[i], tile_frame);
+      if (tiles->paged(wanted[i]) || loads >= TILE_LOADS) continue;
+      in.clear();
+      if (!tiles->pageIn(wanted[i], in)) continue;
+      loads++;
+      for (unsigned int k = 0; k < in.size(); k++)
+      {
+         // a landmark seen again since stays active
+         unsigned long id = in[k].first;
+         if (lmrks.find(id) != lmrks.end()) continue;
+         inactive_lmrks[id] = in[k].second;
+         glm::vec3 point = packedPoint(in[k].second);
+         float quality = packedQuality(in[k].second);
+         lmrk_bvh->update(id, glm::value_ptr(point), STAR_RADIUS*quality);
+         graph->setLandmark(id, point, quality, false);
+      }
+      changed = true;
+   }
+
+   while (tiles->resident() > tile_budget)
+   {
+      int tile = tiles->lru(tile_frame);
+      if (tile < 0 || !pageOutTile(tile)) break;
+      changed = true;
+   }
+   if (changed)
+   {
+      lmrk_bvh->refit();
+      static_shadow_dirty = true;
+   }
+}
+
+//
+//  Write a tile's new landmarks out and forget all of it, false if
+//  the store can't be written
+//
+bool SlamViz::pageOutTile(int tile)
+{
+   std::vector<unsigned long> ids;
+   if (!tiles->pageOut(tile, inactive_lmrks, ids)) return false;
+   for (unsigned int i = 0; i < ids.size(); i++)
+   {
+      unsigned long id = ids[i];
+      inactive_lmrks.erase(id);
+      if (lmrks.find(id) != lmrks.end()) continue;
+      lmrk_bvh->remove(id);
+      graph->removeLandmark(id);
+      if (picked && picked_id == id)
+      {
+         picked = false;
+         emit pickInfo(QString());
+      }
+   }
+   return true;
+}
+
 
 void SlamViz::initShaders()
 {
@@ -746,11 +2154,10 @@ void SlamViz::initShaders()
 
 void SlamViz::initMap()
 {
-   unsigned int shadowtex;
    int n;
    // make sure multitextures are supported
    glGetIntegerv(GL_MAX_TEXTURE_UNITS, &n);
-   if (n<2) close();
+   if (n<2) QMetaObject::invokeMethod(this, "close", Qt::QueuedConnection);
    // get max texture buffer size
    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &shadowdim);
    // limit texture size to maximum buffer size
@@ -758,9 +2165,17 @@ void SlamViz::initMap()
    if (shadowdim > n) shadowdim = n;
    // limit texture size to 2048 for performance
    if (shadowdim > 2048) shadowdim = 2048;
-   if (shadowdim < 512) close(); // shadow dimension too small
-   // do shadow textures in multitexture 1
+   if (shadowdim < 512) QMetaObject::invokeMethod(this, "close", Qt::QueuedConnection); // shadow dimension too small
+   shadow_max = shadowdim;
+   shadowdim = std::max(shadow_max >> governor->quality().shadow_shift, 256);
+   // do shadow textures in multitexture 1, the static layer is only
+   // ever copied from, so it is made first and left unbound
    glFuncs->glActiveTexture(GL_TEXTURE1);
+   glFuncs->glGenTextures(1,&static_shadowtex);
+   glFuncs->glBindTexture(GL_TEXTURE_2D, static_shadowtex);
+   glFuncs->glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, shadowdim, shadowdim, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+   glFuncs->glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+   glFuncs->glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
    glFuncs->glGenTextures(1,&shadowtex);
    glFuncs->glBindTexture(GL_TEXTURE_2D, shadowtex);
    glFuncs->glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, shadowdim, shadowdim, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
@@ -795,44 +2210,80 @@ void SlamViz::initMap()
    glReadBuffer(GL_NONE);
    //  Make sure this all worked
    if (glFuncs->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) Fatal("Error setting up frame buffer\n");
-   glFuncs->glBindFramebuffer(GL_FRAMEBUFFER,0);
+   // Same for the static layer
+   glFuncs->glGenFramebuffers(1,&static_framebuf);
+   glFuncs->glBindFramebuffer(GL_FRAMEBUFFER,static_framebuf);
+   glFuncs->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, static_shadowtex, 0);
+   glDrawBuffer(GL_NONE);
+   glReadBuffer(GL_NONE);
+   if (glFuncs->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) Fatal("Error setting up static shadow frame buffer\n");
+   glFuncs->glBindFramebuffer(GL_FRAMEBUFFER,target_fbo);
 
    ErrCheck("InitMap");
 
-   shadowMap();
+   static_shadow_dirty = true;
+}
+
+//
+//  Resize both shadow layers for the governor's current level, the
+//  other settings are read where they are used
+//
+void SlamViz::applyQuality()
+{
+   int dim = std::max(shadow_max >> governor->quality().shadow_shift, 256);
+   if (!shadowtex || dim == shadowdim) return;
+   shadowdim = dim;
+   state->activeTexture(GL_TEXTURE1);
+   state->bindTexture(GL_TEXTURE_2D, static_shadowtex);
+   glFuncs->glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, shadowdim, shadowdim, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+   state->bindTexture(GL_TEXTURE_2D, shadowtex);
+   glFuncs->glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, shadowdim, shadowdim, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+   state->activeTexture(GL_TEXTURE0);
+   static_shadow_dirty = true;
 }
 
+//
+//  Two depth layers from the light: marginalized landmarks never move,
+//  so their depth is kept in the static layer and only redrawn when
+//  that set or the light changes; every frame the static depth is
+//  copied into the shadow map and the airplane and active landmarks
+//  are depth tested on top, leaving the nearer of the two per texel
+//
 void SlamViz::shadowMap(void)
 {
+   ProfileScope scope(profiler, "shadowMap");
+   QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
    double Lmodel[16];
    double Lproj[16];
    double Tproj[16];
-   double Dim = 2.0;
-   double Ldist;
 
    glPushMatrix();
    glPushAttrib(GL_TRANSFORM_BIT|GL_ENABLE_BIT);
    glShadeModel(GL_FLAT);
    glFuncs->glColorMask(0,0,0,0);
-   glFuncs->glEnable(GL_POLYGON_OFFSET_FILL);
+   state->enable(GL_POLYGON_OFFSET_FILL);
    
    Light(false);
 
-   Ldist = sqrt(Lpos[0]*Lpos[0] + Lpos[1]*Lpos[1] + Lpos[2]*Lpos[2]);
-   if(Ldist < 1.1*Dim) Ldist = 1.1*Dim;
-
    glMatrixMode(GL_PROJECTION);
-   glLoadIdentity();
-   gluPerspective(114.6*atan(Dim/Ldist),1,Ldist-Dim,Ldist+Dim);
+   glLoadMatrixf(glm::value_ptr(shadow_cam.proj));
    glMatrixMode(GL_MODELVIEW);
-   glLoadIdentity();
-   gluLookAt(Lpos[0],Lpos[1],Lpos[2], v_x,v_y,v_z, 0,1,0);
+   glLoadMatrixf(glm::value_ptr(shadow_cam.view));
    glFuncs->glViewport(0,0,shadowdim,shadowdim);
    
+   if (static_shadow_dirty)
+   {
+      glFuncs->glBindFramebuffer(GL_FRAMEBUFFER, static_framebuf);
+      glClear(GL_DEPTH_BUFFER_BIT);
+      drawCasters(shadow_cam, true);
+      static_shadow_dirty = false;
+   }
+   f->glBindFramebuffer(GL_READ_FRAMEBUFFER, static_framebuf);
+   f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuf);
+   f->glBlitFramebuffer(0,0,shadowdim,shadowdim, 0,0,shadowdim,shadowdim,
+                        GL_DEPTH_BUFFER_BIT, GL_NEAREST);
    glFuncs->glBindFramebuffer(GL_FRAMEBUFFER, framebuf);
-   glClear(GL_DEPTH_BUFFER_BIT);
-
-   Scene(false);
+   drawCasters(shadow_cam, false);
 
    glGetDoublev(GL_PROJECTION_MATRIX,Lproj);
    glGetDoublev(GL_MODELVIEW_MATRIX,Lmodel);
@@ -856,73 +2307,197 @@ void SlamViz::shadowMap(void)
    // Restore normal drawing state
    glShadeModel(GL_SMOOTH);
    glColorMask(1,1,1,1);
-   glFuncs->glDisable(GL_POLYGON_OFFSET_FILL);
+   state->disable(GL_POLYGON_OFFSET_FILL);
    glPopAttrib();
+   // the attribute stack restored enables behind the cache
+   state->invalidate();
    glPopMatrix();
-   glFuncs->glBindFramebuffer(GL_FRAMEBUFFER,0);
+   glFuncs->glBindFramebuffer(GL_FRAMEBUFFER,target_fbo);
 
    //ErrCheck("ShadowMap");
 }
 
-void SlamViz::Light(bool light)
+//
+//  Depth-only shadow casters for one layer: the inactive landmarks,
+//  or the airplane from its display list and the active landmarks.
+//  Landmarks inside the light frustum come from a position-only mesh,
+//  without texturing, skipping stars whose shadow is under
+//  shadow_min_texels across
+//
+void SlamViz::drawCasters(const ViewCam &light, bool inactive)
 {
-   //  Set light position
-   Lpos[0] = 2;
-   Lpos[1] = 2;
-   Lpos[2] = 0;
-   Lpos[3] = 1;
+   ProfileScope scope(profiler, inactive ? "Static depth" : "Scene depth");
+   Light(false);
+
+   // a sphere of radius r at distance d covers about r*texels/d texels,
+   // the draw list was culled with the larger light bound
+   float texels = 0.5*shadowdim*light.proj[1][1];
+   float up[3] = {1, 0, 0};
+   float center[3] = {(float)v_x, (float)v_y, (float)v_z};
+   caster_mats.clear();
+   for (unsigned int i = 0; i < draw_list.size(); i++)
+   {
+      const DrawItem &item = draw_list[i];
+      if (!(item.views & shadow_bit) || item.active == inactive) continue;
+      float r = STAR_RADIUS*item.quality;
+      if (!sphereInView(light, item.world, r)) continue;
+      if (r*texels < shadow_min_texels*glm::length(item.world - light.eye)) continue;
+      const float *pt = glm::value_ptr(item.point);
+      float d[3] = {pt[0]-center[0], pt[1]-center[1], pt[2]-center[2]};
+      caster_mats.resize(caster_mats.size() + 16);
+      Star::facing(pt, d, up, item.quality, &caster_mats[caster_mats.size()-16]);
+   }
+   drawDepthCasters(light, !inactive);
+}
+
+//
+//  The airplane and the stars in caster_mats, depth only, through the
+//  core renderer when there is one; the fixed-function path draws
+//  with the caller's projection and light or view matrix
+//
+void SlamViz::drawDepthCasters(const ViewCam &cam, bool with_plane)
+{
+   int count = caster_mats.size()/16;
+   bool instanced = renderer ? coreMeshes() : star->depthInstanced();
+   if (instanced && count)
+   {
+      shadow_bytes = caster_mats.size()*sizeof(float);
+      state->bindBuffer(GL_ARRAY_BUFFER, shadow_buf);
+      glBufferData(GL_ARRAY_BUFFER, shadow_bytes, caster_mats.data(), GL_STREAM_DRAW);
+   }
+   if (renderer)
+   {
+      scene_list.clear();
+      if (with_plane) plane->addParts(scene_list, renderer, graph->world(plane_node));
+      if (instanced && count)
+         scene_list.addInstanced(star_depth_mesh, Material(), graph->world(SCENE_ROOT), shadow_buf, count);
+      renderer->drawDepth(scene_list, cam.proj, cam.view);
+      return;
+   }
+
+   if (with_plane)
+   {
+      glPushMatrix();
+      glMultMatrixf(glm::value_ptr(graph->world(plane_node)));
+      plane->drawDepth();
+      glPopMatrix();
+   }
+   glPushMatrix();
+   glMultMatrixf(glm::value_ptr(graph->world(SCENE_ROOT)));
+   if (instanced && count)
+      star->drawDepthInstances(shadow_buf, count);
+   else
+      star->drawDepth(caster_mats.data(), count);
+   glPopMatrix();
+}
+
+//
+//  Wrap the star buffers once they are uploaded, false until then
+//
+bool SlamViz::coreMeshes()
+{
+   if (!point_mesh)
+      point_mesh = renderer->wrapMesh(inst_buf[1], 0, 0, GL_POINTS, 3);
+   if (!star_mesh)
+   {
+      GLuint vbo, pos_vbo, ibo;
+      GLsizei count;
+      if (!star->buffers(&vbo, &pos_vbo, &ibo, &count)) return false;
+      star_mesh = renderer->wrapMesh(vbo, ibo, count, GL_TRIANGLES, MESH_STRIDE);
+      star_depth_mesh = renderer->wrapMesh(pos_vbo, ibo, count, GL_TRIANGLES, 3);
+   }
+   return true;
+}
+
+//
+//  The airplane and landmarks through the core renderer, lit and
+//  shadowed in the shader
+//
+void SlamViz::drawCore(const ViewCam &cam, unsigned int bit)
+{
+   ProfileScope scope(profiler, "Scene");
+   scene_list.clear();
+   if (layer != LAYER_STATIC)
+      plane->addParts(scene_list, renderer, graph->world(plane_node));
+   if (coreMeshes())
+   {
+      core_pass = true;
+      drawInstanced(cam, bit);
+      core_pass = false;
+   }
+   scene_list.sort();
+
+   RenderLight light;
+   light.position = glm::vec3(Lpos[0], Lpos[1], Lpos[2]);
+   light.eye = cam.eye;
+   light.ambient = 0.3;
+   light.diffuse = 1.0;
+   light.shadow = shadowtex;
+   light.shadow_mat = glm::translate(glm::mat4(1), glm::vec3(0.5)) *
+                      glm::scale(glm::mat4(1), glm::vec3(0.5)) * shadow_cam.proj * shadow_cam.view;
+   glPointSize(2);
+   renderer->draw(scene_list, cam.proj, cam.view, light);
+   glPointSize(1);
+   // the overlays drawn next still use the fixed-function light
+   Light(true);
+}
 
+void SlamViz::Light(bool light)
+{
    //  Enable lighting
    if (light)
    {
       float Med[]  = {0.3,0.3,0.3,1.0};
       float High[] = {1.0,1.0,1.0,1.0};
       //  Enable lighting with normalization
-      glFuncs->glEnable(GL_LIGHTING);
-      glFuncs->glEnable(GL_NORMALIZE);
+      state->enable(GL_LIGHTING);
+      state->enable(GL_NORMALIZE);
       //  glColor sets ambient and diffuse color materials
       glColorMaterial(GL_FRONT_AND_BACK,GL_AMBIENT_AND_DIFFUSE);
-      glFuncs->glEnable(GL_COLOR_MATERIAL);
+      state->enable(GL_COLOR_MATERIAL);
       //  Enable light 0
-      glFuncs->glEnable(GL_LIGHT0);
+      state->enable(GL_LIGHT0);
       glLightfv(GL_LIGHT0,GL_POSITION,Lpos);
       glLightfv(GL_LIGHT0,GL_AMBIENT,Med);
       glLightfv(GL_LIGHT0,GL_DIFFUSE,High);
    }
    else
    {
-      glFuncs->glDisable(GL_LIGHTING);
-      glFuncs->glDisable(GL_COLOR_MATERIAL);
-      glFuncs->glDisable(GL_NORMALIZE);
+      state->disable(GL_LIGHTING);
+      state->disable(GL_COLOR_MATERIAL);
+      state->disable(GL_NORMALIZE);
    }
 }
 
-void SlamViz::Scene(bool light)
+void SlamViz::Scene(bool light, unsigned int view)
 {
+   ProfileScope scope(profiler, light ? "Scene" : "Scene depth");
    Light(light);
 
    if (light)
    {
-      glFuncs->glEnable(GL_TEXTURE_2D);
+      state->enable(GL_TEXTURE_2D);
    }
    
-   glPushMatrix();
-   //  Draw scene
-   glRotated(-90.0,1.0,0.0,0.0);
-   glMultMatrixf(glm::value_ptr(cur_pose.T_WS));
-   plane->drawAirplane(0,0,0,
-                       0,0,1,
-                       1,0,0);
+   if (layer != LAYER_STATIC)
+   {
+      glPushMatrix();
+      //  Draw scene
+      glMultMatrixf(glm::value_ptr(graph->world(plane_node)));
+      plane->drawAirplane(0,0,0,
+                          0,0,1,
+                          1,0,0);
 
-   //plane->drawAirplane(-1,0,0, 0,0,1, 1,0,0);
+      //plane->drawAirplane(-1,0,0, 0,0,1, 1,0,0);
 
-   glPopMatrix();
+      glPopMatrix();
+   }
 
-   dispLandmarks();
+   dispLandmarks(view);
    
    
    if (light) 
-      glFuncs->glDisable(GL_TEXTURE_2D);
+      state->disable(GL_TEXTURE_2D);
    // prior poses, axes and skybox don't cast shadows, so return
    // here if not doing lighting
    if (!light) 
@@ -930,43 +2505,137 @@ void SlamViz::Scene(bool light)
       return;
    }
    
-   glFuncs->glDisable(GL_TEXTURE_2D);
+   state->disable(GL_TEXTURE_2D);
 }
 
-void SlamViz::dispLandmarks()
+//
+//  Draw landmarks, the draw list entries visible in view or,
+//  for view 0, every entry of the draw list
+//
+void SlamViz::dispLandmarks(unsigned int view)
 {
-   for (std::map<unsigned long, Landmark>::iterator it = lmrks.begin();
-      it != lmrks.end(); it++)
+   ProfileScope scope(profiler, "dispLandmarks");
+   // the instanced path has its own shader, so it is skipped while
+   // the clustered lighting program is bound
+   if (view && star->instanced() && state->program() == 0)
    {
-      if (it->second.quality >= lmrk_lwr_bound)
-      {
-         glPushMatrix();
-         glRotated(-90.0,1.0,0.0,0.0);
-         double x = it->second.point[0];
-         double y = it->second.point[1];
-         double z = it->second.point[2];
-         star->drawStar(x,y,z, x-v_x,y-v_y,z-v_z, 1.,0.,0., it->second.quality);
-         glPopMatrix();
-      }
+      unsigned int v = 0;
+      while (!(view & (1u << v)))
+         v++;
+      drawInstanced(views[v], view);
+      return;
    }
-   if (disp_inactive_lmrks)
+   glPushMatrix();
+   glMultMatrixf(glm::value_ptr(graph->world(SCENE_ROOT)));
+   for (unsigned int i = 0; i < draw_list.size(); i++)
    {
-      for (std::map<unsigned long, Landmark>::iterator it = inactive_lmrks.begin();
-         it != inactive_lmrks.end(); it++)
-      {
-         if (it->second.quality >= lmrk_lwr_bound)
-         {
-            glPushMatrix();
-            glRotated(-90.0,1.0,0.0,0.0);
-            double x = it->second.point[0];
-            double y = it->second.point[1];
-            double z = it->second.point[2];
-            star->drawStar(x,y,z, x-v_x,y-v_y,z-v_z, 1.,0.,0., it->second.quality);;
-            glPopMatrix();
-         }
-      }
+      if ((view && !(draw_list[i].views & view)) || !inLayer(draw_list[i])) continue;
+      double x = draw_list[i].point[0];
+      double y = draw_list[i].point[1];
+      double z = draw_list[i].point[2];
+      star->drawStar(x,y,z, x-v_x,y-v_y,z-v_z, 1.,0.,0., draw_list[i].quality);
    }
+   star->release();
+   glPopMatrix();
 }
 
+//
+//  Set up the clustered landmark lighting path, it stays disabled
+//  if the context can't do 3.3 buffer textures
+//
+void SlamViz::initClusters()
+{
+   GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+   clusters = new LightClusters(16,9,24);
+   gl33 = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_3_Compatibility>();
+   if (!gl33 || !gl33->initializeOpenGLFunctions())
+   {
+      gl33 = NULL;
+      return;
+   }
+   cluster_shader = new QOpenGLShaderProgram();
+   if (!cluster_shader->addShaderFromSourceFile(QOpenGLShader::Vertex, "cluster.vert") ||
+       !cluster_shader->addShaderFromSourceFile(QOpenGLShader::Fragment, "cluster.frag") ||
+       !cluster_shader->link())
+   {
+      std::cerr << "Landmark lights disabled: " << cluster_shader->log().toStdString() << std::endl;
+      delete cluster_shader;
+      cluster_shader = NULL;
+      return;
+   }
+   glGenBuffers(3, cluster_buf);
+   glGenTextures(3, cluster_tex);
+   for (int i = 0; i < 3; i++)
+   {
+      glBindBuffer(GL_TEXTURE_BUFFER, cluster_buf[i]);
+      glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+      glBindTexture(GL_TEXTURE_BUFFER, cluster_tex[i]);
+      gl33->glTexBuffer(GL_TEXTURE_BUFFER, formats[i], cluster_buf[i]);
+   }
+   glBindTexture(GL_TEXTURE_BUFFER, 0);
+   glBindBuffer(GL_TEXTURE_BUFFER, 0);
+   ErrCheck("InitClusters");
+}
 
+//
+//  Gather the view's landmark lights from the draw list in view space,
+//  bin them and upload the result
+//
+void SlamViz::updateClusters(const ViewCam &cam, unsigned int bit)
+{
+   ProfileScope scope(profiler, "clusters");
+   lmrk_light_list.clear();
+   for (unsigned int i = 0; i < draw_list.size(); i++)
+   {
+      const DrawItem &item = draw_list[i];
+      if (!(item.views & bit)) continue;
+      glm::vec4 p = cam.view*glm::vec4(item.world, 1);
+      ClusterLight l;
+      l.pos[0] = p.x;
+      l.pos[1] = p.y;
+      l.pos[2] = p.z;
+      // brightness follows quality, active warm and inactive cool
+      l.intensity = 2.0*item.quality;
+      l.radius = 1.0 + 3.0*item.quality;
+      l.color[0] = item.active ? 1.0 : 0.4;
+      l.color[1] = item.active ? 0.85 : 0.5;
+      l.color[2] = item.active ? 0.4 : 1.0;
+      lmrk_light_list.push_back(l);
+   }
+   clusters->setProjection(cam.fov, cam.asp, cam.znear, cam.zfar);
+   clusters->build(lmrk_light_list, jobs);
+
+   const void *data[3] = {lmrk_light_list.data(), clusters->table.data(), clusters->indices.data()};
+   size_t bytes[3] = {lmrk_light_list.size()*sizeof(ClusterLight),
+                      clusters->table.size()*sizeof(unsigned int),
+                      clusters->indices.size()*sizeof(unsigned int)};
+   for (int i = 0; i < 3; i++)
+   {
+      // orphan the old storage so the driver doesn't wait on last frame
+      state->bindBuffer(GL_TEXTURE_BUFFER, cluster_buf[i]);
+      glBufferData(GL_TEXTURE_BUFFER, std::max(bytes[i],(size_t)16), NULL, GL_STREAM_DRAW);
+      cluster_bytes[i] = std::max(bytes[i],(size_t)16);
+      if (bytes[i]) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes[i], data[i]);
+   }
+   state->bindBuffer(GL_TEXTURE_BUFFER, 0);
+}
 
+void SlamViz::bindClusters()
+{
+   int vp[4];
+   glGetIntegerv(GL_VIEWPORT, vp);
+   state->useProgram(cluster_shader);
+   state->setUniform(cluster_shader, "tex", 0);
+   state->setUniform(cluster_shader, "lights", 2);
+   state->setUniform(cluster_shader, "clusters", 3);
+   state->setUniform(cluster_shader, "indices", 4);
+   state->setUniform(cluster_shader, "grid", clusters->nx, clusters->ny, clusters->nz);
+   state->setUniform(cluster_shader, "viewport", QVector4D(vp[0],vp[1],vp[2],vp[3]));
+   state->setUniform(cluster_shader, "depth", QVector2D(clusters->znear, log(clusters->zfar/clusters->znear)));
+   for (int i = 0; i < 3; i++)
+   {
+      state->activeTexture(GL_TEXTURE2+i);
+      state->bindTexture(GL_TEXTURE_BUFFER, cluster_tex[i]);
+   }
+   state->activeTexture(GL_TEXTURE0);
+}
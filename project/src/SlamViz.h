@@ -8,23 +8,49 @@
 #define GLM_ENABLE_EXPERIMENTAL
 
 
-#include <QGLWidget>
-#include <QGLFunctions>
+#include <QOpenGLWidget>
 #include <QString>
 #include <QOpenGLTexture>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFunctions_3_3_Compatibility>
+#include <QOpenGLFramebufferObject>
+#include <QSemaphore>
 
 //#include <GL/gl.h>
 
 #include "airplane.h"
 #include "Star.h"
 #include "SmokeBB.h"
+#include "GLUploader.h"
+#include "AssetLoader.h"
+#include "LightClusters.h"
+#include "JobSystem.h"
+#include "MultiView.h"
+#include "FrameProfiler.h"
+#include "MemoryBudget.h"
+#include "QualityGovernor.h"
+#include "GLState.h"
+#include "LandmarkBVH.h"
+#include "TextRenderer.h"
+#include "SceneGraph.h"
+#include "HiZBuffer.h"
+#include "TileStore.h"
+#include "CoreRenderer.h"
+#include "FrameExporter.h"
+#include "InputLog.h"
+#include "CameraPath.h"
+#include "SlamLog.h"
+#include "TimeIndex.h"
+#include "TripleBuffer.h"
+#include "RenderThread.h"
 #include "CSCIx229.h"
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <fstream>
+#include <atomic>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.hpp>
@@ -34,23 +60,52 @@
 #include <glm/gtx/rotate_vector.hpp>
 #include <glm/matrix.hpp>
 
+#define LOD_CULLED 0
+#define LOD_MESH   1
+#define LOD_POINT  2
+
+#define LAYER_ALL     0 // drawView draws everything,
+#define LAYER_STATIC  1 // the cached background: sky or grid, inactive landmarks
+#define LAYER_DYNAMIC 2 // or what goes over it: airplane, active landmarks, smoke
+
+#define SHADOW_MIN_TEXELS 1.0 // casters with a smaller shadow are skipped
+#define MEM_KEEP_POSES 256 // newest trajectory poses never thinned out
+#define TIME_WINDOW_END 1e10 // default window end, past any log stamp
+
 
 QT_FORWARD_DECLARE_CLASS(QOpenGLTexture);
 
-typedef struct Pose
+// view and display state as set on the GUI thread, the render thread
+// copies the newest one into its own members before drawing
+typedef struct ViewParams
 {
-	glm::mat4 T_WS;
-	double timestamp;
-} Pose;
+	int th, ph;
+	double dim;
+	glm::vec3 center;   // view center while not tracking the pose
+	bool mode, axes, disp_sky, disp_inactive_lmrks, pose_track,
+	     disp_prev_poses, lmrk_lights, multi_view, show_profiler;
+	double lmrk_lwr_bound;
+	bool time_window;   // only landmarks seen between time_from and time_to
+	double time_from, time_to;
+	int width, height;
+	int textures;       // switchTexture presses so far
+	int picks;          // left clicks so far, the last one at pick_pos
+	QPoint pick_pos;
+	long tick;          // replay ticks to have run
+	long serial;        // bumped by every change except ticks
+	bool export_frame;  // draw this tick into the exporter
+} ViewParams;
 
-typedef struct Landmark
+// a finished frame for the widget to composite
+typedef struct FrameOut
 {
-	glm::vec3 point;
-	double timestamp;
-	double quality;
-} Landmark;
+	QOpenGLFramebufferObject *fbo;
+	GLsync drawn; // fenced by the render thread after drawing
+	GLsync shown; // fenced by the widget after compositing
+	std::vector<Label> labels;
+} FrameOut;
 
-class SlamViz : public QGLWidget, protected QGLFunctions, protected QOpenGLFunctions
+class SlamViz : public QOpenGLWidget, protected QOpenGLFunctions
 {
 Q_OBJECT
 private:
@@ -65,8 +120,20 @@ private:
 	bool disp_inactive_lmrks;
 	bool pose_track;
 	bool disp_prev_poses;
+	bool static_shadow_dirty; // inactive casters or the light changed since the static layer was drawn
+	bool lmrk_lights;  // landmarks are light sources
+	bool multi_view;   // orbit, top-down, chase and cockpit views
+	bool show_profiler;
+	bool headless;     // no window, replay as fast as frames can be exported
+	bool export_frame; // the frame being drawn goes to the exporter
 	double lmrk_lwr_bound;
+	bool time_window;
+	double time_from, time_to;
 	QPoint pos;
+	int frame_w, frame_h;
+	int textures, picks;  // as far as the render thread has applied them
+	long serial;          // of the last adopted ViewParams
+	GLuint target_fbo;    // framebuffer the current frame is drawn into
 	double dim;
 	double asp;
 	double v_x,v_y,v_z; // current view center
@@ -84,6 +151,10 @@ private:
 	int ambient, diffuse, specular, distance, zh,
 			local, emission, shiny, inc, shadowdim;
 	unsigned int framebuf;
+	unsigned int shadowtex;
+	unsigned int static_framebuf;  // depth of the inactive landmarks only
+	unsigned int static_shadowtex;
+	int shadow_max;      // largest shadow map the context allows, up to 2048
 	airplane* plane;
 	Star* star;
 	SmokeBB* smoke;
@@ -95,14 +166,94 @@ private:
 	Pose cur_pose;
 	std::vector<Pose> prev_poses;
 	std::map<unsigned long, Landmark> lmrks;
-	std::map<unsigned long, Landmark> inactive_lmrks;
+	PackedLandmarks inactive_lmrks;  // marginalized, 16 bytes each
+	FrameTable frame_table;          // log frame stamps the packed ones index
+	TimeIndex times;                 // first and last frame each landmark was seen in
+	std::vector<unsigned long> window_ids; // seen in the time window, this frame
+	LandmarkBVH *lmrk_bvh;           // landmark spheres for picking and occlusion
+	bool picked;
+	unsigned long picked_id;
+
+	std::vector<Label> labels;
+	TextRenderer *glyphs;      // render thread
+	TextRenderer *gui_glyphs;  // widget context
+	bool label_lmrks;          // -labels: landmark ids and pose stamps
+	std::vector<ViewCam> views;
+	ViewCam shadow_cam;              // light view for the shadow map
+	SceneGraph *graph;               // cached world matrices of pose, plane and landmarks
+	int plane_node;
+	std::vector<DrawItem> draw_list; // landmarks visible in any view or the light
+	unsigned int shadow_bit;         // draw list view bit of shadow_cam
+	std::vector<unsigned char> lmrk_lod; // per draw list entry for the view being drawn
+	JobSystem *jobs;
+	GLuint inst_buf[2];              // star matrices and point positions
+	GLuint shadow_buf;               // shadow caster star matrices
+	size_t shadow_bytes;
+	std::vector<float> caster_mats;
+	double shadow_min_texels;        // 0 draws every caster in the light frustum
+	HiZBuffer *hiz;                  // occluders of the first view
+	bool occlusion;                  // off with -no-occlusion
+	GLuint hiz_fbo, hiz_tex;
+	int hiz_w, hiz_h;
+	std::vector<float> hiz_depth;
+	long hiz_tested, hiz_hidden;     // first view landmarks, and those occluded
+	bool want_core;                  // -core
+	CoreRenderer *renderer;          // NULL draws the scene fixed-function
+	RenderList scene_list;
+	RenderMesh *star_mesh, *star_depth_mesh, *point_mesh;
+	bool core_pass;                  // drawInstanced fills scene_list instead of drawing
+	bool bg_cache;                   // off with -no-bg-cache
+	bool bg_active;                  // the frame being drawn goes over the cached layer
+	bool bg_dirty;                   // camera or static set changed since it was drawn
+	bool bg_sky;
+	glm::mat4 bg_view_proj;          // first view when it was drawn
+	QOpenGLFramebufferObject *bg_fbo;
+	int layer;                       // LAYER_*, what drawView draws
 
 	QOpenGLShaderProgram *shadow_shader;
 	QOpenGLFunctions *glFuncs;
+	GLUploader *uploader;
+	FrameProfiler *profiler;
+	MemoryBudget *memory;
+	QualityGovernor *governor;
+	double render_scale;  // of the frame being drawn, relative to the window
+	QSize drawn_size;     // pixels the views were last laid out over
+	GLState *state;       // render thread only
+	QString spill_path;      // inactive landmarks spilled past the soft limit
+	TileStore *tiles;        // NULL unless run with -tiles
+	size_t tile_budget;      // resident tile landmarks
+	long tile_frame;         // frames paged so far, the LRU clock
+	glm::vec3 tile_eye;      // first view's eye when last paged
+	std::ofstream *spill_file;
+	size_t inst_bytes[2], cluster_bytes[3], frame_bytes;
+	AssetLoader *loader;
+	FrameExporter *exporter; // NULL unless run with -export
+	InputLog *input;         // -record and -play
+	CameraPath *cam_path;    // -camera
+	long tick;               // replay ticks run so far
+	std::atomic<bool> replay_done; // both logs are exhausted
+
+	// the GUI thread only touches gui, pos and the mouse buttons,
+	// everything else belongs to the render thread
+	ViewParams gui;
+	TripleBuffer<ViewParams> params;
+	TripleBuffer<FrameOut> frames;
+	RenderThread *render;
+	std::atomic<bool> render_ready;
+	QSemaphore frame_done;   // released after each exported frame
+	bool export_waiting;     // GUI thread: an exported frame is still being drawn
+	QOpenGLFunctions_3_3_Compatibility *gl33; // NULL if 3.3 is unavailable
+
+	QOpenGLShaderProgram *cluster_shader;
+	LightClusters *clusters;
+	std::vector<ClusterLight> lmrk_light_list;
+	GLuint cluster_buf[3]; // lights, cluster table, light indices
+	GLuint cluster_tex[3];
 
 
 public:
 	SlamViz(QWidget* parent=0);
+	~SlamViz();
 	QSize sizeHint() const {return QSize(400,400);}
 
 public slots:
@@ -115,12 +266,19 @@ public slots:
   	void toggleSky(void);
   	void setLmrkDispBound(double bound);
   	void toggleInactive(void);
+  	void toggleTimeWindow(void);
+  	void setTimeFrom(double stamp);
+  	void setTimeTo(double stamp);
   	void togglePoseTrack(void);
   	void togglePrevPoses(void);
+  	void toggleLmrkLights(void);
+  	void toggleMultiView(void);
+  	void toggleProfiler(void);
 
 signals:
 	void angles(QString text); // Signal for display angles
 	void dimen(QString text);    // Signal for display dimensions
+	void pickInfo(QString text); // Signal for the picked landmark
 
 protected:
 	void initializeGL();											// Initialize widget
@@ -139,14 +297,53 @@ private:
 	void readPose();
 	void readLmrks();
 	void drawAxes(double len, bool draw_labels);
+	void addLabel(double x, double y, double z, const QString &text, int priority);
+	void addLabel(const ViewCam &cam, const glm::vec3 &world, const QString &text, int priority);
+	void labelScene(const ViewCam &cam, unsigned int bit);
 	void addToPrevPoses();
+	void recordInput(const QString &name, const QStringList &args=QStringList());
+	void replayInput(const InputEvent &event);
+	void followCameraPath();
+	void publish(bool changed=true);
+	void initRender();
+	void renderFrame();
+	void releaseRender();
+	bool adoptParams(const ViewParams &p);
+	bool advance();
+	void accountMemory();
+	void enforceBudget();
+	void decimateTrajectory();
+	void dropInactive(size_t count, bool spill);
+	void pageTiles();
+	bool pageOutTile(int tile);
+	void drawFrame(bool to_export);
+	void pick(QPoint p);
+	void drawPicked();
+	bool pickable(unsigned long id);
+	bool inWindow(uint32_t slot) const;
 
 	void initShaders();
 	void initMap();
+	void applyQuality();
 	void shadowMap(void);
+	void drawCasters(const ViewCam &light, bool inactive);
+	void drawDepthCasters(const ViewCam &cam, bool with_plane);
+	bool coreMeshes();
+	void drawCore(const ViewCam &cam, unsigned int bit);
+	void drawBackground(QSize size);
+	bool inLayer(const DrawItem &item) const
+	{return layer == LAYER_ALL || item.active == (layer == LAYER_DYNAMIC);}
 	void Light(bool light);
-	void Scene(bool light);
-	void dispLandmarks();
+	void Scene(bool light, unsigned int view=0);
+	void dispLandmarks(unsigned int view=0);
+	void setupViews(int width, int height);
+	void buildDrawList();
+	void occlusionCull();
+	void drawView(const ViewCam &cam, unsigned int bit);
+	void drawInstanced(const ViewCam &cam, unsigned int bit);
+	void initClusters();
+	void updateClusters(const ViewCam &cam, unsigned int bit);
+	void bindClusters();
 };
 
 #endif
\ No newline at end of file
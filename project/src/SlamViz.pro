@@ -2,11 +2,11 @@
 #  Andrew Kramer
 #
 #  List of header files
-HEADERS = viewer.h SlamViz.h airplane.h Star.h SmokeBB.h CSCIx229.h
+HEADERS = viewer.h SlamViz.h airplane.h Star.h SmokeBB.h GLUploader.h TexCache.h AssetLoader.h ObjMesh.h LightClusters.h MultiView.h FrameProfiler.h MemoryBudget.h QualityGovernor.h GLState.h LandmarkBVH.h TextRenderer.h SceneGraph.h SlamLog.h HiZBuffer.h TileStore.h TimeIndex.h CoreRenderer.h FrameExporter.h InputLog.h CameraPath.h JobSystem.h TripleBuffer.h RenderThread.h CSCIx229.h
 #  List of source files
-SOURCES = main.cpp viewer.cpp SlamViz.cpp airplane.cpp Star.cpp SmokeBB.cpp errcheck.cpp fatal.cpp
-#  Include OpenGL support
-QT += opengl
+SOURCES = main.cpp viewer.cpp SlamViz.cpp airplane.cpp Star.cpp SmokeBB.cpp GLUploader.cpp TexCache.cpp AssetLoader.cpp ObjMesh.cpp LightClusters.cpp MultiView.cpp FrameProfiler.cpp MemoryBudget.cpp QualityGovernor.cpp GLState.cpp LandmarkBVH.cpp TextRenderer.cpp SceneGraph.cpp SlamLog.cpp HiZBuffer.cpp TileStore.cpp TimeIndex.cpp CoreRenderer.cpp FrameExporter.cpp InputLog.cpp CameraPath.cpp JobSystem.cpp RenderThread.cpp errcheck.cpp fatal.cpp
+#  Include OpenGL support (QOpenGLWidget needs Qt 5.6 or later)
+QT += widgets
 unix:!macx{
 	LIBS += -lGLU -lglut
 }
@@ -1,24 +1,42 @@
 #include "SmokeBB.h"
 
-SmokeBB::SmokeBB()
+SmokeBB::SmokeBB(AssetLoader *loader, GLState *state)
 {
-	smoke_tex = new QOpenGLTexture(QImage(QString("smoke_tex.png")));
+	this->state = state;
+	smoke_tex = NULL;
+	loader->loadTexture(QString("smoke_tex.png"), &smoke_tex);
 }
 
 void SmokeBB::DrawSmoke(float cam_x, float cam_y, float cam_z,
 			  	   		float obj_pos_x, float obj_pos_y, 
 			  	   		float obj_pos_z, float scale)
 {
-	float look_at[3], obj_to_cam_proj[3], obj_to_cam[3], up_aux[3];
-	float angle_cosine;
+	float cam[3] = {cam_x, cam_y, cam_z};
+	float obj[3] = {obj_pos_x, obj_pos_y, obj_pos_z};
+	float turn[4], tilt[4];
+	orient(cam, obj, turn, tilt);
 
 	glPushMatrix();
+	if (turn[0]) glRotatef(turn[0], turn[1], turn[2], turn[3]);
+	if (tilt[0]) glRotatef(tilt[0], tilt[1], tilt[2], tilt[3]);
+	//glTranslated(obj_pos_x, obj_pos_y, obj_pos_z);
 	
+	DrawObject(scale);
+
+	glPopMatrix();
+}
+
+void SmokeBB::orient(const float *cam, const float *obj, float *turn, float *tilt)
+{
+	float look_at[3], obj_to_cam_proj[3], obj_to_cam[3], up_aux[3];
+	float angle_cosine;
+
+	turn[0] = tilt[0] = 0;
 
 	// calculate vector from local origin to camera projected in xz
-	obj_to_cam_proj[0] = cam_x - obj_pos_x;
+	obj_to_cam_proj[0] = cam[0] - obj[0];
 	obj_to_cam_proj[1] = 0;
-	obj_to_cam_proj[2] = cam_z - obj_pos_z;
+	obj_to_cam_proj[2] = cam[2] - obj[2];
 
 	// original look-at vector for object in world coordinates
 	look_at[0] = 0;
@@ -36,13 +54,17 @@ void SmokeBB::DrawSmoke(float cam_x, float cam_y, float cam_z,
 
 	// perform rotation
 	if ((angle_cosine < 0.9999) && (angle_cosine > -0.9999))
-		glRotatef(acos(angle_cosine)*180.0/3.1415, 
-					up_aux[0], up_aux[1], up_aux[2]);
+	{
+		turn[0] = acos(angle_cosine)*180.0/3.1415;
+		turn[1] = up_aux[0];
+		turn[2] = up_aux[1];
+		turn[3] = up_aux[2];
+	}
 
 	// get vector from object to camera in 3D
-	obj_to_cam[0] = cam_x - obj_pos_x;
-	obj_to_cam[1] = cam_y - obj_pos_y;
-	obj_to_cam[2] = cam_z - obj_pos_z;
+	obj_to_cam[0] = cam[0] - obj[0];
+	obj_to_cam[1] = cam[1] - obj[1];
+	obj_to_cam[2] = cam[2] - obj[2];
 
 	Normalize(obj_to_cam);
 
@@ -52,24 +74,19 @@ void SmokeBB::DrawSmoke(float cam_x, float cam_y, float cam_z,
 	// tilt upward
 	if ((angle_cosine < 0.9999) && (angle_cosine > -0.9999))
 	{
-		if (obj_to_cam[1] < 0)
-			glRotatef(acos(angle_cosine)*180.0/3.1415,1,0,0);
-		else
-			glRotatef(acos(angle_cosine)*180.0/3.1415,-1,0,0);
+		tilt[0] = acos(angle_cosine)*180.0/3.1415;
+		tilt[1] = obj_to_cam[1] < 0 ? 1 : -1;
+		tilt[2] = tilt[3] = 0;
 	}
-	//glTranslated(obj_pos_x, obj_pos_y, obj_pos_z);
-	
-	DrawObject(scale);
-
-	glPopMatrix();
 }
 
 void SmokeBB::DrawObject(float scale)
 {
-	glEnable(GL_TEXTURE_2D);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	smoke_tex->bind();
+	// left set until release(), so only the first puff changes state
+	state->enable(GL_TEXTURE_2D);
+	state->enable(GL_BLEND);
+	state->blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state->bindTexture(smoke_tex);
 	glScalef(scale,scale,scale);
 	glColor4f(1.0,1.0,1.0,1.0);
 	//glColor3f(1.0,1.0,1.0);
@@ -82,9 +99,12 @@ void SmokeBB::DrawObject(float scale)
 		glVertex3d(0.5*Cosd(th),0.5*Sind(th),0.0);
 	}
 	glEnd();
-	smoke_tex->release();
-	glDisable(GL_BLEND);
-	glDisable(GL_TEXTURE_2D);
+}
+
+void SmokeBB::release()
+{
+	state->disable(GL_BLEND);
+	state->disable(GL_TEXTURE_2D);
 }
 
 void SmokeBB::Normalize(float *a)
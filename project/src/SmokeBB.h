@@ -8,19 +8,27 @@
 #include <glm/glm.hpp>
 #include <glm/matrix.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "AssetLoader.h"
+#include "GLState.h"
 
 class SmokeBB
 {
 public:
-	SmokeBB();
+	SmokeBB(AssetLoader *loader, GLState *state);
 	void DrawSmoke(float cam_x, float cam_y, float cam_z,
 			  	   float obj_pos_x, float obj_pos_y, 
 			  	   float obj_pos_z, float scale);
+	// rotations, angle in degrees then axis, that turn a puff at obj
+	// to face cam; an angle of 0 means no rotation
+	static void orient(const float *cam, const float *obj, float *turn, float *tilt);
+	const QOpenGLTexture *texture() const {return smoke_tex;}
+	void release(); // after a run of DrawSmoke calls
 private:
 	QOpenGLTexture *smoke_tex;
-	void Normalize(float *a);
-	void CrossProduct(float *a, float *b, float *c);
-	float InnerProduct(float *a, float *b);
+	GLState *state;
+	static void Normalize(float *a);
+	static void CrossProduct(float *a, float *b, float *c);
+	static float InnerProduct(float *a, float *b);
 	void DrawObject(float scale);
 };
 
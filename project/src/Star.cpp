@@ -1,103 +1,76 @@
 #include "Star.h"
+#include <memory>
 
-Star::Star()
+Star::Star(AssetLoader *loader, QOpenGLFunctions *GLFuncs, GLState *state)
 {
-	star_tex = new QOpenGLTexture(QImage(QString("star_tex.jpg")));
-	loadOBJ("star.obj", star_vertices, star_uvs, star_normals);
-}
-
-void Star::loadOBJ(const char *path, std::vector<glm::vec3> &out_vertices,
-		std::vector<glm::vec2> &out_uvs, std::vector<glm::vec3> &out_normals)
-{
-	std::ifstream obj_file;
-	obj_file.open(path);
-	std::string line;
-
-	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices;
-	std::vector<glm::vec2> temp_uvs;
-	std::vector<glm::vec3> temp_normals;
-
-
-	while(std::getline(obj_file, line))
+	glFuncs = GLFuncs;
+	this->state = state;
+	star_tex = NULL;
+	star_vbo = star_ibo = star_pos_vbo = 0;
+	star_count = 0;
+	mesh_bytes = 0;
+	inst_shader = NULL;
+	depth_shader = NULL;
+	gl33 = NULL;
+	loader->loadTexture(QString("star_tex.jpg"), &star_tex);
+	loader->run(QString("star.obj"), [this,loader]()
 	{
-		std::istringstream ss(line);
-		std::string token;
-		std::getline(ss, token, ' ');
-
-		// if line describes a vertex
-		if (token == "v")
-		{
-			glm::vec3 vertex;
-			for (int i = 0; i < 3; i++)
-			{
-				std::getline(ss, token, ' ');
-				vertex[i] = std::stof(token);
-			}
-			temp_vertices.push_back(vertex);
-		}
-		// if line describes a uv
-		else if (token == "vt")
+		std::shared_ptr<Mesh> mesh(new Mesh);
+		std::shared_ptr<GLuint> bufs(new GLuint[3], std::default_delete<GLuint[]>());
+		if (!loadMesh("star.obj", *mesh))
 		{
-			glm::vec2 uv;
-			for (int i = 0; i < 2; i++)
-			{
-				std::getline(ss, token, ' ');
-				uv[i] = std::stof(token);
-			}
-			temp_uvs.push_back(uv);
+			std::cerr << "Could not load star.obj\n";
+			return;
 		}
-		// if line describes a normal
-		else if (token == "vn")
+		std::shared_ptr<std::vector<float> > pos(new std::vector<float>);
+		for (unsigned int i = 0; i < mesh->vertices.size(); i += MESH_STRIDE)
+			pos->insert(pos->end(), mesh->vertices.begin()+i, mesh->vertices.begin()+i+3);
+		loader->gl->upload([mesh,bufs,pos](QOpenGLExtraFunctions *f)
 		{
-			glm::vec3 normal;
-			for (int i = 0; i < 3; i++)
-			{
-				std::getline(ss, token, ' ');
-				normal[i] = std::stof(token);
-			}
-			temp_normals.push_back(normal);
-		}
-		else if (token == "f")
+			f->glGenBuffers(3, bufs.get());
+			f->glBindBuffer(GL_ARRAY_BUFFER, bufs.get()[0]);
+			f->glBufferData(GL_ARRAY_BUFFER, mesh->vertices.size()*sizeof(float),
+				mesh->vertices.data(), GL_STATIC_DRAW);
+			f->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs.get()[1]);
+			f->glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->indices.size()*sizeof(unsigned int),
+				mesh->indices.data(), GL_STATIC_DRAW);
+			f->glBindBuffer(GL_ARRAY_BUFFER, bufs.get()[2]);
+			f->glBufferData(GL_ARRAY_BUFFER, pos->size()*sizeof(float), pos->data(), GL_STATIC_DRAW);
+			f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+			f->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		},
+		[this,mesh,bufs,pos]()
 		{
-			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			for (int i = 0; i < 3; i++)
-			{
-				std::getline(ss, token, ' ');
-				std::istringstream ss2(token);
-				std::string index;
-				std::getline(ss2, index, '/');
-				vertexIndex[i] = std::stoul(index);
-				std::getline(ss2, index, '/');
-				uvIndex[i] = std::stoul(index);
-				std::getline(ss2, index, '/');
-				normalIndex[i] = std::stoul(index);
-			}
-			std::cerr << std::endl;
-			for (int i = 0; i < 3; i++)
-			{
-				vertexIndices.push_back(vertexIndex[i]);
-				uvIndices.push_back(uvIndex[i]);
-				normalIndices.push_back(normalIndex[i]);
-			}
-		}
-	}
-
-	// process data read from file
-	for (unsigned int i = 0; i < vertexIndices.size(); i++)
-	{
-		unsigned int vertexIndex = vertexIndices[i];
-		glm::vec3 vertex = temp_vertices[vertexIndex - 1];
-		out_vertices.push_back(vertex);
-
-		unsigned int uvIndex = uvIndices[i];
-		glm::vec2 uv = temp_uvs[uvIndex - 1];
-		out_uvs.push_back(uv);
+			star_vbo = bufs.get()[0];
+			star_ibo = bufs.get()[1];
+			star_pos_vbo = bufs.get()[2];
+			star_count = mesh->indices.size();
+			mesh_bytes = (mesh->vertices.size() + pos->size())*sizeof(float) +
+			             mesh->indices.size()*sizeof(unsigned int);
+		});
+	});
+}
 
-		unsigned int normalIndex = normalIndices[i];
-		glm::vec3 normal = temp_normals[normalIndex - 1];
-		out_normals.push_back(normal);
-	}
+//
+//  Model matrix for a star at c facing d with up u, column major
+//
+void Star::facing(const float *c, const float *d, const float *u, float scale, float *m)
+{
+	//  Unit vector for facing direction
+	float D0 = sqrtf(d[0]*d[0]+d[1]*d[1]+d[2]*d[2]);
+	float X0 = d[0]/D0, Y0 = d[1]/D0, Z0 = d[2]/D0;
+	//  Unit vector in "up" direction
+	float D1 = sqrtf(u[0]*u[0]+u[1]*u[1]+u[2]*u[2]);
+	float X1 = u[0]/D1, Y1 = u[1]/D1, Z1 = u[2]/D1;
+	//  Cross product gives the third vector
+	float X2 = Y0*Z1-Y1*Z0;
+	float Y2 = Z0*X1-Z1*X0;
+	float Z2 = X0*Y1-X1*Y0;
+	//  translate * rotate 90 about z * facing rotation * scale
+	m[0] = -Y0*scale;  m[4] = -Y1*scale;  m[ 8] = -Y2*scale;  m[12] = c[0];
+	m[1] =  X0*scale;  m[5] =  X1*scale;  m[ 9] =  X2*scale;  m[13] = c[1];
+	m[2] =  Z0*scale;  m[6] =  Z1*scale;  m[10] =  Z2*scale;  m[14] = c[2];
+	m[3] =  0;         m[7] =  0;         m[11] =  0;         m[15] = 1;
 }
 
 void Star::drawStar(double cx, double cy, double cz, 
@@ -105,53 +78,203 @@ void Star::drawStar(double cx, double cy, double cz,
 								double ux, double uy, double uz,
 								double scale)
 {
-	//  Unit vector for facing direction
-  double D0 = sqrt(dx*dx+dy*dy+dz*dz);
-  double X0 = dx/D0;
-  double Y0 = dy/D0;
-  double Z0 = dz/D0;
-  //  Unit vector in "up" direction
-  double D1 = sqrt(ux*ux+uy*uy+uz*uz);
-  double X1 = ux/D1;
-  double Y1 = uy/D1;
-  double Z1 = uz/D1;
-  //  Cross product gives the third vector
-  double X2 = Y0*Z1-Y1*Z0;
-  double Y2 = Z0*X1-Z1*X0;
-  double Z2 = X0*Y1-X1*Y0;
-  //  Rotation matrix
-  double mat[16];
-  mat[0] = X0;   mat[4] = X1;   mat[ 8] = X2;   mat[12] = 0;
-  mat[1] = Y0;   mat[5] = Y1;   mat[ 9] = Y2;   mat[13] = 0;
-  mat[2] = Z0;   mat[6] = Z1;   mat[10] = Z2;   mat[14] = 0;
-  mat[3] =  0;   mat[7] =  0;   mat[11] =  0;   mat[15] = 1;
+	float c[3] = {(float)cx, (float)cy, (float)cz};
+	float d[3] = {(float)dx, (float)dy, (float)dz};
+	float u[3] = {(float)ux, (float)uy, (float)uz};
+	float mat[16];
+	facing(c, d, u, scale, mat);
+
+	// save current transforms, the mesh stays bound until release()
+	// so the state cache drops the binds for every star after the first
+	glPushMatrix();
+	glMultMatrixf(mat);
+	if (star_vbo)
+	{
+		bindMesh();
+		glDrawElements(GL_TRIANGLES, star_count, GL_UNSIGNED_INT, (void*)0);
+	}
+	glPopMatrix();
+}
+
+bool Star::buffers(GLuint *vbo, GLuint *pos_vbo, GLuint *ibo, GLsizei *count) const
+{
+	if (!star_vbo) return false;
+	*vbo = star_vbo;
+	*pos_vbo = star_pos_vbo;
+	*ibo = star_ibo;
+	*count = star_count;
+	return true;
+}
+
+void Star::release()
+{
+	releaseMesh();
+}
+
+//
+//  Set up texture and client arrays for the star mesh
+//
+void Star::bindMesh()
+{
+	GLsizei stride = MESH_STRIDE*sizeof(float);
+	state->enable(GL_TEXTURE_2D);
+	state->bindTexture(star_tex);
+	state->bindBuffer(GL_ARRAY_BUFFER, star_vbo);
+	state->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, star_ibo);
+	state->clientState(GL_VERTEX_ARRAY, true);
+	state->clientState(GL_TEXTURE_COORD_ARRAY, true);
+	state->clientState(GL_NORMAL_ARRAY, true);
+	glVertexPointer(3, GL_FLOAT, stride, (void*)0);
+	glTexCoordPointer(2, GL_FLOAT, stride, (void*)(3*sizeof(float)));
+	glNormalPointer(GL_FLOAT, stride, (void*)(5*sizeof(float)));
+}
 
-  //float em[] = {1,1,1,1};
+void Star::releaseMesh()
+{
+	// the texture stays bound, texturing is switched by the enable
+	state->clientState(GL_NORMAL_ARRAY, false);
+	state->clientState(GL_TEXTURE_COORD_ARRAY, false);
+	state->clientState(GL_VERTEX_ARRAY, false);
+	state->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	state->bindBuffer(GL_ARRAY_BUFFER, 0);
+	state->disable(GL_TEXTURE_2D);
+}
 
-  // save current transforms
-  glPushMatrix();
+//
+//  Compile the instancing shader, instanced drawing stays off
+//  without a 3.3 context
+//
+void Star::initInstancing(QOpenGLFunctions_3_3_Compatibility *gl)
+{
+	gl33 = gl;
+	if (!gl33) return;
+	inst_shader = new QOpenGLShaderProgram();
+	if (!inst_shader->addShaderFromSourceFile(QOpenGLShader::Vertex, "star.vert") ||
+	    !inst_shader->addShaderFromSourceFile(QOpenGLShader::Fragment, "star.frag") ||
+	    !inst_shader->link())
+	{
+		std::cerr << "Instanced stars disabled: " << inst_shader->log().toStdString() << std::endl;
+		delete inst_shader;
+		inst_shader = NULL;
+	}
+	depth_shader = new QOpenGLShaderProgram();
+	if (!depth_shader->addShaderFromSourceFile(QOpenGLShader::Vertex, "star_depth.vert") ||
+	    !depth_shader->addShaderFromSourceFile(QOpenGLShader::Fragment, "star_depth.frag") ||
+	    !depth_shader->link())
+	{
+		std::cerr << "Instanced star shadows disabled: " << depth_shader->log().toStdString() << std::endl;
+		delete depth_shader;
+		depth_shader = NULL;
+	}
+}
 
-  // offset, scale and rotate
-  glTranslated(cx,cy,cz);
-  glRotated(90,0.,0.,1.);
-  glMultMatrixd(mat);
-  glScaled(scale, scale, scale);
+//
+//  Draw count stars in one call, the shader turns each StarInstance
+//  into the facing() matrix toward origin
+//
+void Star::drawInstances(GLuint buffer, int count, const float *origin, float step)
+{
+	if (!count || !instanced()) return;
+	state->useProgram(inst_shader);
+	state->setUniform(inst_shader, "tex", 0);
+	state->setUniform(inst_shader, "Origin", QVector4D(origin[0], origin[1], origin[2], step));
+	bindMesh();
+	state->bindBuffer(GL_ARRAY_BUFFER, buffer);
+	gl33->glEnableVertexAttribArray(STAR_INSTANCE_ATTRIB);
+	gl33->glVertexAttribPointer(STAR_INSTANCE_ATTRIB, 3, GL_SHORT, GL_FALSE,
+	                            sizeof(StarInstance), (void*)offsetof(StarInstance, p));
+	gl33->glVertexAttribDivisor(STAR_INSTANCE_ATTRIB, 1);
+	gl33->glEnableVertexAttribArray(STAR_QUALITY_ATTRIB);
+	gl33->glVertexAttribPointer(STAR_QUALITY_ATTRIB, 1, GL_UNSIGNED_BYTE, GL_TRUE,
+	                            sizeof(StarInstance), (void*)offsetof(StarInstance, quality));
+	gl33->glVertexAttribDivisor(STAR_QUALITY_ATTRIB, 1);
+	gl33->glDrawElementsInstanced(GL_TRIANGLES, star_count, GL_UNSIGNED_INT, (void*)0, count);
+	for (int i = STAR_INSTANCE_ATTRIB; i <= STAR_QUALITY_ATTRIB; i++)
+	{
+		gl33->glVertexAttribDivisor(i, 0);
+		gl33->glDisableVertexAttribArray(i);
+	}
+	releaseMesh();
+	state->useProgram(NULL);
+}
 
+//
+//  Stars too small to see are drawn as points, buffer holds StarInstances
+//
+void Star::drawPoints(GLuint buffer, int count, const float *origin, float step)
+{
+	if (!count) return;
+	glPushMatrix();
+	glTranslatef(origin[0], origin[1], origin[2]);
+	glScalef(step, step, step);
+	state->bindBuffer(GL_ARRAY_BUFFER, buffer);
+	state->clientState(GL_VERTEX_ARRAY, true);
+	glVertexPointer(3, GL_SHORT, sizeof(StarInstance), (void*)offsetof(StarInstance, p));
+	glPointSize(2);
+	glDrawArrays(GL_POINTS, 0, count);
+	glPointSize(1);
+	state->clientState(GL_VERTEX_ARRAY, false);
+	state->bindBuffer(GL_ARRAY_BUFFER, 0);
+	glPopMatrix();
+}
 
+//
+//  Position-only client arrays for depth passes
+//
+void Star::bindDepthMesh()
+{
+	state->bindBuffer(GL_ARRAY_BUFFER, star_pos_vbo);
+	state->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, star_ibo);
+	state->clientState(GL_VERTEX_ARRAY, true);
+	glVertexPointer(3, GL_FLOAT, 0, (void*)0);
+}
 
-  glEnable(GL_TEXTURE_2D);
-  //glMaterialfv(GL_FRONT_AND_BACK,GL_EMISSION,em);
-  star_tex->bind();
-  glBegin(GL_TRIANGLES);
-  for (int i = 0; i < star_vertices.size(); i++)
-  {
-  	glNormal3f(star_normals[i][0],star_normals[i][1],star_normals[i][2]);
-  	glTexCoord2f(star_uvs[i][0],star_uvs[i][1]);
-  	glVertex3f(star_vertices[i][0],star_vertices[i][1],star_vertices[i][2]);
-  }
-  glEnd();
-  star_tex->release();
-  glDisable(GL_TEXTURE_2D);
+void Star::releaseDepthMesh()
+{
+	state->clientState(GL_VERTEX_ARRAY, false);
+	state->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	state->bindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-  glPopMatrix();
-}
\ No newline at end of file
+//
+//  Depth-only stars in one call, buffer holds a facing() matrix per star
+//
+void Star::drawDepthInstances(GLuint buffer, int count)
+{
+	if (!count || !depthInstanced()) return;
+	state->useProgram(depth_shader);
+	bindDepthMesh();
+	state->bindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (int i = 0; i < 4; i++)
+	{
+		gl33->glEnableVertexAttribArray(STAR_INSTANCE_ATTRIB+i);
+		gl33->glVertexAttribPointer(STAR_INSTANCE_ATTRIB+i, 4, GL_FLOAT, GL_FALSE,
+		                            16*sizeof(float), (void*)(4*i*sizeof(float)));
+		gl33->glVertexAttribDivisor(STAR_INSTANCE_ATTRIB+i, 1);
+	}
+	gl33->glDrawElementsInstanced(GL_TRIANGLES, star_count, GL_UNSIGNED_INT, (void*)0, count);
+	for (int i = 0; i < 4; i++)
+	{
+		gl33->glVertexAttribDivisor(STAR_INSTANCE_ATTRIB+i, 0);
+		gl33->glDisableVertexAttribArray(STAR_INSTANCE_ATTRIB+i);
+	}
+	releaseDepthMesh();
+	state->useProgram(NULL);
+}
+
+//
+//  Depth-only stars one draw each, mats holds count facing() matrices
+//
+void Star::drawDepth(const float *mats, int count)
+{
+	if (!count || !star_pos_vbo) return;
+	bindDepthMesh();
+	for (int i = 0; i < count; i++)
+	{
+		glPushMatrix();
+		glMultMatrixf(mats + 16*i);
+		glDrawElements(GL_TRIANGLES, star_count, GL_UNSIGNED_INT, (void*)0);
+		glPopMatrix();
+	}
+	releaseDepthMesh();
+}
@@ -6,23 +6,69 @@
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <stdint.h>
+#include <stddef.h>
 #include <QOpenGLTexture>
+#include <QOpenGLFunctions>
+#include <QOpenGLFunctions_3_3_Compatibility>
+#include <QOpenGLShaderProgram>
+#include "AssetLoader.h"
+#include "ObjMesh.h"
+#include "GLState.h"
+
+#define STAR_RADIUS 8.0        // star.obj extent at scale 1
+#define STAR_INSTANCE_ATTRIB 4 // StarInstance position, or the first of four mat4 columns for
+                               // the depth shader; clear of the built-in aliases
+#define STAR_QUALITY_ATTRIB  5 // StarInstance quality, after the position at 4
+
+// one star for the instancing shader, its position in steps from an
+// origin given with the draw
+typedef struct StarInstance
+{
+	int16_t p[3];
+	uint8_t quality;  // 1/255 steps
+	uint8_t pad;
+} StarInstance;
 
 class Star
 {
 public:
-	Star();
+	Star(AssetLoader *loader, QOpenGLFunctions *GLFuncs, GLState *state);
 	void drawStar(double cx, double cy, double cz, 
 				  double dx, double dy, double dz,
 				  double ux, double uy, double uz, double scale);
+	void release(); // after a run of drawStar calls
+	static void facing(const float *c, const float *d, const float *u, float scale, float *m);
+	void initInstancing(QOpenGLFunctions_3_3_Compatibility *gl);
+	bool instanced() const {return inst_shader && star_vbo;}
+	// buffer holds StarInstances facing center, origin+step*p
+	void drawInstances(GLuint buffer, int count, const float *origin, float step);
+	void drawPoints(GLuint buffer, int count, const float *origin, float step);
+	// depth passes only need positions, so they read a separate
+	// position-only copy of the mesh and skip texturing
+	bool depthInstanced() const {return depth_shader && star_pos_vbo;}
+	void drawDepthInstances(GLuint buffer, int count);
+	void drawDepth(const float *mats, int count); // fixed-function fallback
+	const QOpenGLTexture *texture() const {return star_tex;}
+	// mesh buffers for other renderers, false until uploaded
+	bool buffers(GLuint *vbo, GLuint *pos_vbo, GLuint *ibo, GLsizei *count) const;
+	size_t meshBytes() const {return mesh_bytes;}
 private:
-	std::vector<glm::vec3> star_vertices;
-	std::vector<glm::vec2> star_uvs;
-	std::vector<glm::vec3> star_normals;
 	QOpenGLTexture *star_tex;
+	GLuint star_vbo, star_ibo; // indexed mesh, 0 until loaded and uploaded
+	GLuint star_pos_vbo;       // xyz only, indexed by star_ibo
+	GLsizei star_count;
+	size_t mesh_bytes;
+	QOpenGLFunctions *glFuncs;
+	GLState *state;
+	QOpenGLFunctions_3_3_Compatibility *gl33;
+	QOpenGLShaderProgram *inst_shader;
+	QOpenGLShaderProgram *depth_shader;
 
-	void loadOBJ(const char *path, std::vector<glm::vec3> &out_vertices,
-		std::vector<glm::vec2> &out_uvs, std::vector<glm::vec3> &out_normals);
+	void bindMesh();
+	void releaseMesh();
+	void bindDepthMesh();
+	void releaseDepthMesh();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,215 @@
+//
+//  Texture cache: mip chains are stored ready for glTexImage2D
+//  so a warm start never decodes an image
+//
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <algorithm>
+#include <string.h>
+#include "TexCache.h"
+
+typedef struct TexHeader
+{
+   char magic[4];
+   uint32_t width, height, format, nlevels;
+} TexHeader;
+
+//
+//  64 bit FNV-1a hash of the source file contents
+//
+uint64_t hashBytes(const QByteArray &data)
+{
+   uint64_t h = 14695981039346656037ULL;
+   const unsigned char *p = (const unsigned char*)data.constData();
+   for (int i = 0; i < data.size(); i++)
+   {
+      h ^= p[i];
+      h *= 1099511628211ULL;
+   }
+   return h;
+}
+
+QString cachePath(uint64_t hash, bool compress)
+{
+   return QString("%1/%2%3.stc").arg(TEXCACHE_DIR)
+                                .arg(hash, 16, 16, QChar('0'))
+                                .arg(compress ? "_bc1" : "");
+}
+
+//
+//  Size of one mip level as buildMips lays it out
+//
+static uint32_t levelBytes(uint32_t format, uint32_t w, uint32_t h)
+{
+   if (format == TEX_BC1) return ((w+3)/4)*((h+3)/4)*8;
+   return 4*w*h;
+}
+
+//
+//  A header or level that does not match what buildMips would have
+//  written is rejected so the caller decodes the source instead
+//
+bool readCache(const QString &path, MipImage &out)
+{
+   QFile file(path);
+   TexHeader head;
+   if (!file.open(QIODevice::ReadOnly)) return false;
+   if (file.read((char*)&head, sizeof(head)) != sizeof(head)) return false;
+   if (memcmp(head.magic, "STC1", 4) != 0) return false;
+   if (head.format != TEX_RGBA8 && head.format != TEX_BC1) return false;
+   if (head.width < 1 || head.height < 1 ||
+       head.width > TEXCACHE_MAX_SIZE || head.height > TEXCACHE_MAX_SIZE) return false;
+   // a full chain halves the larger side down to 1
+   uint32_t nlevels = 1;
+   for (uint32_t n = std::max(head.width, head.height); n > 1; n /= 2)
+      nlevels++;
+   if (head.nlevels != nlevels) return false;
+   out.width = head.width;
+   out.height = head.height;
+   out.format = head.format;
+   out.levels.clear();
+   uint32_t w = head.width, h = head.height;
+   for (unsigned int i = 0; i < head.nlevels; i++)
+   {
+      uint32_t bytes;
+      if (file.read((char*)&bytes, sizeof(bytes)) != sizeof(bytes)) return false;
+      if (bytes != levelBytes(head.format, w, h)) return false;
+      out.levels.push_back(file.read(bytes));
+      if ((uint32_t)out.levels.back().size() != bytes) return false;
+      w = std::max(1u, w/2);
+      h = std::max(1u, h/2);
+   }
+   return true;
+}
+
+bool writeCache(const QString &path, const MipImage &img)
+{
+   TexHeader head;
+   QDir().mkpath(TEXCACHE_DIR);
+   // QSaveFile renames into place so a reader never sees half a file
+   QSaveFile file(path);
+   if (!file.open(QIODevice::WriteOnly)) return false;
+   memcpy(head.magic, "STC1", 4);
+   head.width = img.width;
+   head.height = img.height;
+   head.format = img.format;
+   head.nlevels = img.levels.size();
+   file.write((const char*)&head, sizeof(head));
+   for (unsigned int i = 0; i < img.levels.size(); i++)
+   {
+      uint32_t bytes = img.levels[i].size();
+      file.write((const char*)&bytes, sizeof(bytes));
+      file.write(img.levels[i]);
+   }
+   return file.commit();
+}
+
+//
+//  RGB565 helpers for block compression
+//
+static uint16_t pack565(const int *c)
+{
+   return ((c[0]>>3)<<11) | ((c[1]>>2)<<5) | (c[2]>>3);
+}
+
+static void unpack565(uint16_t v, int *c)
+{
+   c[0] = ((v>>11)&31)*255/31;
+   c[1] = ((v>>5)&63)*255/63;
+   c[2] = (v&31)*255/31;
+}
+
+//
+//  Compress an RGBA8 level to BC1 using the block's color bounding box
+//  as endpoints, edge blocks repeat the last row/column
+//
+static QByteArray compressBC1(const unsigned char *rgba, int w, int h)
+{
+   int bw = (w+3)/4, bh = (h+3)/4;
+   QByteArray out(bw*bh*8, 0);
+   unsigned char *dst = (unsigned char*)out.data();
+   for (int by = 0; by < bh; by++)
+      for (int bx = 0; bx < bw; bx++)
+      {
+         int px[16][3];
+         int lo[3] = {255,255,255}, hi[3] = {0,0,0};
+         for (int i = 0; i < 16; i++)
+         {
+            int x = std::min(4*bx + i%4, w-1);
+            int y = std::min(4*by + i/4, h-1);
+            const unsigned char *p = rgba + 4*(y*w + x);
+            for (int k = 0; k < 3; k++)
+            {
+               px[i][k] = p[k];
+               lo[k] = std::min(lo[k], (int)p[k]);
+               hi[k] = std::max(hi[k], (int)p[k]);
+            }
+         }
+         uint16_t c0 = pack565(hi), c1 = pack565(lo);
+         uint32_t indices = 0;
+         if (c0 < c1) std::swap(c0, c1);
+         if (c0 != c1)
+         {
+            // four color mode palette
+            int pal[4][3];
+            unpack565(c0, pal[0]);
+            unpack565(c1, pal[1]);
+            for (int k = 0; k < 3; k++)
+            {
+               pal[2][k] = (2*pal[0][k] + pal[1][k])/3;
+               pal[3][k] = (pal[0][k] + 2*pal[1][k])/3;
+            }
+            for (int i = 0; i < 16; i++)
+            {
+               int best = 0, best_d = 1<<30;
+               for (int j = 0; j < 4; j++)
+               {
+                  int d = 0;
+                  for (int k = 0; k < 3; k++)
+                     d += (px[i][k]-pal[j][k])*(px[i][k]-pal[j][k]);
+                  if (d < best_d)
+                  {
+                     best_d = d;
+                     best = j;
+                  }
+               }
+               indices |= best << (2*i);
+            }
+         }
+         unsigned char *b = dst + 8*(by*bw + bx);
+         b[0] = c0 & 0xff;   b[1] = c0 >> 8;
+         b[2] = c1 & 0xff;   b[3] = c1 >> 8;
+         for (int k = 0; k < 4; k++)
+            b[4+k] = (indices >> (8*k)) & 0xff;
+      }
+   return out;
+}
+
+//
+//  Build the full mip chain, flipped to match QOpenGLTexture(QImage)
+//  uploads, and block compress it if asked and the image is opaque
+//
+void buildMips(const QImage &src, bool compress, MipImage &out)
+{
+   QImage level = src.convertToFormat(QImage::Format_RGBA8888).mirrored();
+   compress = compress && !src.hasAlphaChannel();
+   out.width = level.width();
+   out.height = level.height();
+   out.format = compress ? TEX_BC1 : TEX_RGBA8;
+   out.levels.clear();
+   while (true)
+   {
+      int w = level.width(), h = level.height();
+      const unsigned char *bits = level.constBits();
+      if (compress)
+         out.levels.push_back(compressBC1(bits, w, h));
+      else
+         out.levels.push_back(QByteArray((const char*)bits, 4*w*h));
+      if (w == 1 && h == 1) break;
+      // smooth scaling returns a premultiplied image, so convert back
+      level = level.scaled(std::max(1,w/2), std::max(1,h/2),
+                           Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                   .convertToFormat(QImage::Format_RGBA8888);
+   }
+}
@@ -0,0 +1,36 @@
+//
+// on-disk cache of decoded, pre-mipmapped texture images
+//
+
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QImage>
+#include <vector>
+#include <stdint.h>
+
+#define TEXCACHE_DIR "texcache"
+#define TEXCACHE_MAX_SIZE 16384 // larger cached sizes are treated as corrupt
+
+enum TexFormat
+{
+	TEX_RGBA8 = 0,
+	TEX_BC1 = 1    // DXT1 blocks, only used for opaque images
+};
+
+typedef struct MipImage
+{
+	int width, height; // size of level 0
+	int format;
+	std::vector<QByteArray> levels; // level 0 first, rows bottom to top
+} MipImage;
+
+uint64_t hashBytes(const QByteArray &data);
+QString cachePath(uint64_t hash, bool compress);
+bool readCache(const QString &path, MipImage &out);
+bool writeCache(const QString &path, const MipImage &img);
+void buildMips(const QImage &src, bool compress, MipImage &out);
+
+#endif
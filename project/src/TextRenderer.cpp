@@ -0,0 +1,170 @@
+//
+//  Text renderer
+//  printable ASCII is drawn once into a texture atlas of fixed size
+//  cells; a frame's labels become one quad per character in a streamed
+//  vertex buffer, drawn with a single call under an orthographic
+//  projection in label coordinates
+//
+#include <QImage>
+#include <QPainter>
+#include <QFont>
+#include <QFontMetrics>
+#include <algorithm>
+#include <math.h>
+#include "TextRenderer.h"
+
+static QFont labelFont()
+{
+   QFont font("Monospace");
+   font.setStyleHint(QFont::TypeWriter);
+   return font;
+}
+
+//
+//  Constructor, the metrics are known before there is a context
+//  so labels can be decluttered on any thread
+//
+TextRenderer::TextRenderer()
+{
+   QFontMetrics fm(labelFont());
+   cw = std::max(fm.width(QChar('M')), 1);
+   ch = std::max(fm.height(), 1);
+   ascent = fm.ascent();
+   int rows = (TEXT_LAST - TEXT_FIRST + TEXT_COLS) / TEXT_COLS;
+   aw = TEXT_COLS*cw;
+   ah = rows*ch;
+   gl = NULL;
+   atlas = vbo = 0;
+   last_glyphs = 0;
+}
+
+TextRenderer::~TextRenderer()
+{
+   if (!gl) return;
+   gl->glDeleteTextures(1, &atlas);
+   gl->glDeleteBuffers(1, &vbo);
+}
+
+void TextRenderer::initGL(QOpenGLFunctions *gl)
+{
+   this->gl = gl;
+   QImage img(aw, ah, QImage::Format_RGBA8888);
+   img.fill(Qt::transparent);
+   QPainter painter(&img);
+   painter.setFont(labelFont());
+   painter.setPen(Qt::white);
+   for (int c = TEXT_FIRST; c <= TEXT_LAST; c++)
+   {
+      int i = c - TEXT_FIRST;
+      painter.drawText(QPointF((i%TEXT_COLS)*cw, (i/TEXT_COLS)*ch + ascent), QString(QChar(c)));
+   }
+   painter.end();
+   // rows go up top first, so v = 0 is the top of the first cell row
+   gl->glGenTextures(1, &atlas);
+   gl->glBindTexture(GL_TEXTURE_2D, atlas);
+   gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+   gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+   gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+   gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, aw, ah, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.constBits());
+   gl->glBindTexture(GL_TEXTURE_2D, 0);
+   gl->glGenBuffers(1, &vbo);
+}
+
+void TextRenderer::draw(const std::vector<Label> &labels, int width, int height)
+{
+   verts.clear();
+   for (unsigned int i = 0; i < labels.size(); i++)
+   {
+      // whole pixels keep the nearest sampled glyphs crisp
+      float x = floor(labels[i].x + 0.5);
+      float y0 = floor(labels[i].y + 0.5) - (ch - ascent);
+      float y1 = y0 + ch;
+      const QString &text = labels[i].text;
+      for (int k = 0; k < text.size(); k++, x += cw)
+      {
+         int c = text[k].unicode();
+         if (c == ' ') continue;
+         if (c < TEXT_FIRST || c > TEXT_LAST) c = '?';
+         c -= TEXT_FIRST;
+         float u0 = (c%TEXT_COLS)*cw/(float)aw, u1 = u0 + cw/(float)aw;
+         float v0 = (c/TEXT_COLS)*ch/(float)ah, v1 = v0 + ch/(float)ah;
+         float quad[16] = {x,y0,u0,v1,  x+cw,y0,u1,v1,  x+cw,y1,u1,v0,  x,y1,u0,v0};
+         verts.insert(verts.end(), quad, quad+16);
+      }
+   }
+   last_glyphs = verts.size()/16;
+   if (verts.empty() || !atlas) return;
+
+   glPushAttrib(GL_ENABLE_BIT|GL_COLOR_BUFFER_BIT|GL_TEXTURE_BIT|GL_TRANSFORM_BIT|GL_CURRENT_BIT);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadIdentity();
+   glOrtho(0, width, 0, height, -1, 1);
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glLoadIdentity();
+   gl->glDisable(GL_DEPTH_TEST);
+   gl->glDisable(GL_CULL_FACE);
+   glDisable(GL_LIGHTING);
+   gl->glEnable(GL_BLEND);
+   gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+   gl->glActiveTexture(GL_TEXTURE0);
+   glEnable(GL_TEXTURE_2D);
+   gl->glBindTexture(GL_TEXTURE_2D, atlas);
+   glColor4f(1, 1, 1, 1);
+
+   // orphan last frame's storage
+   gl->glBindBuffer(GL_ARRAY_BUFFER, vbo);
+   gl->glBufferData(GL_ARRAY_BUFFER, verts.size()*sizeof(float), verts.data(), GL_STREAM_DRAW);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+   glDisableClientState(GL_NORMAL_ARRAY);
+   glVertexPointer(2, GL_FLOAT, 4*sizeof(float), (void*)0);
+   glTexCoordPointer(2, GL_FLOAT, 4*sizeof(float), (void*)(2*sizeof(float)));
+   gl->glDrawArrays(GL_QUADS, 0, verts.size()/4);
+   gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+   gl->glBindTexture(GL_TEXTURE_2D, 0);
+
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_MODELVIEW);
+   glPopMatrix();
+   glPopClientAttrib();
+   glPopAttrib();
+}
+
+//
+//  Labels claim the cells of a coarse screen grid, a label is dropped
+//  if any cell it covers is taken; overlay text claims cells first
+//
+void TextRenderer::declutter(std::vector<Label> &labels, int width, int height, QSize glyph)
+{
+   std::stable_sort(labels.begin(), labels.end(),
+                    [](const Label &a, const Label &b) {return a.priority < b.priority;});
+   int gw = width/TEXT_CELL + 1, gh = height/TEXT_CELL + 1;
+   std::vector<unsigned char> grid(gw*gh, 0);
+   std::vector<Label> kept;
+   kept.reserve(labels.size());
+   for (unsigned int i = 0; i < labels.size(); i++)
+   {
+      const Label &l = labels[i];
+      double x0 = l.x, x1 = l.x + l.text.size()*glyph.width();
+      double y0 = l.y - glyph.height()/4, y1 = y0 + glyph.height();
+      if (x1 <= 0 || x0 >= width || y1 <= 0 || y0 >= height) continue;
+      int cx0 = std::max((int)x0/TEXT_CELL, 0), cx1 = std::min((int)x1/TEXT_CELL, gw-1);
+      int cy0 = std::max((int)y0/TEXT_CELL, 0), cy1 = std::min((int)y1/TEXT_CELL, gh-1);
+      bool free = true;
+      for (int cy = cy0; cy <= cy1 && free; cy++)
+         for (int cx = cx0; cx <= cx1 && free; cx++)
+            free = !grid[cy*gw+cx];
+      if (!free && l.priority != LABEL_HUD) continue;
+      for (int cy = cy0; cy <= cy1; cy++)
+         for (int cx = cx0; cx <= cx1; cx++)
+            grid[cy*gw+cx] = 1;
+      kept.push_back(l);
+   }
+   labels.swap(kept);
+}
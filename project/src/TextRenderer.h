@@ -0,0 +1,56 @@
+//
+// glyph atlas text, every label of a frame in one buffer and one draw
+//
+
+#ifndef TEXTRENDERER_H
+#define TEXTRENDERER_H
+
+#include <QString>
+#include <QSize>
+#include <QOpenGLFunctions>
+#include <vector>
+
+#define LABEL_HUD  0 // overlay text, never culled
+#define LABEL_PICK 1 // lower priorities win when labels overlap
+#define LABEL_AXES 2
+#define LABEL_LMRK 3
+#define LABEL_POSE 4
+
+#define TEXT_FIRST 32  // printable ASCII in the atlas, others draw as '?'
+#define TEXT_LAST  126
+#define TEXT_COLS  16
+#define TEXT_CELL  8   // declutter grid cell in pixels
+
+typedef struct Label
+{
+	double x,y;   // baseline start in window coordinates, origin bottom left
+	QString text;
+	int priority;
+} Label;
+
+class TextRenderer
+{
+public:
+	TextRenderer();
+	~TextRenderer(); // call with the GL context current
+	void initGL(QOpenGLFunctions *gl);
+	QSize glyph() const {return QSize(cw, ch);}
+	// draws labels in one call over the current viewport, which
+	// spans width x height in label coordinates
+	void draw(const std::vector<Label> &labels, int width, int height);
+	long glyphs() const {return last_glyphs;}
+	// sorts labels by priority and drops those off screen or over
+	// one kept before them, earlier labels win ties
+	static void declutter(std::vector<Label> &labels, int width, int height, QSize glyph);
+
+private:
+	QOpenGLFunctions *gl;
+	GLuint atlas;
+	GLuint vbo;
+	int aw, ah;        // atlas size
+	int cw, ch, ascent;
+	std::vector<float> verts;
+	long last_glyphs;
+};
+
+#endif
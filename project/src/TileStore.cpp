@@ -0,0 +1,236 @@
+//
+//  Landmark tile store
+//  marginalized landmarks are binned by x and y into TILE_SIZE squares;
+//  paging a tile out appends its unwritten landmarks to the file as one
+//  chunk of packed records and forgets them, paging it in reads every
+//  chunk it has. Tiles are the x,y columns of the packing cubes. The
+//  file is only appended to, a tile's chunks are found from the index
+//  kept in memory, and a landmark marginalized again leaves its older
+//  records dead on disk; the home of each landmark's newest record
+//  tells them apart
+//
+#include "TileStore.h"
+#include "MemoryBudget.h"
+#include <algorithm>
+#include <math.h>
+
+TileStore::TileStore()
+{
+   file = NULL;
+   in_memory = on_disk = 0;
+   loads = evictions = 0;
+   file_bytes = 0;
+}
+
+TileStore::~TileStore()
+{
+   if (file) fclose(file);
+}
+
+bool TileStore::open(const char *path)
+{
+   if (file) fclose(file);
+   file = fopen(path, "w+b");
+   return file != NULL;
+}
+
+void TileStore::add(unsigned long id, const PackedLandmark &lmrk)
+{
+   int tx = lmrk.tile[0], ty = lmrk.tile[1];
+   float z = packedPoint(lmrk).z;
+   int64_t key = ((int64_t)tx << 32) | (uint32_t)ty;
+   std::unordered_map<int64_t, int>::iterator it = lookup.find(key);
+   int slot;
+   if (it != lookup.end())
+   {
+      slot = it->second;
+   }
+   else
+   {
+      Tile tile;
+      tile.tx = tx;
+      tile.ty = ty;
+      tile.zmin = tile.zmax = z;
+      tile.loaded = true;
+      tile.used = -1;
+      slot = tiles.size();
+      tiles.push_back(tile);
+      lookup[key] = slot;
+   }
+   Tile &tile = tiles[slot];
+   tile.zmin = std::min(tile.zmin, z);
+   tile.zmax = std::max(tile.zmax, z);
+   // a record from before the landmark was seen again is dead, wherever it is
+   remove(id);
+   Home home = {slot, false};
+   homes[id] = home;
+   tile.fresh_ids.push_back(id);
+   in_memory++;
+}
+
+void TileStore::remove(unsigned long id)
+{
+   std::unordered_map<unsigned long, Home>::iterator it = homes.find(id);
+   if (it == homes.end()) return;
+   if (it->second.on_disk)
+      on_disk--;
+   else
+      in_memory--;
+   homes.erase(it);
+}
+
+//
+//  A record or id in a tile is the landmark's newest one if its home
+//  is that tile, with the copy where it is expected
+//
+bool TileStore::live(unsigned long id, int tile, bool disk) const
+{
+   std::unordered_map<unsigned long, Home>::const_iterator it = homes.find(id);
+   return it != homes.end() && it->second.tile == tile && it->second.on_disk == disk;
+}
+
+void TileStore::find(std::function<bool(const glm::vec3 &lo, const glm::vec3 &hi)> visible,
+                     std::vector<int> &found) const
+{
+   for (unsigned int i = 0; i < tiles.size(); i++)
+   {
+      const Tile &tile = tiles[i];
+      glm::vec3 lo(tile.tx*TILE_SIZE, tile.ty*TILE_SIZE, tile.zmin);
+      glm::vec3 hi(lo.x + TILE_SIZE, lo.y + TILE_SIZE, tile.zmax);
+      if (visible(lo, hi)) found.push_back(i);
+   }
+}
+
+//
+//  Chunks are read newest first, the first record of a landmark that is
+//  still on disk here is its newest and takes it back into memory, so
+//  older copies of it are skipped
+//
+bool TileStore::pageIn(int slot, std::vector<std::pair<unsigned long, PackedLandmark> > &lmrks)
+{
+   Tile &tile = tiles[slot];
+   if (tile.loaded) return true;
+   if (!file) return false;
+   size_t first = lmrks.size(), first_loaded = tile.loaded_ids.size();
+   for (int c = tile.chunks.size()-1; c >= 0; c--)
+   {
+      const Chunk &chunk = tile.chunks[c];
+      records.resize(chunk.count);
+      if (fseek(file, chunk.offset + sizeof(ChunkHead), SEEK_SET) ||
+          fread(records.data(), sizeof(Record), chunk.count, file) != (size_t)chunk.count)
+      {
+         fprintf(stderr, "cannot read landmark tile %d,%d\n", tile.tx, tile.ty);
+         // what was taken back goes on disk again
+         for (size_t i = first; i < lmrks.size(); i++)
+            homes[lmrks[i].first].on_disk = true;
+         lmrks.resize(first);
+         tile.loaded_ids.resize(first_loaded);
+         return false;
+      }
+      for (int i = 0; i < chunk.count; i++)
+      {
+         const Record &r = records[i];
+         if (!live(r.id, slot, true)) continue;
+         homes[r.id].on_disk = false;
+         lmrks.push_back(std::make_pair((unsigned long)r.id, r.lmrk));
+         tile.loaded_ids.push_back(r.id);
+      }
+   }
+   tile.loaded = true;
+   in_memory += lmrks.size() - first;
+   on_disk -= lmrks.size() - first;
+   loads++;
+   return true;
+}
+
+bool TileStore::pageOut(int slot, const PackedLandmarks &inactive, std::vector<unsigned long> &ids)
+{
+   Tile &tile = tiles[slot];
+   if (!file) return false;
+   // landmarks dropped or superseded since they were added are not written
+   records.clear();
+   for (unsigned int i = 0; i < tile.fresh_ids.size(); i++)
+   {
+      unsigned long id = tile.fresh_ids[i];
+      PackedLandmarks::const_iterator it = inactive.find(id);
+      if (!live(id, slot, false) || it == inactive.end()) continue;
+      Record r;
+      r.id = id;
+      r.lmrk = it->second;
+      records.push_back(r);
+      // a repeated id is written once
+      homes[id].on_disk = true;
+   }
+   if (!records.empty())
+   {
+      ChunkHead head = {tile.tx, tile.ty, (int32_t)records.size(), 0};
+      Chunk chunk;
+      chunk.count = records.size();
+      if (fseek(file, 0, SEEK_END) || (chunk.offset = ftell(file)) < 0 ||
+          fwrite(&head, sizeof(head), 1, file) != 1 ||
+          fwrite(records.data(), sizeof(Record), records.size(), file) != records.size() ||
+          fflush(file))
+      {
+         fprintf(stderr, "cannot write landmark tiles, keeping them in memory\n");
+         for (unsigned int i = 0; i < records.size(); i++)
+            homes[records[i].id].on_disk = false;
+         fclose(file);
+         file = NULL;
+         return false;
+      }
+      tile.chunks.push_back(chunk);
+      file_bytes = chunk.offset + sizeof(head) + records.size()*sizeof(Record);
+   }
+   // what was read back is on disk still, the rest was just written
+   size_t written = records.size();
+   for (unsigned int i = 0; i < records.size(); i++)
+      ids.push_back(records[i].id);
+   for (unsigned int i = 0; i < tile.loaded_ids.size(); i++)
+   {
+      unsigned long id = tile.loaded_ids[i];
+      if (!live(id, slot, false)) continue;
+      homes[id].on_disk = true;
+      ids.push_back(id);
+      written++;
+   }
+   // fresh ones gone from inactive are forgotten
+   for (unsigned int i = 0; i < tile.fresh_ids.size(); i++)
+   {
+      unsigned long id = tile.fresh_ids[i];
+      if (!live(id, slot, false)) continue;
+      homes.erase(id);
+      in_memory--;
+   }
+   in_memory -= written;
+   on_disk += written;
+   std::vector<unsigned long>().swap(tile.loaded_ids);
+   std::vector<unsigned long>().swap(tile.fresh_ids);
+   tile.loaded = tile.chunks.empty();
+   evictions++;
+   return true;
+}
+
+int TileStore::lru(long frame) const
+{
+   int best = -1;
+   for (unsigned int i = 0; i < tiles.size(); i++)
+   {
+      const Tile &tile = tiles[i];
+      if (tile.used == frame || (tile.loaded_ids.empty() && tile.fresh_ids.empty())) continue;
+      if (best < 0 || tile.used < tiles[best].used) best = i;
+   }
+   return best;
+}
+
+//
+//  Index footprint
+//
+size_t TileStore::bytes() const
+{
+   size_t n = tiles.capacity()*sizeof(Tile) + records.capacity()*sizeof(Record) +
+              MemoryBudget::hashMapBytes(lookup) + MemoryBudget::hashMapBytes(homes);
+   for (unsigned int i = 0; i < tiles.size(); i++)
+      n += tiles[i].chunks.capacity()*sizeof(Chunk) +
+           (tiles[i].loaded_ids.capacity() + tiles[i].fresh_ids.capacity())*sizeof(unsigned long);
+   return n;
+}
@@ -0,0 +1,101 @@
+//
+// inactive landmarks in square tiles over the ground plane, paged
+// between memory and one append-only file
+//
+
+#ifndef TILESTORE_H
+#define TILESTORE_H
+
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+#include <functional>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "SlamLog.h"
+
+#define TILE_SIZE     QUANT_TILE // tile edge in landmark x and y, a packed landmark's cube
+#define TILE_BUDGET   500000 // resident landmarks before tiles are paged out
+#define TILE_LOADS    4      // tiles paged in per frame, visible ones first
+#define TILE_PREFETCH 8      // frames of camera motion to page ahead by
+
+class TileStore
+{
+public:
+	TileStore();
+	~TileStore();
+	bool open(const char *path); // truncates
+	bool ok() const {return file != NULL;}
+	// a landmark just marginalized, in memory until its tile is paged out
+	// one marginalized again supersedes the record it had before
+	void add(unsigned long id, const PackedLandmark &lmrk);
+	void remove(unsigned long id); // dropped, its records are dead
+	// appends the tiles whose box, in landmark coordinates, visible() accepts
+	void find(std::function<bool(const glm::vec3 &lo, const glm::vec3 &hi)> visible,
+			  std::vector<int> &tiles) const;
+	void touch(int tile, long frame) {tiles[tile].used = frame;}
+	bool paged(int tile) const {return tiles[tile].loaded;} // nothing of it only on disk
+	// reads the tile's landmarks back from disk, the newest record of each
+	bool pageIn(int tile, std::vector<std::pair<unsigned long, PackedLandmark> > &lmrks);
+	// writes the tile's landmarks not yet on disk, looked up in inactive,
+	// and hands back every id it holds in memory
+	bool pageOut(int tile, const PackedLandmarks &inactive, std::vector<unsigned long> &ids);
+	// least recently used tile holding landmarks in memory, not touched
+	// in frame, or -1
+	int lru(long frame) const;
+	size_t resident() const {return in_memory;}
+	size_t stored() const {return on_disk;}  // landmarks only on disk
+	int count() const {return tiles.size();}
+	size_t bytes() const;
+	long loads, evictions;
+	long file_bytes;
+
+private:
+	typedef struct Chunk
+	{
+		long offset;
+		int count;
+	} Chunk;
+
+	typedef struct Tile
+	{
+		int tx, ty;
+		float zmin, zmax;
+		std::vector<Chunk> chunks;         // written so far
+		bool loaded;                       // chunks are in memory
+		// read back, not yet written; ids whose Home moved on are stale
+		std::vector<unsigned long> loaded_ids, fresh_ids;
+		long used;                         // frame last touched
+	} Tile;
+
+	// one landmark on disk, a chunk is a ChunkHead and count of these
+	typedef struct Record
+	{
+		uint64_t id;
+		PackedLandmark lmrk;
+	} Record;
+
+	typedef struct ChunkHead
+	{
+		int32_t tx, ty, count, pad;
+	} ChunkHead;
+
+	// where the newest record of a landmark is, older ones are skipped
+	typedef struct Home
+	{
+		int tile;
+		bool on_disk; // only on disk, not held in memory
+	} Home;
+
+	FILE *file;
+	std::vector<Tile> tiles;
+	std::unordered_map<int64_t, int> lookup; // tile x,y to index
+	std::unordered_map<unsigned long, Home> homes;
+	size_t in_memory, on_disk; // live landmarks only
+
+	bool live(unsigned long id, int tile, bool on_disk) const;
+	std::vector<Record> records;
+};
+
+#endif
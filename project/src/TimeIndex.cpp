@@ -0,0 +1,130 @@
+//
+//  Landmark time index
+//  landmarks get slots in the order they are first seen, so the slots
+//  are sorted by first-seen frame and a window's upper end is a binary
+//  search. Over blocks of TIME_BLOCK slots sits a max tree of the last
+//  seen frames, the descent skips every block with nothing seen at or
+//  after the window's lower end, so a query costs O(log n + k) blocks
+//
+#include "TimeIndex.h"
+#include "MemoryBudget.h"
+#include <algorithm>
+
+TimeIndex::TimeIndex()
+{
+   leaves = 1;
+   tree.assign(2, 0);
+}
+
+uint32_t TimeIndex::add(unsigned long id, uint32_t frame)
+{
+   // log frames only move forward, a stamp repeated keeps the order
+   if (!slots.empty()) frame = std::max(frame, slots.back().first);
+   Slot slot = {id, frame, frame + 1};
+   slots.push_back(slot);
+   lookup[id] = slots.size() - 1;
+   if ((slots.size() - 1)/TIME_BLOCK >= leaves) grow();
+   raise((slots.size() - 1)/TIME_BLOCK, slot.end);
+   return slots.size() - 1;
+}
+
+bool TimeIndex::find(unsigned long id, uint32_t &slot) const
+{
+   std::unordered_map<unsigned long, uint32_t>::const_iterator it = lookup.find(id);
+   if (it == lookup.end()) return false;
+   slot = it->second;
+   return true;
+}
+
+void TimeIndex::seen(uint32_t slot, uint32_t frame)
+{
+   Slot &s = slots[slot];
+   if (!s.end || frame + 1 <= s.end) return;
+   s.end = frame + 1;
+   raise(slot/TIME_BLOCK, s.end);
+}
+
+void TimeIndex::remove(uint32_t slot)
+{
+   if (!slots[slot].end) return;
+   slots[slot].end = 0;
+   lookup.erase(slots[slot].id);
+   refresh(slot/TIME_BLOCK);
+}
+
+//
+//  Ends only grow on the path up until a node already holds more
+//
+void TimeIndex::raise(size_t block, uint32_t end)
+{
+   for (size_t node = leaves + block; node && tree[node] < end; node /= 2)
+      tree[node] = end;
+}
+
+uint32_t TimeIndex::blockEnd(size_t block) const
+{
+   uint32_t end = 0;
+   size_t last = std::min((block + 1)*TIME_BLOCK, slots.size());
+   for (size_t i = block*TIME_BLOCK; i < last; i++)
+      end = std::max(end, slots[i].end);
+   return end;
+}
+
+//
+//  A removal can lower a block, its ancestors are recomputed
+//
+void TimeIndex::refresh(size_t block)
+{
+   size_t node = leaves + block;
+   tree[node] = blockEnd(block);
+   for (node /= 2; node; node /= 2)
+      tree[node] = std::max(tree[2*node], tree[2*node + 1]);
+}
+
+//
+//  Double the leaves and rebuild, amortized over the slots added
+//
+void TimeIndex::grow()
+{
+   leaves *= 2;
+   tree.assign(2*leaves, 0);
+   size_t blocks = (slots.size() + TIME_BLOCK - 1)/TIME_BLOCK;
+   for (size_t b = 0; b < blocks; b++)
+      tree[leaves + b] = blockEnd(b);
+   for (size_t node = leaves - 1; node; node--)
+      tree[node] = std::max(tree[2*node], tree[2*node + 1]);
+}
+
+size_t TimeIndex::bytes() const
+{
+   return slots.capacity()*sizeof(Slot) + tree.capacity()*sizeof(uint32_t) +
+          MemoryBudget::hashMapBytes(lookup);
+}
+
+void TimeIndex::query(uint32_t f0, uint32_t f1, std::vector<unsigned long> &ids) const
+{
+   if (f1 < f0) return;
+   // slots first seen by f1
+   size_t count = std::upper_bound(slots.begin(), slots.end(), f1,
+                                   [](uint32_t f, const Slot &s) {return f < s.first;}) - slots.begin();
+   if (count) visit(1, 0, leaves, count, f0, ids);
+}
+
+//
+//  Node covers blocks lo to hi, only the first count slots are wanted
+//
+void TimeIndex::visit(size_t node, size_t lo, size_t hi, size_t count, uint32_t f0,
+                      std::vector<unsigned long> &ids) const
+{
+   if (lo*TIME_BLOCK >= count || tree[node] <= f0) return;
+   if (hi - lo == 1)
+   {
+      size_t last = std::min(hi*TIME_BLOCK, count);
+      for (size_t i = lo*TIME_BLOCK; i < last; i++)
+         if (slots[i].end > f0) ids.push_back(slots[i].id);
+      return;
+   }
+   size_t mid = (lo + hi)/2;
+   visit(2*node, lo, mid, count, f0, ids);
+   visit(2*node + 1, mid, hi, count, f0, ids);
+}
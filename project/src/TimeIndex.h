@@ -0,0 +1,57 @@
+//
+// first- and last-seen log frames of every landmark, indexed so a time
+// window finds the landmarks seen inside it without visiting the rest
+//
+
+#ifndef TIMEINDEX_H
+#define TIMEINDEX_H
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <stddef.h>
+
+#define TIME_BLOCK 64 // slots under one leaf of the last-seen max tree
+
+class TimeIndex
+{
+public:
+	TimeIndex();
+	// a landmark first seen in frame, returns the slot it keeps for good
+	uint32_t add(unsigned long id, uint32_t frame);
+	// the slot of a landmark not removed, even while its tile is on disk
+	bool find(unsigned long id, uint32_t &slot) const;
+	void seen(uint32_t slot, uint32_t frame); // seen again, frames only grow
+	void remove(uint32_t slot);               // dropped, never found again
+	uint32_t first(uint32_t slot) const {return slots[slot].first;}
+	uint32_t last(uint32_t slot) const {return slots[slot].end - 1;}
+	// seen at some time in frames f0 to f1
+	bool overlaps(uint32_t slot, uint32_t f0, uint32_t f1) const
+		{return slots[slot].end > f0 && slots[slot].first <= f1;}
+	// appends the ids of every landmark seen in frames f0 to f1
+	void query(uint32_t f0, uint32_t f1, std::vector<unsigned long> &ids) const;
+	size_t size() const {return slots.size();}
+	size_t bytes() const;
+
+private:
+	typedef struct Slot
+	{
+		uint64_t id;
+		uint32_t first; // frame first seen
+		uint32_t end;   // one past the frame last seen, 0 once removed
+	} Slot;
+
+	std::vector<Slot> slots;    // in first-seen order, so sorted by first
+	std::vector<uint32_t> tree; // implicit, largest end under each node
+	size_t leaves;              // leaf count, a power of two
+	std::unordered_map<unsigned long, uint32_t> lookup; // id to slot
+
+	uint32_t blockEnd(size_t block) const;
+	void raise(size_t block, uint32_t end);
+	void refresh(size_t block);
+	void grow();
+	void visit(size_t node, size_t lo, size_t hi, size_t count, uint32_t f0,
+			   std::vector<unsigned long> &ids) const;
+};
+
+#endif
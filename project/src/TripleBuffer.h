@@ -0,0 +1,47 @@
+//
+// lock-free triple buffer between one writer and one reader thread
+//
+
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+//
+// the writer fills back() and publishes it, the reader picks up the
+// newest published slot with update() and reads front(); neither side
+// ever waits, an unread slot is simply replaced by the next publish
+//
+template <typename T>
+class TripleBuffer
+{
+public:
+	// slots are value-initialized, so plain pointer members start NULL
+	TripleBuffer() : slots(), back_i(0), middle(1), front_i(2) {}
+
+	T &back() {return slots[back_i];}
+	void publish()
+	{
+		back_i = middle.exchange(back_i | DIRTY, std::memory_order_acq_rel) & INDEX;
+	}
+
+	bool update() // false if nothing was published since the last call
+	{
+		if (!(middle.load(std::memory_order_acquire) & DIRTY)) return false;
+		front_i = middle.exchange(front_i, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+	T &front() {return slots[front_i];}
+
+	// every slot, only while neither side is using the buffer
+	T &slot(int i) {return slots[i];}
+
+private:
+	enum {INDEX = 3, DIRTY = 4};
+	T slots[3];
+	int back_i;               // writer only
+	std::atomic<int> middle;  // last published slot, DIRTY until read
+	int front_i;              // reader only
+};
+
+#endif
@@ -1,7 +1,10 @@
 #include "airplane.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
-airplane::airplane(QOpenGLTexture** textures, int num_tex, QOpenGLFunctions *GLFuncs)
+airplane::airplane(QOpenGLTexture** textures, int num_tex, QOpenGLFunctions *GLFuncs, GLState *state)
 {
+	this->state = state;
 	texture = textures;
 	num_textures = num_tex;
   glFuncs = GLFuncs;
@@ -33,18 +36,63 @@ void airplane::drawAirplane(double x, double y, double z,
   mat[3] =  0;   mat[7] =  0;   mat[11] =  0;   mat[15] = 1;
 
   // save current transforms
-  glPushMatrix();
+  pushMatrix();
 
   // offset, scale and rotate
-  glTranslated(x,y,z);
-  glMultMatrixd(mat);
+  translate(x,y,z);
+  multMatrix(mat);
 
   drawFuselage();
   drawWing();
   drawVStab();
   drawHStab();
 
-  glPopMatrix();
+  popMatrix();
+}
+
+//
+//  The core renderer's meshes are recorded from the same drawing code
+//  on first use, one per material; textured parts get the current
+//  texture every time they are added
+//
+void airplane::addParts(RenderList &list, CoreRenderer *renderer, const glm::mat4 &model)
+{
+	if (parts.cmds.empty())
+	{
+		MeshBuilder builder;
+		rec = &builder;
+		drawAirplane(0,0,0, 0,0,1, 1,0,0);
+		rec = NULL;
+		builder.build(renderer, parts);
+	}
+	GLuint tex = texture[ntex] && texture[ntex]->isCreated() ? texture[ntex]->textureId() : 0;
+	for (unsigned int i = 0; i < parts.cmds.size(); i++)
+	{
+		RenderCmd cmd = parts.cmds[i];
+		cmd.model = model*cmd.model;
+		if (cmd.material.textured) cmd.material.texture = tex;
+		list.cmds.push_back(cmd);
+	}
+}
+
+//
+//  Depth passes replay a display list compiled on first use,
+//  texture binds are left out of it
+//
+void airplane::drawDepth()
+{
+	if (!depth_list)
+	{
+		depth_list = glGenLists(1);
+		depth_only = true;
+		glNewList(depth_list, GL_COMPILE);
+		drawAirplane(0,0,0, 0,0,1, 1,0,0);
+		glEndList();
+		depth_only = false;
+	}
+	glCallList(depth_list);
+	// the list ends with the window pass, which turns the offset off
+	state->assume(GL_POLYGON_OFFSET_FILL, false);
 }
 
 void airplane::changeTexture()
@@ -52,6 +100,97 @@ void airplane::changeTexture()
 	ntex = (ntex+1)%num_textures;
 }
 
+// textures are uploaded asynchronously, so skip them until they land
+void airplane::bindTexture()
+{
+  if (rec)
+    rec->material.textured = true;
+  else if (!depth_only)
+    state->bindTexture(texture[ntex]);
+}
+
+void airplane::releaseTexture()
+{
+  // every part binds its texture, so the binding is left in place
+  // and the state cache drops the rebinds of the same texture
+  if (rec) rec->material.textured = false;
+}
+
+// display lists are compiled without executing, so the depth list
+// goes around the state cache
+void airplane::setOffset(bool on)
+{
+  if (rec)
+    rec->material.offset = on;
+  else if (depth_only)
+  {
+    if (on)
+      glFuncs->glEnable(GL_POLYGON_OFFSET_FILL);
+    else
+      glFuncs->glDisable(GL_POLYGON_OFFSET_FILL);
+  }
+  else
+  {
+    state->set(GL_POLYGON_OFFSET_FILL, on);
+  }
+}
+
+// immediate mode and the matrix stack, recorded while building meshes
+void airplane::begin(GLenum mode)
+{
+  if (rec) rec->begin(mode); else glBegin(mode);
+}
+
+void airplane::end()
+{
+  if (rec) rec->end(); else glEnd();
+}
+
+void airplane::vertex(double x, double y, double z)
+{
+  if (rec) rec->vertex(x,y,z); else glVertex3d(x,y,z);
+}
+
+void airplane::normal(double x, double y, double z)
+{
+  if (rec) rec->normal(x,y,z); else glNormal3d(x,y,z);
+}
+
+void airplane::texCoord(double s, double t)
+{
+  if (rec) rec->texCoord(s,t); else glTexCoord2d(s,t);
+}
+
+void airplane::color(double r, double g, double b)
+{
+  if (rec) rec->material.color = glm::vec4(r,g,b,1); else glColor3d(r,g,b);
+}
+
+void airplane::shininess(GLenum face, double s)
+{
+  if (rec) rec->material.shininess = s; else glMaterialf(face,GL_SHININESS,s);
+}
+
+void airplane::pushMatrix()
+{
+  if (rec) rec->matrices.push(); else glPushMatrix();
+}
+
+void airplane::popMatrix()
+{
+  if (rec) rec->matrices.pop(); else glPopMatrix();
+}
+
+void airplane::translate(double x, double y, double z)
+{
+  if (rec) rec->matrices.mult(glm::translate(glm::mat4(1), glm::vec3(x,y,z))); else glTranslated(x,y,z);
+}
+
+void airplane::multMatrix(const double *m)
+{
+  if (rec) rec->matrices.mult(glm::mat4(glm::make_mat4(m))); else glMultMatrixd(m);
+}
+
 void airplane::Vertex(double th, double ph)
 {
 	double x = Sind(th)*Cosd(ph);
@@ -59,13 +198,13 @@ void airplane::Vertex(double th, double ph)
   double z =         Sind(ph);
   //  For a sphere at the origin, the position
   //  and normal vectors are the same
-  glNormal3d(x,y,z);
-  glVertex3d(x,y,z);
+  normal(x,y,z);
+  vertex(x,y,z);
 }
 
 void airplane::pointOnCircle(double th, double r, double c_x, double c_y, double c_z)
 {
-  glVertex3d(c_x, c_y + (r*Cosd(th)), c_z + (r*Sind(th)));
+  vertex(c_x, c_y + (r*Cosd(th)), c_z + (r*Sind(th)));
 }
 
 void airplane::pointOnCircle2(double th, double r, double c_x, double c_y, double c_z,
@@ -85,7 +224,7 @@ void airplane::getCowlNorms(double aft_x, double aft_y,
   norm_j = l*Cosd(th);
   double norm_k = l*Sind(th);
 
-  glNormal3f(norm_i, norm_j, norm_k);
+  normal(norm_i, norm_j, norm_k);
 }
 
 void airplane::crossProduct(double a_i, double a_j, double a_k,
@@ -122,7 +261,7 @@ void airplane::crossProductNorm(double a_i, double a_j, double a_k,
   double i,j,k;
   crossProduct(a_i,a_j,a_k,b_i,b_j,b_k,c_i,c_j,c_k,&i,&j,&k);
 
-  glNormal3f(i,j,k);
+  normal(i,j,k);
 }
 
 // draws a single rectangle using many polygons to approximate
@@ -139,15 +278,15 @@ void airplane::drawWindow(int horiz_seg, int vert_seg, double start_x,
   double cur_z = start_z;
   for (int i = 0; i <= vert_seg; i++)
   {
-    glBegin(GL_QUAD_STRIP);
+    begin(GL_QUAD_STRIP);
     for (int j = 0; j <= horiz_seg; j++)
     {
       
-      glVertex3d(cur_x+x_increment,cur_y+y_increment,cur_z);
-      glVertex3d(cur_x, cur_y, cur_z);
+      vertex(cur_x+x_increment,cur_y+y_increment,cur_z);
+      vertex(cur_x, cur_y, cur_z);
       cur_z += z_increment;
     }
-    glEnd();
+    end();
     cur_x += x_increment;
     cur_y += y_increment;
     cur_z = start_z;
@@ -158,17 +297,17 @@ void airplane::drawFuselage()
 {
   float white[] = {1,1,1,1};
   float black[] = {0,0,0,1};
-  glMaterialf(GL_FRONT,GL_SHININESS,0.5);
+  shininess(GL_FRONT,0.5);
   glMaterialfv(GL_FRONT,GL_SPECULAR,white);
   glMaterialfv(GL_FRONT,GL_EMISSION,black);
 
   // enable textures
   //glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_MODULATE);
-  glColor3f(1.0,1.0,1.0);
+  color(1.0,1.0,1.0);
   //glFuncs->glEnable(GL_TEXTURE_2D);
-  texture[ntex]->bind();
+  bindTexture();
 
-  glBegin(GL_QUADS);
+  begin(GL_QUADS);
    // aft tail boom  right side
   double tail_top = 0.17;
   double fwd_tail_top = 0.21;
@@ -178,37 +317,37 @@ void airplane::drawFuselage()
   crossProductNorm(tail, 0.1, 0.0,
                tail_boom_front, fwd_tail_top, 0.0875,
                tail, tail_top, 0.0);
-  glTexCoord2f(0,0.7); glVertex3d(tail, tail_top, 0.0);
-  glTexCoord2f(0,0.4); glVertex3d(tail, 0.1, 0.0);
-  glTexCoord2f(2,0); glVertex3d(tail_boom_front, 0.025, 0.0875);
-  glTexCoord2f(2,1); glVertex3d(tail_boom_front, fwd_tail_top, 0.0875);
+  texCoord(0,0.7); vertex(tail, tail_top, 0.0);
+  texCoord(0,0.4); vertex(tail, 0.1, 0.0);
+  texCoord(2,0); vertex(tail_boom_front, 0.025, 0.0875);
+  texCoord(2,1); vertex(tail_boom_front, fwd_tail_top, 0.0875);
 
   // aft tail boom left side
   crossProductNorm(tail_boom_front, fwd_tail_top, -0.0875,
                tail, 0.1, 0.0,
                tail, tail_top, 0.0);
-  glTexCoord2f(0,0.4); glVertex3d(tail, 0.1, 0.0);
-  glTexCoord2f(0,0.7); glVertex3d(tail, tail_top, 0.0);
-  glTexCoord2f(2,1); glVertex3d(tail_boom_front, fwd_tail_top, -0.0875);
-  glTexCoord2f(2,0); glVertex3d(tail_boom_front, 0.025, -0.0875);
+  texCoord(0,0.4); vertex(tail, 0.1, 0.0);
+  texCoord(0,0.7); vertex(tail, tail_top, 0.0);
+  texCoord(2,1); vertex(tail_boom_front, fwd_tail_top, -0.0875);
+  texCoord(2,0); vertex(tail_boom_front, 0.025, -0.0875);
 
   // aft tail boom top
   crossProductNorm(tail_boom_front, fwd_tail_top, 0.0875,
                tail_boom_front, fwd_tail_top, -0.875,
                tail, tail_top, 0.0);
-  glTexCoord2f(0,0.5); glVertex3d(tail, tail_top, 0.0);
-  glTexCoord2f(0,0.5); glVertex3d(tail, tail_top, 0.0);
-  glTexCoord2f(2,0.9); glVertex3d(tail_boom_front, fwd_tail_top, 0.0875);
-  glTexCoord2f(2,0.1); glVertex3d(tail_boom_front, fwd_tail_top, -0.0875);
+  texCoord(0,0.5); vertex(tail, tail_top, 0.0);
+  texCoord(0,0.5); vertex(tail, tail_top, 0.0);
+  texCoord(2,0.9); vertex(tail_boom_front, fwd_tail_top, 0.0875);
+  texCoord(2,0.1); vertex(tail_boom_front, fwd_tail_top, -0.0875);
 
   // aft tail boom bottom
   crossProductNorm(tail_boom_front, 0.025, -0.0875,
                tail_boom_front, 0.025, 0.875,
                tail, 0.1, 0.0);
-  glTexCoord2f(0,0.5); glVertex3d(tail, 0.1, 0.0);
-  glTexCoord2f(0,0.5); glVertex3d(tail, 0.1, 0.0);
-  glTexCoord2f(2,0.9); glVertex3d(tail_boom_front, 0.025, -0.0875);
-  glTexCoord2f(2,0.1); glVertex3d(tail_boom_front, 0.025, 0.0875);
+  texCoord(0,0.5); vertex(tail, 0.1, 0.0);
+  texCoord(0,0.5); vertex(tail, 0.1, 0.0);
+  texCoord(2,0.9); vertex(tail_boom_front, 0.025, -0.0875);
+  texCoord(2,0.1); vertex(tail_boom_front, 0.025, 0.0875);
 
   double door_top = 0.25;
   double door_bottom = 0.0;
@@ -218,19 +357,19 @@ void airplane::drawFuselage()
   crossProductNorm(tail_boom_front, 0.025, 0.0875,
                fwd_tail_front, door_top, 0.10,
                tail_boom_front, fwd_tail_top, 0.0875);
-  glTexCoord2f(0,1); glVertex3d(tail_boom_front, fwd_tail_top, 0.0875);
-  glTexCoord2f(0,0); glVertex3d(tail_boom_front, 0.025, 0.0875);
-  glTexCoord2f(0.5,-0.1); glVertex3d(fwd_tail_front, door_bottom, 0.10);
-  glTexCoord2f(0.5,1.15); glVertex3d(fwd_tail_front, door_top, 0.10);
+  texCoord(0,1); vertex(tail_boom_front, fwd_tail_top, 0.0875);
+  texCoord(0,0); vertex(tail_boom_front, 0.025, 0.0875);
+  texCoord(0.5,-0.1); vertex(fwd_tail_front, door_bottom, 0.10);
+  texCoord(0.5,1.15); vertex(fwd_tail_front, door_top, 0.10);
 
   // fwd tail boom left side
   crossProductNorm(fwd_tail_front, door_top, -0.10,
                tail_boom_front, 0.025, -0.0875,
                tail_boom_front, fwd_tail_top, -0.0875);
-  glTexCoord2f(0,0.1); glVertex3d(tail_boom_front, 0.025, -0.0875);
-  glTexCoord2f(0,0.9); glVertex3d(tail_boom_front, fwd_tail_top, -0.0875);
-  glTexCoord2f(0.5,1.15); glVertex3d(fwd_tail_front, door_top, -0.10);
-  glTexCoord2f(0.5,-0.1); glVertex3d(fwd_tail_front, door_bottom, -0.10);
+  texCoord(0,0.1); vertex(tail_boom_front, 0.025, -0.0875);
+  texCoord(0,0.9); vertex(tail_boom_front, fwd_tail_top, -0.0875);
+  texCoord(0.5,1.15); vertex(fwd_tail_front, door_top, -0.10);
+  texCoord(0.5,-0.1); vertex(fwd_tail_front, door_bottom, -0.10);
 
 
 
@@ -238,48 +377,48 @@ void airplane::drawFuselage()
   crossProductNorm(fwd_tail_front, door_top, 0.10,
                tail_boom_front, fwd_tail_top, -0.875,
                tail_boom_front, fwd_tail_top, 0.875);
-  glTexCoord2f(0,0.9); glVertex3d(tail_boom_front, fwd_tail_top, 0.0875);
-  glTexCoord2f(0.5,1); glVertex3d(fwd_tail_front, door_top, 0.10);
-  glTexCoord2f(0.5,0); glVertex3d(fwd_tail_front, door_top, -0.10);
-  glTexCoord2f(0,0.1); glVertex3d(tail_boom_front, fwd_tail_top, -0.0875);
+  texCoord(0,0.9); vertex(tail_boom_front, fwd_tail_top, 0.0875);
+  texCoord(0.5,1); vertex(fwd_tail_front, door_top, 0.10);
+  texCoord(0.5,0); vertex(fwd_tail_front, door_top, -0.10);
+  texCoord(0,0.1); vertex(tail_boom_front, fwd_tail_top, -0.0875);
 
   // fwd tail boom bottom
   crossProductNorm(fwd_tail_front, door_bottom, -0.10,
                tail_boom_front, 0.025, 0.0875,
                tail_boom_front, 0.025, -0.0875);
   
-  glTexCoord2f(0,0.1); glVertex3d(tail_boom_front, 0.025, 0.0875);
-  glTexCoord2f(0,0.9); glVertex3d(tail_boom_front, 0.025, -0.0875);
-  glTexCoord2f(0.5,1); glVertex3d(fwd_tail_front, door_bottom, -0.10);
-  glTexCoord2f(0.5,0); glVertex3d(fwd_tail_front, door_bottom, 0.10);
+  texCoord(0,0.1); vertex(tail_boom_front, 0.025, 0.0875);
+  texCoord(0,0.9); vertex(tail_boom_front, 0.025, -0.0875);
+  texCoord(0.5,1); vertex(fwd_tail_front, door_bottom, -0.10);
+  texCoord(0.5,0); vertex(fwd_tail_front, door_bottom, 0.10);
   
 
   // right door
   crossProductNorm(fwd_tail_front, door_bottom, 0.10,
                0.25, door_top, 0.10,
                fwd_tail_front, door_top, 0.10);
-  glTexCoord2f(0,1.1); glVertex3d(fwd_tail_front, door_top, 0.10);
-  glTexCoord2f(0,-0.1); glVertex3d(fwd_tail_front, door_bottom, 0.10);
-  glTexCoord2f(1,-0.1); glVertex3d(0.25, door_bottom, 0.10);
-  glTexCoord2f(1,1.1); glVertex3d(0.25, door_top, 0.10);
+  texCoord(0,1.1); vertex(fwd_tail_front, door_top, 0.10);
+  texCoord(0,-0.1); vertex(fwd_tail_front, door_bottom, 0.10);
+  texCoord(1,-0.1); vertex(0.25, door_bottom, 0.10);
+  texCoord(1,1.1); vertex(0.25, door_top, 0.10);
 
   // left door
   crossProductNorm(0.25, door_top, -0.10,
                fwd_tail_front, door_bottom, -0.10,
                fwd_tail_front, door_top, -0.10);
-  glTexCoord2f(0,-0.1); glVertex3d(fwd_tail_front, door_bottom, -0.10);
-  glTexCoord2f(0,1.1); glVertex3d(fwd_tail_front, door_top, -0.10);
-  glTexCoord2f(1,1.1); glVertex3d(0.25, door_top, -0.10);
-  glTexCoord2f(1,-0.1); glVertex3d(0.25, door_bottom, -0.10);
+  texCoord(0,-0.1); vertex(fwd_tail_front, door_bottom, -0.10);
+  texCoord(0,1.1); vertex(fwd_tail_front, door_top, -0.10);
+  texCoord(1,1.1); vertex(0.25, door_top, -0.10);
+  texCoord(1,-0.1); vertex(0.25, door_bottom, -0.10);
 
   // belly
   crossProductNorm(0.25, door_bottom, -0.1,
                fwd_tail_front, door_bottom, 0.1,
                fwd_tail_front, door_bottom, -0.1);
-  glTexCoord2f(0,1); glVertex3d(fwd_tail_front, door_bottom, 0.1);
-  glTexCoord2f(0,0); glVertex3d(fwd_tail_front, door_bottom, -0.1);
-  glTexCoord2f(1,0); glVertex3d(0.25, door_bottom, -0.1);
-  glTexCoord2f(1,1); glVertex3d(0.25, door_bottom, 0.1);
+  texCoord(0,1); vertex(fwd_tail_front, door_bottom, 0.1);
+  texCoord(0,0); vertex(fwd_tail_front, door_bottom, -0.1);
+  texCoord(1,0); vertex(0.25, door_bottom, -0.1);
+  texCoord(1,1); vertex(0.25, door_bottom, 0.1);
 
   // leave roof open, it will be covered by the wing
 
@@ -293,35 +432,35 @@ void airplane::drawFuselage()
   crossProductNorm(0.25, door_bottom, 0.1,
                firewall, cowling_top, cowling_side,
                0.25, door_top, 0.1);
-  glTexCoord2f(0,1.1); glVertex3d(0.25, door_top, 0.1);
-  glTexCoord2f(0,-0.1); glVertex3d(0.25, door_bottom, 0.1);
-  glTexCoord2f(0.25,-0.05); glVertex3d(firewall, cowling_bottom, cowling_side);
-  glTexCoord2f(0.25,0.8); glVertex3d(firewall, cowling_top, cowling_side);
+  texCoord(0,1.1); vertex(0.25, door_top, 0.1);
+  texCoord(0,-0.1); vertex(0.25, door_bottom, 0.1);
+  texCoord(0.25,-0.05); vertex(firewall, cowling_bottom, cowling_side);
+  texCoord(0.25,0.8); vertex(firewall, cowling_top, cowling_side);
 
   // fwd fuselage left
   crossProductNorm(firewall, cowling_top, -1. * cowling_side,
                0.25, door_bottom, -0.1,
                0.25, door_top, -0.1);
-  glTexCoord2f(0,-0.1); glVertex3d(0.25, door_bottom, -0.1);
-  glTexCoord2f(0,1.1); glVertex3d(0.25, door_top, -0.1);
-  glTexCoord2f(0.25,0.8); glVertex3d(firewall, cowling_top, -1. * cowling_side);
-  glTexCoord2f(0.25,-0.05); glVertex3d(firewall, cowling_bottom, -1. * cowling_side);
+  texCoord(0,-0.1); vertex(0.25, door_bottom, -0.1);
+  texCoord(0,1.1); vertex(0.25, door_top, -0.1);
+  texCoord(0.25,0.8); vertex(firewall, cowling_top, -1. * cowling_side);
+  texCoord(0.25,-0.05); vertex(firewall, cowling_bottom, -1. * cowling_side);
 
   // fwd belly
   crossProductNorm(0.25, door_bottom, -0.1,
                firewall, cowling_bottom, cowling_side,
                0.25, door_bottom, 0.1);
-  glTexCoord2f(0,0); glVertex3d(0.25, door_bottom, -0.1);
-  glTexCoord2f(0.25,0.1); glVertex3d(firewall, cowling_bottom, -1. * cowling_side);
-  glTexCoord2f(0.25,0.9); glVertex3d(firewall, cowling_bottom, cowling_side);
-  glTexCoord2f(0,1); glVertex3d(0.25, door_bottom, 0.1);
-  glEnd();
-  texture[ntex]->release();
+  texCoord(0,0); vertex(0.25, door_bottom, -0.1);
+  texCoord(0.25,0.1); vertex(firewall, cowling_bottom, -1. * cowling_side);
+  texCoord(0.25,0.9); vertex(firewall, cowling_bottom, cowling_side);
+  texCoord(0,1); vertex(0.25, door_bottom, 0.1);
+  end();
+  releaseTexture();
   //glFuncs->glDisable(GL_TEXTURE_2D);
 
   // windscreen
-  glMaterialf(GL_FRONT_AND_BACK,GL_SHININESS,1.0);
-  glColor3f(0.2,0.6,0.8);
+  shininess(GL_FRONT_AND_BACK,1.0);
+  color(0.2,0.6,0.8);
   crossProductNorm(firewall, cowling_top, cowling_side,
                0.25, door_top, -0.1,
                0.25, door_top, 0.1);
@@ -329,57 +468,57 @@ void airplane::drawFuselage()
              firewall,cowling_top,cowling_side);
 
   // windows
-  glFuncs->glEnable(GL_POLYGON_OFFSET_FILL);
+  setOffset(true);
   glPolygonOffset(-1.0f,-1.0f);
 
-  glBegin(GL_QUADS);
+  begin(GL_QUADS);
 
   double offset = 0.01;
-  glNormal3f(0.,0.,1.);
-  glVertex3d(fwd_tail_front + 0.1, door_top - offset, 0.10);
-  glVertex3d(fwd_tail_front + 0.1, cowling_top - offset, 0.10);
-  glVertex3d(0.25 - offset, cowling_top - offset, 0.10);
-  glVertex3d(0.25 - offset, door_top - offset, 0.10);
+  normal(0.,0.,1.);
+  vertex(fwd_tail_front + 0.1, door_top - offset, 0.10);
+  vertex(fwd_tail_front + 0.1, cowling_top - offset, 0.10);
+  vertex(0.25 - offset, cowling_top - offset, 0.10);
+  vertex(0.25 - offset, door_top - offset, 0.10);
   
   
 
-  glNormal3f(0.,0.,-1.);
-  glVertex3d(fwd_tail_front + 0.1, door_top - offset, -0.10);
-  glVertex3d(0.25 - offset/2, door_top - offset, -0.10);
-  glVertex3d(0.25 - offset/2, cowling_top - offset, -0.10);
-  glVertex3d(fwd_tail_front + 0.1, cowling_top - offset, -0.10);
+  normal(0.,0.,-1.);
+  vertex(fwd_tail_front + 0.1, door_top - offset, -0.10);
+  vertex(0.25 - offset/2, door_top - offset, -0.10);
+  vertex(0.25 - offset/2, cowling_top - offset, -0.10);
+  vertex(fwd_tail_front + 0.1, cowling_top - offset, -0.10);
 
   crossProductNorm(0.25+offset/2, cowling_top - offset, 0.10,
                    firewall-offset, cowling_top-offset, cowling_side,
                    0.25+offset/2, door_top-0.015, 0.10);
-  glVertex3d(0.25+offset/2, door_top-0.015, 0.10);
-  glVertex3d(0.25+offset/2, cowling_top - offset, 0.10);
-  glVertex3d(0.25+offset/2, cowling_top - offset, 0.10);
-  glVertex3d(firewall-offset, cowling_top-offset, cowling_side);
+  vertex(0.25+offset/2, door_top-0.015, 0.10);
+  vertex(0.25+offset/2, cowling_top - offset, 0.10);
+  vertex(0.25+offset/2, cowling_top - offset, 0.10);
+  vertex(firewall-offset, cowling_top-offset, cowling_side);
   
 
   crossProductNorm(firewall-offset, cowling_top-offset, cowling_side,
                    0.25+offset/2, cowling_top - offset, 0.10,
                    0.25+offset/2, door_top-0.015, 0.10);
-  glVertex3d(0.25+offset/2, door_top-0.015, -0.10);
-  glVertex3d(firewall-offset, cowling_top-offset, -cowling_side);
-  glVertex3d(0.25+offset/2, cowling_top - offset, -0.10);
-  glVertex3d(0.25+offset/2, cowling_top - offset, -0.10);
+  vertex(0.25+offset/2, door_top-0.015, -0.10);
+  vertex(firewall-offset, cowling_top-offset, -cowling_side);
+  vertex(0.25+offset/2, cowling_top - offset, -0.10);
+  vertex(0.25+offset/2, cowling_top - offset, -0.10);
 
-  glEnd();
+  end();
 
-  glFuncs->glDisable(GL_POLYGON_OFFSET_FILL);
+  setOffset(false);
 
   
 
-  glMaterialf(GL_FRONT,GL_SHININESS,0.5);
-  glColor3f(1.0,1.0,1.0);
+  shininess(GL_FRONT,0.5);
+  color(1.0,1.0,1.0);
   //glFuncs->glEnable(GL_TEXTURE_2D);
-  texture[ntex]->bind();
+  bindTexture();
 
   // aft cowling
   double cowl_y_center = 0.5 * (cowling_top + cowling_bottom);
-  glBegin(GL_QUAD_STRIP);
+  begin(GL_QUAD_STRIP);
   double radius = 0.06;
   double fwd_cowl = 0.45;
   double horiz_increment = cowling_side * 0.5;
@@ -392,12 +531,12 @@ void airplane::drawFuselage()
     pointOnCircle2(th,radius,fwd_cowl,cowl_y_center,0.0,&px,&py,&pz);
     getCowlNorms(firewall, cowling_top, px, py, th);
 
-    glNormal3f(Sind(fwd_cowl_angle),Cosd(th),Sind(th));
-    glTexCoord2f(0.25,th/90.); 
-    glVertex3d(px,py,pz);
+    normal(Sind(fwd_cowl_angle),Cosd(th),Sind(th));
+    texCoord(0.25,th/90.); 
+    vertex(px,py,pz);
 
-    glTexCoord2f(0,th/90.); 
-    glVertex3d(firewall, cowling_top, horiz_position);
+    texCoord(0,th/90.); 
+    vertex(firewall, cowling_top, horiz_position);
 
     
     horiz_position += horiz_increment;
@@ -412,12 +551,12 @@ void airplane::drawFuselage()
     pointOnCircle2(th,radius,fwd_cowl,cowl_y_center,0.0,&px,&py,&pz);
     getCowlNorms(firewall, vert_position, px, py, th);
 
-    glNormal3f(Sind(fwd_cowl_angle),Cosd(th),Sind(th));
-    glTexCoord2f(0.25,th/90.); 
-    glVertex3d(px,py,pz);
+    normal(Sind(fwd_cowl_angle),Cosd(th),Sind(th));
+    texCoord(0.25,th/90.); 
+    vertex(px,py,pz);
 
-    glTexCoord2f(0,th/90.); 
-    glVertex3d(firewall, vert_position, cowling_side);
+    texCoord(0,th/90.); 
+    vertex(firewall, vert_position, cowling_side);
     
     vert_position -= vert_increment;
   }
@@ -428,12 +567,12 @@ void airplane::drawFuselage()
     pointOnCircle2(th,radius,fwd_cowl,cowl_y_center,0.0,&px,&py,&pz);
     getCowlNorms(firewall, cowling_bottom, px, py, th);
 
-    glNormal3f(Sind(fwd_cowl_angle),Cosd(th),Sind(th));
-    glTexCoord2f(0.25,th/90.); 
-    glVertex3d(px,py,pz);
+    normal(Sind(fwd_cowl_angle),Cosd(th),Sind(th));
+    texCoord(0.25,th/90.); 
+    vertex(px,py,pz);
 
-    glTexCoord2f(0,th/90.); 
-    glVertex3d(firewall, cowling_bottom, horiz_position);
+    texCoord(0,th/90.); 
+    vertex(firewall, cowling_bottom, horiz_position);
 
     horiz_position -= horiz_increment;
   }
@@ -444,38 +583,38 @@ void airplane::drawFuselage()
     pointOnCircle2(th,radius,fwd_cowl,cowl_y_center,0.0,&px,&py,&pz);
     getCowlNorms(firewall, vert_position, px, py, th);
 
-    glNormal3f(Sind(fwd_cowl_angle),Cosd(th),Sind(th));
-    glTexCoord2f(0.25,th/90.); 
-    glVertex3d(px,py,pz);
+    normal(Sind(fwd_cowl_angle),Cosd(th),Sind(th));
+    texCoord(0.25,th/90.); 
+    vertex(px,py,pz);
 
-    glTexCoord2f(0,th/90.); 
-    glVertex3d(firewall, vert_position, -1 * cowling_side);
+    texCoord(0,th/90.); 
+    vertex(firewall, vert_position, -1 * cowling_side);
 
     vert_position += vert_increment;
   }
 
-  glEnd();
+  end();
   
   // fwd cowling
   double nose = 0.49;
-  glBegin(GL_TRIANGLE_STRIP);
+  begin(GL_TRIANGLE_STRIP);
   
   for (double th = 0; th <= 360; th += 22.5)
   {
     double px, py, pz;
     pointOnCircle2(th,radius,fwd_cowl,cowl_y_center,0.0,&px,&py,&pz);
 
-    glNormal3f(1,0,0);
-    glTexCoord2f(0.5,0.5); 
-    glVertex3d(nose, cowl_y_center, 0.0);
+    normal(1,0,0);
+    texCoord(0.5,0.5); 
+    vertex(nose, cowl_y_center, 0.0);
 
-    glNormal3f(Sind(fwd_cowl_angle), Cosd(th), Sind(th));
-    glTexCoord2f(0.35*Cosd(th)+0.5,0.35*Sind(th)+0.5); 
-    glVertex3d(px,py,pz);
+    normal(Sind(fwd_cowl_angle), Cosd(th), Sind(th));
+    texCoord(0.35*Cosd(th)+0.5,0.35*Sind(th)+0.5); 
+    vertex(px,py,pz);
   }
 
-  glEnd();
-  texture[ntex]->release();
+  end();
+  releaseTexture();
   //glFuncs->glDisable(GL_TEXTURE_2D);
 
 }
@@ -483,9 +622,9 @@ void airplane::drawFuselage()
 void airplane::drawWing()
 {
   //glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_MODULATE);
-  glColor3f(1.0,1.0,1.0);
+  color(1.0,1.0,1.0);
   //glFuncs->glEnable(GL_TEXTURE_2D);
-  texture[ntex]->bind();
+  bindTexture();
 
   // define wing cross section
   int num_points = 6;
@@ -494,31 +633,31 @@ void airplane::drawWing()
 
   double wingtip = -1.2;
 
-  glMaterialf(GL_FRONT_AND_BACK,GL_SHININESS,0.5);
+  shininess(GL_FRONT_AND_BACK,0.5);
 
   double tex_scale = 3.0;
 
-  glBegin(GL_POLYGON);
-  glNormal3f(0,0,wingtip);
+  begin(GL_POLYGON);
+  normal(0,0,wingtip);
   for (int i = num_points - 1; i >= 0; i--)
   {
-    glTexCoord2f(tex_scale*cross_sec_x[i], tex_scale*cross_sec_y[i]);
-    glVertex3d(cross_sec_x[i], cross_sec_y[i], wingtip);
+    texCoord(tex_scale*cross_sec_x[i], tex_scale*cross_sec_y[i]);
+    vertex(cross_sec_x[i], cross_sec_y[i], wingtip);
   }
-  glEnd();
+  end();
   
   wingtip *= -1.0;
 
-  glBegin(GL_POLYGON);
-  glNormal3f(0,0,wingtip);
+  begin(GL_POLYGON);
+  normal(0,0,wingtip);
   for (int i = 0; i < num_points; i++)
   {
-    glTexCoord2f(tex_scale*cross_sec_x[i], tex_scale*cross_sec_y[i]);
-    glVertex3d(cross_sec_x[i], cross_sec_y[i], wingtip);
+    texCoord(tex_scale*cross_sec_x[i], tex_scale*cross_sec_y[i]);
+    vertex(cross_sec_x[i], cross_sec_y[i], wingtip);
   }
-  glEnd();
+  end();
 
-  glBegin(GL_QUAD_STRIP);
+  begin(GL_QUAD_STRIP);
   double tex_pos = 0.0;
   for (int i = 0; i < num_points; i++)
   {
@@ -552,36 +691,36 @@ void airplane::drawWing()
     n_j = sin(th/2)*a_i + cos(th/2)*a_j;
   
     if (i == 0)
-      glNormal3f(0.0, -1.0, 0.0);
+      normal(0.0, -1.0, 0.0);
     else if (i > 0 && i < 4)
-      glNormal3f(-n_i,-n_j,0.0);
+      normal(-n_i,-n_j,0.0);
     else if (i < num_points - 1)
-      glNormal3f(n_i,n_j,0.0);
+      normal(n_i,n_j,0.0);
     else
-      glNormal3f(a_j, a_i, 0.0);
+      normal(a_j, a_i, 0.0);
 
 
 
-    glTexCoord2f(3,tex_pos);
-    glVertex3d(cross_sec_x[i], cross_sec_y[i], wingtip);
-    glTexCoord2f(-3,tex_pos);
-    glVertex3d(cross_sec_x[i], cross_sec_y[i], -1.0*wingtip);
+    texCoord(3,tex_pos);
+    vertex(cross_sec_x[i], cross_sec_y[i], wingtip);
+    texCoord(-3,tex_pos);
+    vertex(cross_sec_x[i], cross_sec_y[i], -1.0*wingtip);
     tex_pos += tex_scale*nb;
   }
-  glEnd();
-  glBegin(GL_QUADS);
-  glNormal3f(0,-1,0);
-  glTexCoord2f(-3,1);
-  glVertex3d(cross_sec_x[0], cross_sec_y[0], -1.0*wingtip);
-  glTexCoord2f(3,1);
-  glVertex3d(cross_sec_x[0], cross_sec_y[0], wingtip);
-  glTexCoord2f(3,0);
-  glVertex3d(cross_sec_x[num_points-1],cross_sec_y[num_points-1],wingtip);
-  glTexCoord2f(-3,0);
-  glVertex3d(cross_sec_x[num_points-1],cross_sec_y[num_points-1],-1.0*wingtip);
+  end();
+  begin(GL_QUADS);
+  normal(0,-1,0);
+  texCoord(-3,1);
+  vertex(cross_sec_x[0], cross_sec_y[0], -1.0*wingtip);
+  texCoord(3,1);
+  vertex(cross_sec_x[0], cross_sec_y[0], wingtip);
+  texCoord(3,0);
+  vertex(cross_sec_x[num_points-1],cross_sec_y[num_points-1],wingtip);
+  texCoord(-3,0);
+  vertex(cross_sec_x[num_points-1],cross_sec_y[num_points-1],-1.0*wingtip);
   
-  glEnd();
-  texture[ntex]->release();
+  end();
+  releaseTexture();
   //glFuncs->glDisable(GL_TEXTURE_2D);
 }
 
@@ -594,50 +733,50 @@ void airplane::drawVStab()
   double offset = 0.005;
   double direction = 1.0;
 
-  glMaterialf(GL_FRONT_AND_BACK,GL_SHININESS,0.5);
+  shininess(GL_FRONT_AND_BACK,0.5);
   //glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_MODULATE);
-  glColor3f(1.0,1.0,1.0);
+  color(1.0,1.0,1.0);
   //glFuncs->glEnable(GL_TEXTURE_2D);
-  texture[ntex]->bind();
+  bindTexture();
   
   // draw sides of v-stab
   double tex_scale = 4.0;
 
-  glBegin(GL_POLYGON);
-  glNormal3f(0,0,direction);
+  begin(GL_POLYGON);
+  normal(0,0,direction);
   for (int i = num_points - 1; i >= 0; i--)
   {
-    glTexCoord2f(tex_scale*cross_sec_x[i],tex_scale*cross_sec_y[i]);
-    glVertex3d(cross_sec_x[i], cross_sec_y[i], direction*offset);
+    texCoord(tex_scale*cross_sec_x[i],tex_scale*cross_sec_y[i]);
+    vertex(cross_sec_x[i], cross_sec_y[i], direction*offset);
   }
-  glEnd();
+  end();
 
   direction *= -1.0;
-  glBegin(GL_POLYGON);
-  glNormal3f(0,0,direction);
+  begin(GL_POLYGON);
+  normal(0,0,direction);
   for (int i = 0; i < num_points; i++)
   {
-    glTexCoord2f(tex_scale*cross_sec_x[i],tex_scale*cross_sec_y[i]);
-    glVertex3d(cross_sec_x[i], cross_sec_y[i], direction*offset);
+    texCoord(tex_scale*cross_sec_x[i],tex_scale*cross_sec_y[i]);
+    vertex(cross_sec_x[i], cross_sec_y[i], direction*offset);
   }
-  glEnd();
+  end();
 
-  glBegin(GL_QUAD_STRIP);
+  begin(GL_QUAD_STRIP);
   for (int i = 0; i < num_points; i++)
   {
-    glNormal3f(Cosd(norm_th[i]),Sind(norm_th[i]),0.0);
-    glTexCoord2f(tex_scale*cross_sec_x[i], tex_scale*2*offset);
-    glVertex3d(cross_sec_x[i], cross_sec_y[i], -1.0*offset);
-    glTexCoord2f(tex_scale*cross_sec_x[i],0);
-    glVertex3d(cross_sec_x[i], cross_sec_y[i], offset);
+    normal(Cosd(norm_th[i]),Sind(norm_th[i]),0.0);
+    texCoord(tex_scale*cross_sec_x[i], tex_scale*2*offset);
+    vertex(cross_sec_x[i], cross_sec_y[i], -1.0*offset);
+    texCoord(tex_scale*cross_sec_x[i],0);
+    vertex(cross_sec_x[i], cross_sec_y[i], offset);
   }
-  glNormal3f(Cosd(norm_th[num_points-1]),Sind(norm_th[num_points-1]),0.0);
-  glTexCoord2f(tex_scale*cross_sec_x[0], tex_scale*2*offset);
-  glVertex3d(cross_sec_x[0], cross_sec_y[0], -1.0*offset);
-  glTexCoord2f(tex_scale*cross_sec_x[0],0);
-  glVertex3d(cross_sec_x[0], cross_sec_y[0], offset);
-  glEnd();
-  texture[ntex]->release();
+  normal(Cosd(norm_th[num_points-1]),Sind(norm_th[num_points-1]),0.0);
+  texCoord(tex_scale*cross_sec_x[0], tex_scale*2*offset);
+  vertex(cross_sec_x[0], cross_sec_y[0], -1.0*offset);
+  texCoord(tex_scale*cross_sec_x[0],0);
+  vertex(cross_sec_x[0], cross_sec_y[0], offset);
+  end();
+  releaseTexture();
   //glFuncs->glDisable(GL_TEXTURE_2D);
 }
 
@@ -652,108 +791,108 @@ void airplane::drawHStab()
   double y_dir = 1.;
   double z_dir = -1.;
 
-  glMaterialf(GL_FRONT_AND_BACK,GL_SHININESS,0.5);
+  shininess(GL_FRONT_AND_BACK,0.5);
   
   
   double tex_scale = 4.0;
 
   //glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_MODULATE);
-  glColor3f(1.0,1.0,1.0);
+  color(1.0,1.0,1.0);
   //glFuncs->glEnable(GL_TEXTURE_2D);
-  texture[ntex]->bind();
+  bindTexture();
      
-  glBegin(GL_POLYGON);
-  glNormal3f(0.0, y_dir, 0.0);
+  begin(GL_POLYGON);
+  normal(0.0, y_dir, 0.0);
   for (int i = 0; i < num_points; i++)
   {
-    glTexCoord2f(tex_scale*cross_sec_z[i],tex_scale*cross_sec_x[i]);
-    glVertex3d(cross_sec_x[i], 
+    texCoord(tex_scale*cross_sec_z[i],tex_scale*cross_sec_x[i]);
+    vertex(cross_sec_x[i], 
                stab_height + (offset*y_dir), 
                cross_sec_z[i]*z_dir);
   }
-  glEnd();
+  end();
 
   y_dir *= -1.;
 
-  glBegin(GL_POLYGON);
-  glNormal3f(0.0, y_dir, 0.0);
+  begin(GL_POLYGON);
+  normal(0.0, y_dir, 0.0);
   for (int i = num_points-1; i >= 0; i--)
   {
-    glTexCoord2f(tex_scale*cross_sec_z[i],tex_scale*cross_sec_x[i]);
-    glVertex3d(cross_sec_x[i], 
+    texCoord(tex_scale*cross_sec_z[i],tex_scale*cross_sec_x[i]);
+    vertex(cross_sec_x[i], 
                stab_height + (offset*y_dir), 
                cross_sec_z[i]*z_dir);
   }
-  glEnd();
-  texture[ntex]->release();
+  end();
+  releaseTexture();
   //glFuncs->glDisable(GL_TEXTURE_2D);
 
 
   //glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_MODULATE);
-  glColor3f(1.0,1.0,1.0);
+  color(1.0,1.0,1.0);
   //glFuncs->glEnable(GL_TEXTURE_2D);
-  texture[ntex]->bind();
-  glBegin(GL_QUAD_STRIP);
+  bindTexture();
+  begin(GL_QUAD_STRIP);
   for (int i = 0; i < num_points; i++)
   {
-    glNormal3f(Sind(norm_th[i]*z_dir),0.0,
+    normal(Sind(norm_th[i]*z_dir),0.0,
                Cosd(norm_th[i]*z_dir));
-    glTexCoord2f(tex_scale*cross_sec_x[i], 0);
-    glVertex3d(cross_sec_x[i],
+    texCoord(tex_scale*cross_sec_x[i], 0);
+    vertex(cross_sec_x[i],
                stab_height + offset, 
                cross_sec_z[i]*z_dir);
-    glTexCoord2f(tex_scale*cross_sec_x[i], tex_scale*2*offset);
-    glVertex3d(cross_sec_x[i],
+    texCoord(tex_scale*cross_sec_x[i], tex_scale*2*offset);
+    vertex(cross_sec_x[i],
                stab_height - offset,
                cross_sec_z[i]*z_dir);
   }
-  glEnd();
+  end();
   
   z_dir *= -1.;
 
-  glBegin(GL_POLYGON);
-  glNormal3f(0.0, y_dir, 0.0);
+  begin(GL_POLYGON);
+  normal(0.0, y_dir, 0.0);
   for (int i = 0; i < num_points; i++)
   {
-    glTexCoord2f(tex_scale*cross_sec_z[i],tex_scale*cross_sec_x[i]);
-    glVertex3d(cross_sec_x[i], 
+    texCoord(tex_scale*cross_sec_z[i],tex_scale*cross_sec_x[i]);
+    vertex(cross_sec_x[i], 
                stab_height + (offset*y_dir), 
                cross_sec_z[i]*z_dir);
   }
-  glEnd();
+  end();
 
   y_dir *= -1.;
 
-  glBegin(GL_POLYGON);
-  glNormal3f(0.0, y_dir, 0.0);
+  begin(GL_POLYGON);
+  normal(0.0, y_dir, 0.0);
   for (int i = num_points-1; i >= 0; i--)
   {
-    glTexCoord2f(tex_scale*cross_sec_z[i],tex_scale*cross_sec_x[i]);
-    glVertex3d(cross_sec_x[i], 
+    texCoord(tex_scale*cross_sec_z[i],tex_scale*cross_sec_x[i]);
+    vertex(cross_sec_x[i], 
                stab_height + (offset*y_dir), 
                cross_sec_z[i]*z_dir);
   }
-  glEnd();
+  end();
 
   //glEnable(GL_TEXTURE_2D);
   //glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_MODULATE);
-  glColor3f(1.0,1.0,1.0);
+  color(1.0,1.0,1.0);
   //texture[ntex]->bind();
-  glBegin(GL_QUAD_STRIP);
+  begin(GL_QUAD_STRIP);
   for (int i = 0; i < num_points; i++)
   {
-    glNormal3f(Sind(norm_th[i]*z_dir),0.0,
+    normal(Sind(norm_th[i]*z_dir),0.0,
                Cosd(norm_th[i]*z_dir));
-    glTexCoord2f(tex_scale*cross_sec_x[i], tex_scale*2*offset);
-    glVertex3d(cross_sec_x[i],
+    texCoord(tex_scale*cross_sec_x[i], tex_scale*2*offset);
+    vertex(cross_sec_x[i],
                stab_height - offset,
                cross_sec_z[i]*z_dir);
-    glTexCoord2f(tex_scale*cross_sec_x[i], 0);
-    glVertex3d(cross_sec_x[i],
+    texCoord(tex_scale*cross_sec_x[i], 0);
+    vertex(cross_sec_x[i],
                stab_height + offset, 
                cross_sec_z[i]*z_dir);
   }
-  glEnd();
-  texture[ntex]->release();
+  end();
+  releaseTexture();
   //glFuncs->glDisable(GL_TEXTURE_2D);
 }
\ No newline at end of file
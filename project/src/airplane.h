@@ -8,24 +8,48 @@
 #include "CSCIx229.h"
 #include <QOpenGLTexture>
 #include <QOpenGLFunctions>
+#include "GLState.h"
+#include "CoreRenderer.h"
 
 class airplane
 {
 public:
-	airplane(QOpenGLTexture **textures, int num_tex, QOpenGLFunctions *GLFuncs); // constructor
+	airplane(QOpenGLTexture **textures, int num_tex, QOpenGLFunctions *GLFuncs, GLState *state); // constructor
 	void drawAirplane(double x, double y, double z,
 										double dx, double dy, double dz,
 										double ux, double uy, double uz);
 	void changeTexture();
+	void drawDepth(); // geometry only, at the origin facing +z
+	// the airplane's meshes for the core renderer, as drawDepth places it
+	void addParts(RenderList &list, CoreRenderer *renderer, const glm::mat4 &model);
 
 
 private:
 	QOpenGLTexture** texture;
 	int ntex = 0;
+	bool depth_only = false; // compiling the depth list, skip textures
+	GLuint depth_list = 0;
 	int num_textures;
 	QOpenGLFunctions *glFuncs;
+	GLState *state;
+	MeshBuilder *rec = NULL; // set while recording the core meshes
+	RenderList parts;
 
+	void begin(GLenum mode);
+	void end();
+	void vertex(double x, double y, double z);
+	void normal(double x, double y, double z);
+	void texCoord(double s, double t);
+	void color(double r, double g, double b);
+	void shininess(GLenum face, double s);
+	void pushMatrix();
+	void popMatrix();
+	void translate(double x, double y, double z);
+	void multMatrix(const double *m);
 
+	void bindTexture();
+	void releaseTexture();
+	void setOffset(bool on);
 	void Vertex(double th, double ph);
 	void pointOnCircle(double th, double r, double c_x, double c_y, double c_z);
 	void pointOnCircle2(double th, double r, double c_x, double c_y, double c_z,
@@ -0,0 +1,433 @@
+//
+//  SlamViz microbenchmarks
+//  times the CPU hot paths of a replay tick on synthetic landmark maps
+//  of 1K to 10M landmarks, calling the same functions the visualizer
+//  does; every allocation goes through the counting operator new below,
+//  so a change that adds work or allocations per landmark shows up as
+//  a larger ns/op or allocs/op next to the previous run
+//
+#include <chrono>
+#include <atomic>
+#include <random>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glm/gtc/type_ptr.hpp>
+#include "SlamLog.h"
+#include "SceneGraph.h"
+#include "TimeIndex.h"
+#include "LandmarkBVH.h"
+#include "JobSystem.h"
+#include "ObjMesh.h"
+#include "SmokeBB.h"
+#include "Star.h"
+
+#define BENCH_MIN_MS    200     // a run repeats until it has taken this long
+#define BENCH_MAX_SCALE 10000000
+#define BENCH_POOL      4096    // distinct synthetic lines, reused in turn
+#define BENCH_SIGHTINGS 1000    // landmarks per synthetic log frame
+#define BENCH_STALE     10      // percent of landmarks marginalized per frame
+#define BENCH_FRAMES    8       // distinct synthetic log frames, reused in turn
+#define BENCH_OPS       1000000 // calls for the per-call benchmarks
+
+static std::atomic<long> allocs(0);
+
+void *operator new(size_t size)
+{
+   allocs.fetch_add(1, std::memory_order_relaxed);
+   void *p = malloc(size ? size : 1);
+   if (!p) throw std::bad_alloc();
+   return p;
+}
+
+void *operator new[](size_t size)
+{
+   return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+   free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+   free(p);
+}
+
+typedef struct Result
+{
+   std::string name;
+   long scale;       // landmarks, 0 where the benchmark has no scale
+   double ns;        // per op
+   double allocs;    // per op
+} Result;
+
+static std::vector<Result> results;
+
+//
+//  Run setup() and then body() until BENCH_MIN_MS of body() have passed,
+//  only body() is timed and counted; body() does ops operations
+//
+static void measure(const char *name, long scale, long ops, std::function<void()> body,
+                    std::function<void()> setup=std::function<void()>())
+{
+   typedef std::chrono::steady_clock Clock;
+   double ns = 0;
+   long count = 0, runs = 0;
+   while (!runs || ns < BENCH_MIN_MS*1e6)
+   {
+      if (setup) setup();
+      long before = allocs.load();
+      Clock::time_point t0 = Clock::now();
+      body();
+      Clock::time_point t1 = Clock::now();
+      count += allocs.load() - before;
+      ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+      runs++;
+   }
+   Result r;
+   r.name = name;
+   r.scale = scale;
+   r.ns = ns/(runs*ops);
+   r.allocs = (double)count/(runs*ops);
+   results.push_back(r);
+   printf("%-22s %10ld %12.1f %10.2f\n", name, scale, r.ns, r.allocs);
+   fflush(stdout);
+}
+
+//
+//  Synthetic log lines, in the formats the replay reads
+//
+static std::mt19937 rng(1);
+
+static float uniform(float lo, float hi)
+{
+   return std::uniform_real_distribution<float>(lo, hi)(rng);
+}
+
+static std::string poseLine(double stamp)
+{
+   char buf[256];
+   glm::vec4 q(uniform(-1,1), uniform(-1,1), uniform(-1,1), uniform(-1,1));
+   q = glm::normalize(q);
+   snprintf(buf, sizeof(buf), "%.6f %.6f %.6f %.6f %.6f %.6f %.6f %.6f", stamp,
+            uniform(-50,50), uniform(-50,50), uniform(-5,5), q.x, q.y, q.z, q.w);
+   return buf;
+}
+
+static std::string lmrkLine(unsigned long id)
+{
+   char buf[256];
+   snprintf(buf, sizeof(buf), "%lu %.6f %.6f %.6f %.6f", id,
+            uniform(0,1), uniform(-50,50), uniform(-50,50), uniform(-5,5));
+   return buf;
+}
+
+static Landmark randomLandmark(unsigned int stamp)
+{
+   Landmark lmrk;
+   lmrk.point = glm::vec3(uniform(-100,100), uniform(-100,100), uniform(-10,10));
+   lmrk.quality = uniform(0,1);
+   lmrk.timestamp = stamp;
+   lmrk.slot = 0;
+   return lmrk;
+}
+
+/******************************************************************/
+/***************************  Benchmarks  *************************/
+/******************************************************************/
+
+//
+//  readPose: one pose line per tick
+//
+static void benchParsePose()
+{
+   std::vector<std::string> lines;
+   for (int i = 0; i < BENCH_POOL; i++)
+      lines.push_back(poseLine(i*0.016));
+   Pose pose;
+   measure("parsePose", 0, BENCH_OPS, [&]()
+   {
+      for (int i = 0; i < BENCH_OPS; i++)
+         parsePose(lines[i%BENCH_POOL], 2.0, pose);
+   });
+}
+
+//
+//  readLmrks: the landmark lines of a frame, n lines per run
+//
+static void benchParseLandmark(long n)
+{
+   std::vector<std::string> lines;
+   for (int i = 0; i < BENCH_POOL; i++)
+      lines.push_back(lmrkLine(rng()%n));
+   unsigned long id;
+   Landmark lmrk;
+   measure("parseLandmark", n, n, [&]()
+   {
+      for (long i = 0; i < n; i++)
+         parseLandmark(lines[i%BENCH_POOL], 7, 2.0, id, lmrk);
+   });
+}
+
+//
+//  readLmrks: a whole frame of BENCH_SIGHTINGS lines against a store of
+//  n landmarks through readLandmarkFrame, as SlamViz::readLmrks does it;
+//  the stamp advances every frame so the last frame's sightings that are
+//  not seen again marginalize, and sightings of inactive landmarks take
+//  their time slot back, with the BVH and scene graph updates and refit
+//
+static void benchReadFrame(long n)
+{
+   std::map<unsigned long, Landmark> lmrks;
+   PackedLandmarks inactive;
+   FrameTable frames;
+   TimeIndex times;
+   LandmarkBVH bvh;
+   SceneGraph graph;
+   std::vector<unsigned long> sighted, marginalized;
+   unsigned int stamp = 1;
+   uint32_t frame = frames.index(stamp);
+   for (long i = 0; i < n; i++)
+   {
+      Landmark lmrk = randomLandmark(stamp);
+      lmrk.slot = times.add(i, frame);
+      lmrks.insert(lmrks.end(), std::pair<unsigned long, Landmark>(i, lmrk));
+   }
+
+   // frame bodies are made up front and reused in turn with a new stamp
+   std::vector<std::string> bodies(BENCH_FRAMES);
+   for (int f = 0; f < BENCH_FRAMES; f++)
+   {
+      for (int i = 0; i < BENCH_SIGHTINGS; i++)
+         bodies[f] += lmrkLine(rng()%n) + "\n";
+      bodies[f] += "\n";
+   }
+   std::string text;
+   auto readFrame = [&]()
+   {
+      std::istringstream log(text);
+      sighted.clear();
+      marginalized.clear();
+      readLandmarkFrame(log, 2.0, lmrks, inactive, frames, times, sighted, marginalized);
+      for (unsigned int i = 0; i < sighted.size(); i++)
+      {
+         const Landmark &lmrk = lmrks.at(sighted[i]);
+         bvh.update(sighted[i], glm::value_ptr(lmrk.point), STAR_RADIUS*lmrk.quality);
+         graph.setLandmark(sighted[i], lmrk.point, lmrk.quality, true);
+      }
+      for (unsigned int i = 0; i < marginalized.size(); i++)
+      {
+         const PackedLandmark &packed = inactive.at(marginalized[i]);
+         glm::vec3 point = packedPoint(packed);
+         bvh.update(marginalized[i], glm::value_ptr(point), STAR_RADIUS*packedQuality(packed));
+         graph.setLandmark(marginalized[i], point, packedQuality(packed), false);
+      }
+      bvh.refit();
+   };
+   auto nextFrame = [&]()
+   {
+      stamp++;
+      text = std::to_string(stamp) + "\n" + bodies[stamp%BENCH_FRAMES];
+   };
+
+   // the first frame marginalizes the seeded store, untimed
+   nextFrame();
+   readFrame();
+   graph.update();
+
+   measure("readLmrks frame", n, 1, readFrame, nextFrame);
+}
+
+//
+//  readLmrks: the marginalization scan alone, BENCH_STALE percent of
+//  n active landmarks move to the inactive map; ns per landmark scanned
+//
+static void benchMarginalize(long n)
+{
+   std::map<unsigned long, Landmark> base;
+   for (long i = 0; i < n; i++)
+   {
+      unsigned int stamp = (long)(rng()%100) < BENCH_STALE ? 1 : 2;
+      base.insert(base.end(), std::pair<unsigned long, Landmark>(i, randomLandmark(stamp)));
+   }
+   std::map<unsigned long, Landmark> lmrks;
+   PackedLandmarks inactive;
+   FrameTable frames;
+   frames.index(1);
+   frames.index(2);
+   std::vector<unsigned long> ids;
+   measure("marginalize", n, n, [&]()
+   {
+      marginalize(lmrks, inactive, 2, frames, ids);
+   }, [&]()
+   {
+      lmrks = base;
+      inactive.clear();
+      ids.clear();
+   });
+}
+
+//
+//  addToPrevPoses: distance from the last kept pose
+//
+static void benchPrevPoses()
+{
+   std::vector<Pose> poses(BENCH_POOL);
+   for (int i = 0; i < BENCH_POOL; i++)
+      parsePose(poseLine(i*0.016), 2.0, poses[i]);
+   std::vector<Pose> prev;
+   prev.reserve(BENCH_OPS);
+   measure("addToPrevPoses", 0, BENCH_OPS, [&]()
+   {
+      for (int i = 1; i < BENCH_OPS; i++)
+         if (poseDistance(poses[i%BENCH_POOL], prev.back()) > POSE_SPACING)
+            prev.push_back(poses[i%BENCH_POOL]);
+   }, [&]() {prev.clear(); prev.push_back(poses[0]);});
+}
+
+//
+//  Landmark filtering: quality bound, active flag and frustum culling
+//  of n landmarks into the sorted draw list; ns per landmark
+//
+static void benchCollect(long n, JobSystem *jobs)
+{
+   SceneGraph graph;
+   for (long i = 0; i < n; i++)
+   {
+      Landmark lmrk = randomLandmark(1);
+      graph.setLandmark(i, lmrk.point, lmrk.quality, rng()%4 != 0);
+   }
+   graph.update();
+   std::vector<ViewCam> views(1);
+   setPerspective(views[0], 55, 16/9.0, 1, 400);
+   setLookAt(views[0], glm::vec3(0,60,120), glm::vec3(0,0,0), glm::vec3(0,1,0));
+   setFrustum(views[0]);
+   std::vector<DrawItem> list;
+   measure("collect", n, n, [&]()
+   {
+      graph.collect(views, 0.3, false, jobs, list);
+   });
+}
+
+//
+//  Time window: n landmarks first seen over n/100 frames, each seen for
+//  up to 20 frames, queried for a 10 frame window; ns per query
+//
+static void benchTimeWindow(long n)
+{
+   TimeIndex times;
+   uint32_t frames = std::max(n/100, 20L);
+   for (long i = 0; i < n; i++)
+   {
+      uint32_t first = (uint64_t)i*frames/n;
+      uint32_t slot = times.add(i, first);
+      times.seen(slot, first + rng()%20);
+   }
+   std::vector<unsigned long> ids;
+   measure("time window", n, 1, [&]()
+   {
+      ids.clear();
+      uint32_t f0 = rng()%(frames - 10);
+      times.query(f0, f0 + 9, ids);
+   });
+}
+
+//
+//  Star mesh: Star::loadOBJ became loadMesh, this is its parse step
+//
+static void benchParseOBJ(const char *path)
+{
+   std::ifstream file(path, std::ios::binary);
+   if (!file)
+   {
+      fprintf(stderr, "parseOBJ: cannot open %s, skipped\n", path);
+      return;
+   }
+   std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+   Mesh mesh;
+   measure("parseOBJ", 0, 1, [&]()
+   {
+      parseOBJ(data.data(), data.size(), mesh);
+   }, [&]() {mesh = Mesh();});
+}
+
+//
+//  Smoke puffs: the billboard rotations of SmokeBB::DrawSmoke
+//
+static void benchSmoke()
+{
+   std::vector<float> pts(3*BENCH_POOL);
+   for (unsigned int i = 0; i < pts.size(); i++)
+      pts[i] = uniform(-50,50);
+   float cam[3] = {10, 40, 80}, turn[4], tilt[4], sum = 0;
+   measure("SmokeBB::orient", 0, BENCH_OPS, [&]()
+   {
+      for (int i = 0; i < BENCH_OPS; i++)
+      {
+         SmokeBB::orient(cam, &pts[3*(i%BENCH_POOL)], turn, tilt);
+         sum += turn[0] + tilt[0];
+      }
+   });
+   // keeps the calls from being optimized away
+   if (sum == 12345) printf("\n");
+}
+
+static void usage()
+{
+   fprintf(stderr, "usage: SlamVizBench [-max <landmarks>] [-only <name>] [-csv <file>] [-obj <file>]\n");
+   exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+   long max_scale = BENCH_MAX_SCALE;
+   const char *only = NULL, *csv = NULL, *obj = "../star.obj";
+   for (int i = 1; i < argc; i++)
+   {
+      if (i+1 >= argc) usage();
+      if (!strcmp(argv[i], "-max")) max_scale = atol(argv[++i]);
+      else if (!strcmp(argv[i], "-only")) only = argv[++i];
+      else if (!strcmp(argv[i], "-csv")) csv = argv[++i];
+      else if (!strcmp(argv[i], "-obj")) obj = argv[++i];
+      else usage();
+   }
+   std::function<bool(const char*)> run = [&](const char *name) {return !only || !strcmp(only, name);};
+
+   JobSystem jobs;
+   printf("%-22s %10s %12s %10s\n", "benchmark", "landmarks", "ns/op", "allocs/op");
+   if (run("parsePose")) benchParsePose();
+   if (run("addToPrevPoses")) benchPrevPoses();
+   if (run("parseOBJ")) benchParseOBJ(obj);
+   if (run("SmokeBB::orient")) benchSmoke();
+   for (long n = 1000; n <= max_scale; n *= 10)
+   {
+      if (run("parseLandmark")) benchParseLandmark(n);
+      if (run("readLmrks frame")) benchReadFrame(n);
+      if (run("marginalize")) benchMarginalize(n);
+      if (run("collect")) benchCollect(n, &jobs);
+      if (run("time window")) benchTimeWindow(n);
+   }
+
+   if (csv)
+   {
+      FILE *f = fopen(csv, "w");
+      if (!f)
+      {
+         fprintf(stderr, "cannot write %s\n", csv);
+         return 1;
+      }
+      fprintf(f, "benchmark,landmarks,ns_per_op,allocs_per_op\n");
+      for (unsigned int i = 0; i < results.size(); i++)
+         fprintf(f, "%s,%ld,%.2f,%.3f\n", results[i].name.c_str(), results[i].scale,
+                 results[i].ns, results[i].allocs);
+      fclose(f);
+   }
+   return 0;
+}
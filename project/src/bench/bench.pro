@@ -0,0 +1,16 @@
+#  Project file for the SlamViz microbenchmarks
+#  Builds against the visualizer's own sources in the parent directory
+#
+#  List of header files
+HEADERS = ../SlamLog.h ../Star.h ../MemoryBudget.h ../TimeIndex.h ../SceneGraph.h ../MultiView.h ../JobSystem.h ../LandmarkBVH.h ../ObjMesh.h ../SmokeBB.h ../GLState.h ../AssetLoader.h ../GLUploader.h ../TexCache.h
+#  List of source files
+SOURCES = bench.cpp ../SlamLog.cpp ../TimeIndex.cpp ../SceneGraph.cpp ../MultiView.cpp ../JobSystem.cpp ../LandmarkBVH.cpp ../ObjMesh.cpp ../SmokeBB.cpp ../GLState.cpp ../AssetLoader.cpp ../GLUploader.cpp ../TexCache.cpp
+INCLUDEPATH += ..
+TARGET = SlamVizBench
+#  SmokeBB brings in the GL and Qt GUI classes it draws with
+QT += gui
+unix:!macx{
+	LIBS += -lGLU -lglut
+}
+CONFIG += c++11 console
+CONFIG -= app_bundle
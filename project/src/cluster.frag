@@ -0,0 +1,72 @@
+//  Clustered lighting fragment shader
+//  key light plus every landmark light binned into this fragment's cluster
+
+#version 330 compatibility
+
+in vec3 View;
+in vec3 Light;
+in vec3 Normal;
+in vec3 Pos;
+in vec4 Ambient;
+in vec2 Tex;
+uniform sampler2D tex;
+uniform samplerBuffer lights;    // position+radius, color+intensity
+uniform usamplerBuffer clusters; // offset+count into indices
+uniform usamplerBuffer indices;  // light index list
+uniform ivec3 grid;              // clusters in x, y and z
+uniform vec4 viewport;           // x, y, width, height
+uniform vec2 depth;              // near plane, log(far/near)
+
+vec4 phong(vec3 N)
+{
+   //  Emission and ambient color
+   vec4 color = Ambient;
+   //  L is the light vector
+   vec3 L = normalize(Light);
+   //  Diffuse light is cosine of light and normal vectors
+   float Id = dot(L,N);
+   if (Id>0.0)
+   {
+      //  Add diffuse
+      color += Id*gl_FrontLightProduct[0].diffuse;
+      //  R is the reflected light vector R = 2(L.N)N - L
+      vec3 R = reflect(-L,N);
+      //  V is the view vector (eye vector)
+      vec3 V = normalize(View);
+      //  Specular is cosine of reflected and view vectors
+      float Is = dot(R,V);
+      if (Is>0.0) color += pow(Is,gl_FrontMaterial.shininess)*gl_FrontLightProduct[0].specular;
+   }
+   return color;
+}
+
+void main()
+{
+   vec3 N = normalize(Normal);
+   vec4 color = phong(N);
+
+   //  Find this fragment's cluster
+   ivec3 c;
+   c.xy = ivec2((gl_FragCoord.xy - viewport.xy)/viewport.zw*vec2(grid.xy));
+   c.z = int(log(max(-Pos.z,depth.x)/depth.x)/depth.y*float(grid.z));
+   c = clamp(c, ivec3(0), grid-1);
+   uvec2 range = texelFetch(clusters, (c.z*grid.y + c.y)*grid.x + c.x).xy;
+
+   //  Landmark lights, diffuse with quadratic falloff to the radius
+   for (uint i=0u; i<range.y; i++)
+   {
+      int l = int(texelFetch(indices, int(range.x+i)).r);
+      vec4 pr = texelFetch(lights, 2*l);
+      vec4 ci = texelFetch(lights, 2*l+1);
+      vec3 L = pr.xyz - Pos;
+      float d = length(L);
+      if (d < pr.w)
+      {
+         float att = 1.0 - d/pr.w;
+         color.rgb += ci.a*att*att*max(dot(N,L/d),0.0)*ci.rgb*gl_FrontMaterial.diffuse.rgb;
+      }
+   }
+
+   //  Modulate by texture
+   gl_FragColor = color * texture2D(tex,Tex);
+}
@@ -0,0 +1,29 @@
+//  Clustered lighting vertex shader
+
+#version 330 compatibility
+
+out vec3 View;
+out vec3 Light;
+out vec3 Normal;
+out vec3 Pos;
+out vec4 Ambient;
+out vec2 Tex;
+
+void main()
+{
+   //  Vertex location in modelview coordinates
+   vec3 P = vec3(gl_ModelViewMatrix * gl_Vertex);
+   Pos = P;
+   //  Key light position
+   Light  = vec3(gl_LightSource[0].position) - P;
+   //  Normal
+   Normal = gl_NormalMatrix * gl_Normal;
+   //  Eye position
+   View  = -P;
+   //  Ambient color
+   Ambient = gl_FrontMaterial.emission + gl_FrontLightProduct[0].ambient + gl_LightModel.ambient*gl_FrontMaterial.ambient;
+   //  Texture coordinate for fragment shader
+   Tex = gl_MultiTexCoord0.st;
+   //  Set vertex position
+   gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+}
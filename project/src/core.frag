@@ -0,0 +1,43 @@
+//  Core profile scene fragment shader
+//  one point light with ambient, diffuse and specular terms, the
+//  diffuse and specular ones dropped where the shadow map is nearer
+
+#version 330 core
+
+in vec3 World;
+in vec3 Norm;
+in vec2 Tex0;
+in vec4 ShadowCoord;
+
+uniform vec4 Color;
+uniform bool Textured;
+uniform bool Lit;
+uniform float Specular;
+uniform float Shininess;
+uniform bool Shadowed;
+uniform sampler2D Tex;
+uniform sampler2DShadow Depth;
+uniform vec3 LightPos;
+uniform vec3 Eye;
+uniform float Ambient;
+uniform float Diffuse;
+
+out vec4 FragColor;
+
+void main()
+{
+   vec4 color = Color;
+   if (Textured) color *= texture(Tex, Tex0);
+   if (Lit)
+   {
+      vec3 N = normalize(gl_FrontFacing ? Norm : -Norm);
+      vec3 L = normalize(LightPos - World);
+      vec3 V = normalize(Eye - World);
+      float lit = 1.0;
+      if (Shadowed && ShadowCoord.w > 0.0) lit = textureProj(Depth, ShadowCoord);
+      float Id = max(dot(N,L), 0.0);
+      float Is = Id > 0.0 ? Specular*pow(max(dot(N, normalize(L+V)), 0.0), Shininess) : 0.0;
+      color.rgb = color.rgb*(Ambient + lit*Diffuse*Id) + vec3(lit*Is);
+   }
+   FragColor = color;
+}
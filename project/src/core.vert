@@ -0,0 +1,31 @@
+//  Core profile scene vertex shader
+//  the model matrix comes from a uniform, times a per-instance
+//  matrix for instanced stars
+
+#version 330 core
+
+layout(location = 0) in vec3 Position;
+layout(location = 1) in vec2 TexCoord;
+layout(location = 2) in vec3 Normal;
+layout(location = 4) in mat4 InstanceModel;
+
+uniform mat4 Model;
+uniform mat4 ViewProj;
+uniform mat4 ShadowMat;  // world to shadow map texture coordinates
+uniform bool Instanced;
+
+out vec3 World;
+out vec3 Norm;
+out vec2 Tex0;
+out vec4 ShadowCoord;
+
+void main()
+{
+   mat4 model = Instanced ? Model * InstanceModel : Model;
+   vec4 world = model * vec4(Position,1);
+   World = world.xyz;
+   Norm = mat3(model) * Normal;
+   Tex0 = TexCoord;
+   ShadowCoord = ShadowMat * world;
+   gl_Position = ViewProj * world;
+}
@@ -0,0 +1,8 @@
+//  Core profile depth-only fragment shader
+//  nothing to write, the depth test keeps the nearest depth
+
+#version 330 core
+
+void main()
+{
+}
@@ -0,0 +1,17 @@
+//  Core profile depth-only vertex shader
+//  positions only, for the shadow and occluder passes
+
+#version 330 core
+
+layout(location = 0) in vec3 Position;
+layout(location = 4) in mat4 InstanceModel;
+
+uniform mat4 Model;
+uniform mat4 ViewProj;
+uniform bool Instanced;
+
+void main()
+{
+   mat4 model = Instanced ? Model * InstanceModel : Model;
+   gl_Position = ViewProj * model * vec4(Position,1);
+}
@@ -3,6 +3,7 @@
 //
 
 #include <QApplication>
+#include <QSurfaceFormat>
 #include "viewer.h"
 
 //
@@ -10,10 +11,21 @@
 //
 int main(int argc, char *argv[])
 {
+   //  Request a 3.3 context that still allows the fixed-function path,
+   //  shared between the widget and the upload thread
+   QSurfaceFormat format;
+   format.setVersion(3,3);
+   format.setProfile(QSurfaceFormat::CompatibilityProfile);
+   format.setDepthBufferSize(24);
+   QSurfaceFormat::setDefaultFormat(format);
+   QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
    //  Create the application
    QApplication app(argc,argv);
    //  Create and show Viewer widget
    Viewer viewer;
+   //  -headless exports without ever mapping the window
+   if (app.arguments().contains("-headless"))
+      viewer.setAttribute(Qt::WA_DontShowOnScreen);
    viewer.show();
    //  Main loop for application
    return app.exec();
@@ -0,0 +1,12 @@
+//  Instanced star fragment shader
+//  texture modulated by the current color, as the fixed-function path
+
+#version 330 compatibility
+
+in vec2 Tex;
+uniform sampler2D tex;
+
+void main()
+{
+   gl_FragColor = gl_Color * texture2D(tex,Tex);
+}
@@ -0,0 +1,28 @@
+//  Instanced star vertex shader
+//  one StarInstance per star, 16-bit steps from Origin and an 8-bit
+//  quality; the model matrix is Star::facing toward Origin
+
+#version 330 compatibility
+
+layout(location = 4) in vec3 Steps;
+layout(location = 5) in float Quality;
+
+uniform vec4 Origin;   // xyz the view center, w the size of a step
+
+out vec2 Tex;
+
+void main()
+{
+   vec3 c = Origin.xyz + Origin.w*Steps;
+   //  facing() with up along x, rotated 90 about z and scaled
+   vec3 d = normalize(c - Origin.xyz);
+   vec3 u = vec3(1,0,0);
+   vec3 s = cross(d,u);
+   mat4 Model = mat4(vec4(-d.y,d.x,d.z,0)*Quality,
+                     vec4(-u.y,u.x,u.z,0)*Quality,
+                     vec4(-s.y,s.x,s.z,0)*Quality,
+                     vec4(c,1));
+   Tex = gl_MultiTexCoord0.st;
+   gl_FrontColor = gl_Color;
+   gl_Position = gl_ModelViewProjectionMatrix * Model * gl_Vertex;
+}
@@ -0,0 +1,8 @@
+//  Depth-only star fragment shader
+//  colour writes are masked off, only depth is kept
+
+#version 330 compatibility
+
+void main()
+{
+}
@@ -0,0 +1,11 @@
+//  Depth-only instanced star vertex shader
+//  positions only, for the shadow pass
+
+#version 330 compatibility
+
+layout(location = 4) in mat4 Model;
+
+void main()
+{
+   gl_Position = gl_ModelViewProjectionMatrix * Model * gl_Vertex;
+}
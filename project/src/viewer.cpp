@@ -39,14 +39,29 @@ Viewer::Viewer(QWidget* parent)
    QDoubleSpinBox* land_lower = new QDoubleSpinBox();
    QCheckBox* track_pose = new QCheckBox("Track Pose With Cam");
    QCheckBox* prev_poses = new QCheckBox("Show Prev Poses");
+   QCheckBox* lmrk_lights = new QCheckBox("Landmark Lights");
+   QCheckBox* multi_view = new QCheckBox("Multi View");
+   QCheckBox* profiler = new QCheckBox("Show Profiler");
+   QCheckBox* time_window = new QCheckBox("Time Window");
+   QDoubleSpinBox* time_from = new QDoubleSpinBox();
+   QDoubleSpinBox* time_to = new QDoubleSpinBox();
 
    QLabel* dim = new QLabel();
+   QLabel* pick_info = new QLabel();
 
    land_lower->setDecimals(2);
    land_lower->setSingleStep(0.01);
    land_lower->setRange(0.01,1.0);
    land_lower->setValue(0.03);
 
+   //  Window bounds are log stamps
+   time_from->setDecimals(0);
+   time_from->setRange(0,TIME_WINDOW_END);
+   time_from->setValue(0);
+   time_to->setDecimals(0);
+   time_to->setRange(0,TIME_WINDOW_END);
+   time_to->setValue(TIME_WINDOW_END);
+
    //  Connect valueChanged() signals to Lorenz slots
    connect(reset, SIGNAL(clicked(void)), slam_viz, SLOT(reset(void)));
    connect(display, SIGNAL(clicked(void)), slam_viz, SLOT(toggleDisplay(void)));
@@ -57,8 +72,15 @@ Viewer::Viewer(QWidget* parent)
    connect(land_lower, SIGNAL(valueChanged(double)), slam_viz, SLOT(setLmrkDispBound(double)));
    connect(track_pose, SIGNAL(clicked(void)), slam_viz, SLOT(togglePoseTrack(void)));
    connect(prev_poses, SIGNAL(clicked(void)), slam_viz, SLOT(togglePrevPoses(void)));
+   connect(lmrk_lights, SIGNAL(clicked(void)), slam_viz, SLOT(toggleLmrkLights(void)));
+   connect(multi_view, SIGNAL(clicked(void)), slam_viz, SLOT(toggleMultiView(void)));
+   connect(profiler, SIGNAL(clicked(void)), slam_viz, SLOT(toggleProfiler(void)));
+   connect(time_window, SIGNAL(clicked(void)), slam_viz, SLOT(toggleTimeWindow(void)));
+   connect(time_from, SIGNAL(valueChanged(double)), slam_viz, SLOT(setTimeFrom(double)));
+   connect(time_to, SIGNAL(valueChanged(double)), slam_viz, SLOT(setTimeTo(double)));
    //  Connect lorenz signals to display widgets
    connect(slam_viz, SIGNAL(dimen(QString)), dim, SLOT(setText(QString)));
+   connect(slam_viz, SIGNAL(pickInfo(QString)), pick_info, SLOT(setText(QString)));
 
 
    //  Connect combo box to setPAR in myself
@@ -87,6 +109,15 @@ Viewer::Viewer(QWidget* parent)
    dsplay->addWidget(inactive,8,0);
    dsplay->addWidget(track_pose,9,0);
    dsplay->addWidget(prev_poses,10,0);
+   dsplay->addWidget(lmrk_lights,11,0);
+   dsplay->addWidget(multi_view,12,0);
+   dsplay->addWidget(profiler,13,0);
+   dsplay->addWidget(time_window,14,0);
+   dsplay->addWidget(time_from,15,0);
+   dsplay->addWidget(new QLabel("Seen From"),15,1);
+   dsplay->addWidget(time_to,16,0);
+   dsplay->addWidget(new QLabel("Seen To"),16,1);
+   dsplay->addWidget(pick_info,17,0,1,2);
    dspbox->setLayout(dsplay);
    layout->addWidget(dspbox,2,1);
 